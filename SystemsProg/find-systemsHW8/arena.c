@@ -0,0 +1,138 @@
+/* arena.c: Chunked arena allocator */
+
+#include "findit.h"
+
+#include <stdlib.h>
+
+/* Chunk Structure */
+
+struct Chunk {
+    Chunk  *next;       // Next (older) chunk
+    size_t  size;       // Usable bytes after header
+    size_t  used;       // Bytes handed out so far
+};
+
+#define ARENA_ALIGN     sizeof(void *)
+#define ARENA_ROUND(n)  (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+/* Chunk Functions */
+
+/**
+ * Allocate a new chunk with at least size usable bytes.
+ * @param   size        Usable bytes
+ * @return  Pointer to new Chunk structure (NULL on failure).
+ **/
+static Chunk *chunk_create(size_t size) {
+    Chunk *c = malloc(ARENA_ROUND(sizeof(Chunk)) + size);
+    if (c) {
+        c->next = NULL;
+        c->size = size;
+        c->used = 0;
+    }
+    return c;
+}
+
+/**
+ * Return pointer to the first usable byte of chunk.
+ * @param   c           Pointer to Chunk structure
+ * @return  Pointer to chunk data.
+ **/
+static char *chunk_data(Chunk *c) {
+    return (char *)c + ARENA_ROUND(sizeof(Chunk));
+}
+
+/* Arena Functions */
+
+/**
+ * Follow merges to the arena that currently owns a's chunks.
+ * @param   a           Pointer to Arena structure
+ * @return  Pointer to owning Arena structure.
+ **/
+static Arena *arena_root(Arena *a) {
+    while (a->owner) {
+        a = a->owner;
+    }
+    return a;
+}
+
+/**
+ * Allocate a new Arena.  The Arena structure itself lives at the start of its
+ * first chunk, so releasing the chunks releases everything.
+ * @return  Pointer to new Arena structure (must be deleted).
+ **/
+Arena * arena_create(void) {
+    Chunk *c = chunk_create(ARENA_CHUNK);
+    if (!c) return NULL;
+
+    Arena *a  = (Arena *)chunk_data(c);
+    c->used   = ARENA_ROUND(sizeof(Arena));
+    a->chunks = c;
+    a->owner  = NULL;
+    return a;
+}
+
+/**
+ * Allocate size bytes (pointer aligned) from arena.  When the current chunk
+ * is full, a new one twice its size (up to ARENA_MAXCHUNK) is started.
+ * @param   a           Pointer to Arena structure
+ * @param   size        Number of bytes
+ * @return  Pointer to memory valid until the arena is deleted (NULL on failure).
+ **/
+void *  arena_alloc(Arena *a, size_t size) {
+    a = arena_root(a);
+    size = ARENA_ROUND(size);
+
+    Chunk *c = a->chunks;
+    if (c->size - c->used < size) {
+        size_t grown = c->size < ARENA_MAXCHUNK ? 2 * c->size : ARENA_MAXCHUNK;
+        Chunk *n     = chunk_create(size > grown ? size : grown);
+        if (!n) return NULL;
+        n->next   = c;
+        a->chunks = n;
+        c         = n;
+    }
+
+    void *p  = chunk_data(c) + c->used;
+    c->used += size;
+    return p;
+}
+
+/**
+ * Move every chunk of src into dst, so deleting dst also releases memory
+ * allocated from src.  Later allocations from src are served by dst.
+ * @param   dst         Pointer to Arena structure to merge into
+ * @param   src         Pointer to Arena structure to merge from
+ **/
+void    arena_merge(Arena *dst, Arena *src) {
+    dst = arena_root(dst);
+    src = arena_root(src);
+    if (dst == src) return;
+
+    // Keep dst's current chunk first, so it continues to be filled
+    Chunk *last = src->chunks;
+    while (last->next) {
+        last = last->next;
+    }
+    last->next          = dst->chunks->next;
+    dst->chunks->next   = src->chunks;
+    src->chunks         = NULL;
+    src->owner          = dst;
+}
+
+/**
+ * Deallocate arena (and every arena merged into it) in one pass over its
+ * chunks.
+ * @param   a           Pointer to Arena structure
+ **/
+void    arena_delete(Arena *a) {
+    if (!a) return;
+
+    Chunk *c = arena_root(a)->chunks;
+    while (c) {
+        Chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
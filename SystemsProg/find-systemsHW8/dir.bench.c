@@ -0,0 +1,118 @@
+/* dir.bench.c: directory reader benchmark */
+
+#include "findit.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+/* Functions */
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void make_entries(const char *root, size_t count) {
+    char path[BUFSIZ];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(path, BUFSIZ, "%s/entry-%08zu", root, i);
+        int fd = open(path, O_CREAT | O_WRONLY, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "open: %s: %s\n", path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+}
+
+void remove_entries(const char *root, size_t count) {
+    char path[BUFSIZ];
+    for (size_t i = 0; i < count; i++) {
+        snprintf(path, BUFSIZ, "%s/entry-%08zu", root, i);
+        unlink(path);
+    }
+    rmdir(root);
+}
+
+/**
+ * Read every entry of root with the given reader, best of rounds.
+ * @param   root        Directory to read
+ * @param   size        Size of getdents64 buffer (ignored for libc)
+ * @param   libc        Whether or not to use libc readdir
+ * @param   rounds      Number of rounds
+ * @param   entries     Set to number of entries read
+ * @param   batches     Set to number of getdents64 batches (0 for libc)
+ * @return  Best elapsed time in seconds.
+ **/
+double bench_read(const char *root, size_t size, bool libc, int rounds, size_t *entries, size_t *batches) {
+    double best = 0;
+    for (int r = 0; r < rounds; r++) {
+        int fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        Dir d;
+        if (fd < 0 || !dir_open(&d, fd, size, libc)) {
+            fprintf(stderr, "dir_open: %s: %s\n", root, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        const char   *name;
+        unsigned char type;
+        size_t        offset = 0;
+        *entries = 0;
+        *batches = 0;
+
+        double start = now();
+        while (dir_read(&d, &name, &type)) {
+            if (d.buffer && d.offset <= offset) (*batches)++;
+            offset = d.offset;
+            (*entries)++;
+        }
+        double elapsed = now() - start;
+        dir_close(&d);
+
+        if (!r || elapsed < best) best = elapsed;
+    }
+    return best;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    size_t count  = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    int    rounds = argc > 2 ? atoi(argv[2]) : 5;
+
+    char root[] = "/tmp/dir.bench.XXXXXX";
+    if (!mkdtemp(root)) {
+        fprintf(stderr, "mkdtemp: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    make_entries(root, count);
+
+    static const struct { const char *name; size_t size; bool libc; } Readers[] = {
+        {"readdir",         0,          true},
+        {"getdents64",      4096,       false},
+        {"getdents64",      32768,      false},
+        {"getdents64",      DIR_BUFSIZE,false},
+        {"getdents64",      1 << 20,    false},
+        {NULL,              0,          false},
+    };
+
+    printf("reader\tbuffer\tentries\tbatches\tns/entry\n");
+    for (size_t i = 0; Readers[i].name; i++) {
+        size_t entries, batches;
+        double elapsed = bench_read(root, Readers[i].size, Readers[i].libc, rounds, &entries, &batches);
+        printf("%s\t%zu\t%zu\t%zu\t%.1f\n", Readers[i].name, Readers[i].size,
+            entries, batches, elapsed * 1e9 / entries);
+    }
+
+    remove_entries(root, count);
+    return EXIT_SUCCESS;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
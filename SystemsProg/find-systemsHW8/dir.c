@@ -0,0 +1,115 @@
+/* dir.c: Directory reading functions */
+
+#include "findit.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+
+/* Linux Directory Record */
+
+struct linux_dirent64 {
+    uint64_t        d_ino;      // Inode number
+    int64_t         d_off;      // Offset to next record
+    unsigned short  d_reclen;   // Size of this record
+    unsigned char   d_type;     // File type
+    char            d_name[];   // NUL-terminated file name
+};
+#endif
+
+/* Directory Functions */
+
+/**
+ * Open directory stream on file descriptor.  On Linux, entries are read in
+ * batches with getdents64 into a buffer of the given size; elsewhere (or when
+ * readdir is requested) the libc readdir stream is used.
+ * @param   d           Pointer to Dir structure
+ * @param   fd          Directory file descriptor (owned by d, even on failure)
+ * @param   size        Size of getdents64 buffer (0 for DIR_BUFSIZE)
+ * @param   libc        Whether or not to use libc readdir
+ * @return  Whether or not the directory could be opened.
+ **/
+bool    dir_open(Dir *d, int fd, size_t size, bool libc) {
+    memset(d, 0, sizeof(Dir));
+    d->fd = fd;
+
+#ifdef __linux__
+    if (!libc) {
+        if (!size)               size = DIR_BUFSIZE;
+        if (size < DIR_MINIMUM)  size = DIR_MINIMUM;
+
+        if ((d->buffer = malloc(size))) {
+            d->size = size;
+            return true;
+        }
+    }
+#endif
+
+    if (!(d->stream = fdopendir(fd))) {
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Read next entry from directory stream.
+ * @param   d           Pointer to Dir structure
+ * @param   name        Set to entry name (valid until next read)
+ * @param   type        Set to entry d_type
+ * @return  Whether or not an entry was read (false at end or on error).
+ **/
+bool    dir_read(Dir *d, const char **name, unsigned char *type) {
+#ifdef __linux__
+    if (d->buffer) {
+        if (d->offset >= d->length) {
+            long n = syscall(SYS_getdents64, d->fd, d->buffer, d->size);
+            if (n <= 0) return false;
+            d->length = n;
+            d->offset = 0;
+        }
+
+        struct linux_dirent64 *r = (struct linux_dirent64 *)(d->buffer + d->offset);
+        d->offset += r->d_reclen;
+        *name = r->d_name;
+        *type = r->d_type;
+        return true;
+    }
+#endif
+
+    struct dirent *e = readdir(d->stream);
+    if (!e) return false;
+    *name = e->d_name;
+    *type = e->d_type;
+    return true;
+}
+
+/**
+ * Return file descriptor of directory stream (for *at calls).
+ * @param   d           Pointer to Dir structure
+ * @return  Directory file descriptor.
+ **/
+int     dir_fd(Dir *d) {
+    return d->fd;
+}
+
+/**
+ * Close directory stream and its file descriptor.
+ * @param   d           Pointer to Dir structure
+ **/
+void    dir_close(Dir *d) {
+    if (d->stream) {
+        closedir(d->stream);
+    } else {
+        close(d->fd);
+    }
+    free(d->buffer);
+    memset(d, 0, sizeof(Dir));
+    d->fd = -1;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,504 @@
+/* dupes.c: Duplicate file detection */
+
+#include "findit.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Constants */
+
+#define PRIME1  0x9E3779B185EBCA87ULL
+#define PRIME2  0xC2B2AE3D27D4EB4FULL
+#define PRIME3  0x165667B19E3779F9ULL
+#define PRIME4  0x85EBCA77C2B2AE63ULL
+#define PRIME5  0x27D4EB2F165667C5ULL
+
+/* Hash Structure */
+
+typedef struct {
+    uint64_t    lanes[4];   // Accumulators, one per 8 bytes of each stripe
+    uint8_t     stripe[32]; // Bytes not yet consumed
+    size_t      used;       // Number of bytes in stripe
+    uint64_t    total;      // Number of bytes hashed
+} Hash;
+
+/* Dupe Structure */
+
+typedef struct {
+    const char *path;       // Path of file
+    size_t      index;      // Position in walk order
+    off_t       size;       // Size in bytes
+    dev_t       dev;        // Device
+    ino_t       ino;        // Inode number
+    uint64_t    hash;       // Hash of first DUPES_HEAD bytes, then of all
+    size_t      set;        // Walk order of first file of its set, once compared
+    const char *first;      // Path of first file of its set (NULL if not compared yet)
+    bool        same;       // Whether or not contents match first file of its set
+    bool        candidate;  // Whether or not file may still have a duplicate
+} Dupe;
+
+/* Hasher Structure */
+
+typedef struct {
+    Dupe          **dupes;  // Files to hash
+    size_t          count;  // Number of files
+    off_t           limit;  // Bytes to hash from each (0 for all)
+    bool            compare;// Compare with first file of set instead of hashing
+    atomic_size_t   next;   // Index of next file to claim
+} Hasher;
+
+/* Hash Functions */
+
+static uint64_t hash_rotate(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t hash_round(uint64_t lane, uint64_t input) {
+    lane += input * PRIME2;
+    return hash_rotate(lane, 31) * PRIME1;
+}
+
+static uint64_t hash_read64(const uint8_t *p) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static uint32_t hash_read32(const uint8_t *p) {
+    uint32_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+/**
+ * Initialize streaming hash (xxh64 with seed 0).
+ * @param   h           Pointer to Hash structure
+ **/
+static void hash_init(Hash *h) {
+    h->lanes[0] = PRIME1 + PRIME2;
+    h->lanes[1] = PRIME2;
+    h->lanes[2] = 0;
+    h->lanes[3] = -PRIME1;
+    h->used     = 0;
+    h->total    = 0;
+}
+
+/**
+ * Add bytes to streaming hash, a 32-byte stripe at a time.
+ * @param   h           Pointer to Hash structure
+ * @param   data        Bytes to add
+ * @param   n           Number of bytes
+ **/
+static void hash_update(Hash *h, const void *data, size_t n) {
+    const uint8_t *p = data;
+
+    h->total += n;
+    if (h->used) {
+        size_t fill = sizeof(h->stripe) - h->used < n ? sizeof(h->stripe) - h->used : n;
+        memcpy(h->stripe + h->used, p, fill);
+        h->used += fill;
+        p       += fill;
+        n       -= fill;
+        if (h->used < sizeof(h->stripe)) return;
+
+        for (int i = 0; i < 4; i++) {
+            h->lanes[i] = hash_round(h->lanes[i], hash_read64(h->stripe + 8 * i));
+        }
+        h->used = 0;
+    }
+
+    for (; n >= sizeof(h->stripe); p += sizeof(h->stripe), n -= sizeof(h->stripe)) {
+        for (int i = 0; i < 4; i++) {
+            h->lanes[i] = hash_round(h->lanes[i], hash_read64(p + 8 * i));
+        }
+    }
+
+    memcpy(h->stripe, p, n);
+    h->used = n;
+}
+
+/**
+ * Finish streaming hash.
+ * @param   h           Pointer to Hash structure
+ * @return  64-bit hash of every byte added.
+ **/
+static uint64_t hash_final(Hash *h) {
+    uint64_t value;
+
+    if (h->total >= sizeof(h->stripe)) {
+        value = hash_rotate(h->lanes[0], 1) + hash_rotate(h->lanes[1], 7) +
+                hash_rotate(h->lanes[2], 12) + hash_rotate(h->lanes[3], 18);
+        for (int i = 0; i < 4; i++) {
+            value = (value ^ hash_round(0, h->lanes[i])) * PRIME1 + PRIME4;
+        }
+    } else {
+        value = PRIME5;
+    }
+    value += h->total;
+
+    const uint8_t *p = h->stripe;
+    size_t         n = h->used;
+    for (; n >= 8; p += 8, n -= 8) {
+        value ^= hash_round(0, hash_read64(p));
+        value  = hash_rotate(value, 27) * PRIME1 + PRIME4;
+    }
+    if (n >= 4) {
+        value ^= (uint64_t)hash_read32(p) * PRIME1;
+        value  = hash_rotate(value, 23) * PRIME2 + PRIME3;
+        p += 4;
+        n -= 4;
+    }
+    for (; n; p++, n--) {
+        value ^= *p * PRIME5;
+        value  = hash_rotate(value, 11) * PRIME1;
+    }
+
+    value ^= value >> 33;
+    value *= PRIME2;
+    value ^= value >> 29;
+    value *= PRIME3;
+    value ^= value >> 32;
+    return value;
+}
+
+/* Dupe Functions */
+
+/**
+ * Order files by size, then identity, then walk order.
+ **/
+static int dupe_compare_identity(const void *a, const void *b) {
+    const Dupe *x = a;
+    const Dupe *y = b;
+    if (x->size != y->size) return x->size < y->size ? -1 : 1;
+    if (x->dev  != y->dev)  return x->dev  < y->dev  ? -1 : 1;
+    if (x->ino  != y->ino)  return x->ino  < y->ino  ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/**
+ * Order files by whether they are still candidates, size, hash, set, then
+ * walk order, so every set of duplicates is a run of candidates.
+ **/
+static int dupe_compare_hash(const void *a, const void *b) {
+    const Dupe *x = a;
+    const Dupe *y = b;
+    if (x->candidate != y->candidate) return x->candidate ? -1 : 1;
+    if (x->size != y->size) return x->size < y->size ? -1 : 1;
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    if (x->set  != y->set)  return x->set  < y->set  ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/**
+ * Determine whether two files belong to the same run of candidates.
+ **/
+static bool dupe_alike(const Dupe *x, const Dupe *y) {
+    return y->candidate && x->size == y->size && x->hash == y->hash && x->set == y->set;
+}
+
+/**
+ * Order sets (pointers to their first file) by walk order of first file.
+ **/
+static int dupe_compare_set(const void *a, const void *b) {
+    const Dupe *x = *(Dupe * const *)a;
+    const Dupe *y = *(Dupe * const *)b;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/**
+ * Hash up to limit bytes of file (all of it if limit is 0), reading through
+ * buffer so memory stays the same whatever the file's size.  Files that
+ * cannot be read, or that changed size, stop being candidates.
+ * @param   d           Pointer to Dupe structure
+ * @param   limit       Number of bytes to hash (0 for all)
+ * @param   buffer      Read buffer of DUPES_BUFSIZE bytes
+ **/
+static void dupe_hash(Dupe *d, off_t limit, char *buffer) {
+    int fd = open(d->path, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) {
+        d->candidate = false;
+        return;
+    }
+
+    Hash    h;
+    off_t   wanted = limit && limit < d->size ? limit : d->size;
+    off_t   total  = 0;
+    ssize_t n      = 0;
+
+    hash_init(&h);
+    while (total < wanted) {
+        size_t chunk = wanted - total < DUPES_BUFSIZE ? wanted - total : DUPES_BUFSIZE;
+        if ((n = read(fd, buffer, chunk)) <= 0) break;
+        hash_update(&h, buffer, n);
+        total += n;
+    }
+    close(fd);
+
+    d->hash      = hash_final(&h);
+    d->candidate = total == wanted;
+}
+
+/**
+ * Compare contents of file with those of the first file of its set, as cmp
+ * does, reading both through buffer.  Files that cannot be read stop being
+ * candidates.
+ * @param   d           Pointer to Dupe structure
+ * @param   buffer      Read buffer of 2 * DUPES_BUFSIZE bytes
+ **/
+static void dupe_compare(Dupe *d, char *buffer) {
+    int fd0 = open(d->first, O_RDONLY | O_NOCTTY | O_CLOEXEC);
+    int fd1 = open(d->path,  O_RDONLY | O_NOCTTY | O_CLOEXEC);
+    if (fd0 < 0 || fd1 < 0) {
+        d->candidate = false;
+        goto cleanup;
+    }
+
+    // Short reads are topped up so both sides are compared a buffer at a time
+    for (;;) {
+        ssize_t n[2] = {0, 0};
+        for (int i = 0; i < 2; i++) {
+            char   *b  = buffer + i * DUPES_BUFSIZE;
+            ssize_t r  = 1;
+            while (n[i] < DUPES_BUFSIZE && (r = read(i ? fd1 : fd0, b + n[i], DUPES_BUFSIZE - n[i])) > 0) {
+                n[i] += r;
+            }
+            if (r < 0) {
+                d->candidate = false;
+                goto cleanup;
+            }
+        }
+        if (n[0] != n[1] || memcmp(buffer, buffer + DUPES_BUFSIZE, n[0]) != 0) break;
+        if (n[0] < DUPES_BUFSIZE) {
+            d->same = true;
+            break;
+        }
+    }
+
+cleanup:
+    if (fd0 >= 0) close(fd0);
+    if (fd1 >= 0) close(fd1);
+}
+
+/**
+ * Hashing thread: claim files one at a time until none are left.
+ * @param   arg         Pointer to Hasher structure
+ * @return  NULL
+ **/
+static void *dupe_worker(void *arg) {
+    Hasher *h      = arg;
+    char   *buffer = malloc(2 * DUPES_BUFSIZE);
+    size_t  i;
+
+    if (!buffer) return NULL;
+    while ((i = atomic_fetch_add(&h->next, 1)) < h->count) {
+        if (h->compare) {
+            dupe_compare(h->dupes[i], buffer);
+        } else {
+            dupe_hash(h->dupes[i], h->limit, buffer);
+        }
+    }
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * Hash files (or compare each with the first file of its set) with a pool of
+ * jobs threads (on the calling thread if none can be started).
+ * @param   dupes       Files to hash
+ * @param   count       Number of files
+ * @param   limit       Number of bytes to hash from each (0 for all)
+ * @param   compare     Whether or not to compare instead of hashing
+ * @param   jobs        Number of threads
+ **/
+static void dupe_hash_all(Dupe **dupes, size_t count, off_t limit, bool compare, size_t jobs) {
+    Hasher    h = {.dupes = dupes, .count = count, .limit = limit, .compare = compare};
+    pthread_t threads[DUPES_MAXJOBS];
+    size_t    started = 0;
+
+    if (jobs > count) jobs = count;
+    if (jobs > DUPES_MAXJOBS) jobs = DUPES_MAXJOBS;
+    atomic_init(&h.next, 0);
+
+    for (; jobs > 1 && started < jobs; started++) {
+        if (pthread_create(&threads[started], NULL, dupe_worker, &h) != 0) break;
+    }
+    dupe_worker(&h);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+/**
+ * Keep as candidates only files in runs of at least two that agree on size
+ * (and on hash, if by_hash), and collect the ones larger than head (which
+ * need their whole content hashed).
+ * @param   dupes       Files sorted so that equal keys are adjacent
+ * @param   count       Number of files
+ * @param   by_hash     Whether or not runs must also agree on hash
+ * @param   head        Files larger than this are collected
+ * @param   pending     Set to candidates larger than head
+ * @return  Number of files collected in pending.
+ **/
+static size_t dupe_narrow(Dupe *dupes, size_t count, bool by_hash, off_t head, Dupe **pending) {
+    size_t n = 0;
+
+    for (size_t start = 0, end; start < count; start = end) {
+        for (end = start + 1; end < count && (by_hash ? dupe_alike(&dupes[start], &dupes[end]) :
+                              dupes[end].candidate && dupes[end].size == dupes[start].size); end++);
+
+        for (size_t i = start; i < end; i++) {
+            dupes[i].candidate = dupes[i].candidate && end - start > 1;
+            if (dupes[i].candidate && dupes[i].size > head) {
+                pending[n++] = &dupes[i];
+            }
+        }
+    }
+    return n;
+}
+
+/**
+ * Compare every file of each run with the first file of the run, until the
+ * files of every run are known to have identical contents: files that differ
+ * from the first of their run are moved to a run of their own, which is
+ * compared again, so a hash collision never passes for a duplicate.
+ * @param   dupes       Files sorted so that runs are adjacent
+ * @param   count       Number of files
+ * @param   jobs        Number of comparing threads
+ * @param   pending     Room for pointers to count files
+ **/
+static void dupe_confirm(Dupe *dupes, size_t count, size_t jobs, Dupe **pending) {
+    for (;;) {
+        size_t n     = 0;
+        size_t total = 0;
+        for (size_t start = 0, end; start < count && dupes[start].candidate; start = end, total = end) {
+            for (end = start + 1; end < count && dupe_alike(&dupes[start], &dupes[end]); end++) {
+                if (!dupes[end].same) {
+                    dupes[end].first = dupes[start].path;
+                    pending[n++]     = &dupes[end];
+                }
+            }
+        }
+        if (!n) break;
+        dupe_hash_all(pending, n, 0, true, jobs);
+
+        // Files that differ start a new set at the first of them (some may
+        // have stopped being candidates, so runs are bounded by key alone)
+        for (size_t start = 0, end; start < total; start = end) {
+            size_t set = 0;
+            for (end = start + 1; end < total && dupes[end].size == dupes[start].size &&
+                                  dupes[end].hash == dupes[start].hash && dupes[end].set == dupes[start].set; end++);
+            for (size_t i = start + 1; i < end; i++) {
+                if (dupes[i].candidate && !dupes[i].same) {
+                    set = set ? set : dupes[i].index;
+                    dupes[i].set = set;
+                }
+            }
+        }
+        qsort(dupes, count, sizeof(Dupe), dupe_compare_hash);
+        dupe_narrow(dupes, count, true, -1, pending);
+        qsort(dupes, count, sizeof(Dupe), dupe_compare_hash);
+    }
+}
+
+/* Dupes Functions */
+
+/**
+ * Find sets of regular files with identical contents among files.  Files are
+ * bucketed by size, same-size files are told apart by a hash of their first
+ * DUPES_HEAD bytes, only those still alike have their whole contents hashed,
+ * and files whose hashes agree are compared byte for byte, with jobs threads
+ * streaming through fixed buffers each.  Empty
+ * files, and extra links to a file already listed, are left out.
+ * @param   files       List of paths
+ * @param   jobs        Number of hashing threads
+ * @param   follow      Whether or not to follow symbolic links
+ * @param   visit       Called with each set of duplicates, in walk order
+ * @param   arg         Argument passed to visit
+ * @return  Number of sets found (or -1 if memory ran out).
+ **/
+ssize_t dupes_find(List *files, size_t jobs, bool follow, DupesVisitor visit, void *arg) {
+    size_t count = 0;
+    for (Node *n = files->head; n; n = n->next) count++;
+
+    Dupe        *dupes   = calloc(count ? count : 1, sizeof(Dupe));
+    Dupe       **pending = calloc(count ? count : 1, sizeof(Dupe *));
+    const char **paths   = calloc(count ? count : 1, sizeof(char *));
+    if (!dupes || !pending || !paths) {
+        free(dupes);
+        free(pending);
+        free(paths);
+        return -1;
+    }
+
+    // Bucket by size, dropping everything but non-empty regular files
+    size_t      n = 0;
+    size_t      index = 0;
+    struct stat st;
+    for (Node *node = files->head; node; node = node->next, index++) {
+        const char *path = node->data.string;
+        if ((follow ? stat(path, &st) : lstat(path, &st)) < 0) continue;
+        if (!S_ISREG(st.st_mode) || st.st_size == 0) continue;
+
+        dupes[n++] = (Dupe){
+            .path = path, .index = index, .size = st.st_size,
+            .dev  = st.st_dev, .ino = st.st_ino, .candidate = true,
+        };
+    }
+    qsort(dupes, n, sizeof(Dupe), dupe_compare_identity);
+
+    // The same file reached by another path is not a duplicate of itself
+    for (size_t i = 1; i < n; i++) {
+        if (dupes[i].size == dupes[i - 1].size && dupes[i].dev == dupes[i - 1].dev && dupes[i].ino == dupes[i - 1].ino) {
+            dupes[i].candidate = false;
+        }
+    }
+    qsort(dupes, n, sizeof(Dupe), dupe_compare_hash);
+    dupe_narrow(dupes, n, false, -1, pending);
+
+    // Hash heads of same-size files, then whole contents of alike large ones
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (dupes[i].candidate) pending[m++] = &dupes[i];
+    }
+    dupe_hash_all(pending, m, DUPES_HEAD, false, jobs);
+    qsort(dupes, n, sizeof(Dupe), dupe_compare_hash);
+
+    m = dupe_narrow(dupes, n, true, DUPES_HEAD, pending);
+    dupe_hash_all(pending, m, 0, false, jobs);
+    qsort(dupes, n, sizeof(Dupe), dupe_compare_hash);
+    dupe_narrow(dupes, n, true, -1, pending);
+    qsort(dupes, n, sizeof(Dupe), dupe_compare_hash);
+
+    // Files alike in size and hash are only duplicates once compared
+    dupe_confirm(dupes, n, jobs, pending);
+
+    // Report sets in the order their first files were walked
+    size_t sets = 0;
+    for (size_t start = 0, end; start < n && dupes[start].candidate; start = end) {
+        for (end = start + 1; end < n && dupe_alike(&dupes[start], &dupes[end]); end++);
+        pending[sets++] = &dupes[start];
+    }
+    qsort(pending, sets, sizeof(Dupe *), dupe_compare_set);
+
+    for (size_t s = 0; s < sets; s++) {
+        Dupe  *first = pending[s];
+        size_t size  = 0;
+        for (Dupe *d = first; d < dupes + n && dupe_alike(first, d); d++) {
+            paths[size++] = d->path;
+        }
+        visit(paths, size, arg);
+    }
+
+    free(dupes);
+    free(pending);
+    free(paths);
+    return sets;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
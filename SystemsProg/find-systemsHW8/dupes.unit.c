@@ -0,0 +1,339 @@
+/* dupes.unit.c: duplicate file detection unit test */
+
+#include "findit.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+#define nargs(a)    (sizeof(a) / sizeof((a)[0]))
+
+#define FILES       600
+#define CONTENTS    150
+
+/* Structures */
+
+typedef struct {
+    char    text[1 << 16];  // Sets reported, one path per line, blank line after each
+    size_t  length;         // Bytes of text used
+    size_t  sets;           // Number of sets reported
+} Report;
+
+/* Functions */
+
+/**
+ * DupesVisitor that appends set to Report.
+ **/
+void report_set(const char **paths, size_t n, void *arg) {
+    Report *r = arg;
+    for (size_t i = 0; i < n; i++) {
+        r->length += snprintf(r->text + r->length, sizeof(r->text) - r->length, "%s\n", paths[i]);
+    }
+    r->length += snprintf(r->text + r->length, sizeof(r->text) - r->length, "\n");
+    r->sets++;
+    assert(r->length < sizeof(r->text));
+}
+
+/**
+ * Write size bytes of pseudo-random content (determined by seed) to path,
+ * with the byte at offset flip changed if flip is less than size.
+ * @param   path        Path of file to create
+ * @param   size        Size in bytes
+ * @param   seed        Seed of content
+ * @param   flip        Offset of byte to change
+ **/
+void make_file(const char *path, size_t size, unsigned int seed, size_t flip) {
+    char *buffer = malloc(size + 1);
+    assert(buffer);
+    for (size_t i = 0; i < size; i++) {
+        buffer[i] = rand_r(&seed);
+    }
+    if (flip < size) buffer[flip] ^= 1;
+
+    FILE *stream = fopen(path, "w");
+    assert(stream && fwrite(buffer, 1, size, stream) == size);
+    fclose(stream);
+    free(buffer);
+}
+
+/**
+ * Compare strings through pointers, for qsort.
+ **/
+int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/**
+ * Rewrite report with paths sorted within each set and sets sorted, so it can
+ * be compared whatever order directories were read in.
+ * @param   r           Pointer to Report structure
+ **/
+void canonical(Report *r) {
+    char  *sets[FILES];
+    char   copy[sizeof(r->text)];
+    size_t n = 0;
+
+    memcpy(copy, r->text, r->length + 1);
+    for (char *start = copy, *end; (end = strstr(start, "\n\n")); start = end + 2) {
+        char  *paths[FILES];
+        size_t count = 0;
+
+        *end = 0;
+        for (char *line = strtok(start, "\n"); line; line = strtok(NULL, "\n")) {
+            paths[count++] = line;
+        }
+        qsort(paths, count, sizeof(char *), compare_strings);
+
+        size_t length = 0;
+        for (size_t i = 0; i < count; i++) length += strlen(paths[i]) + 1;
+        sets[n] = calloc(length + 1, 1);
+        assert(sets[n]);
+        for (size_t i = 0; i < count; i++) {
+            strcat(strcat(sets[n], paths[i]), "\n");
+        }
+        n++;
+    }
+    qsort(sets, n, sizeof(char *), compare_strings);
+
+    r->length = 0;
+    r->text[0] = 0;
+    for (size_t i = 0; i < n; i++) {
+        r->length += snprintf(r->text + r->length, sizeof(r->text) - r->length, "%s\n", sets[i]);
+        free(sets[i]);
+    }
+}
+
+/**
+ * Position of path in walk order.
+ * @param   files       List of walked paths
+ * @param   path        Path to find
+ * @return  Index of path in files.
+ **/
+size_t position(List *files, const char *path) {
+    size_t i = 0;
+    for (Node *n = files->head; n; n = n->next, i++) {
+        if (streq(n->data.string, path)) return i;
+    }
+    assert(false);
+    return i;
+}
+
+/**
+ * Check that paths of each set, and first paths of sets, follow walk order.
+ * @param   r           Pointer to Report structure
+ * @param   files       List of walked paths
+ **/
+void check_order(Report *r, List *files) {
+    char   copy[sizeof(r->text)];
+    size_t last = 0;
+    bool   first_set = true;
+
+    memcpy(copy, r->text, r->length + 1);
+    for (char *start = copy, *end; (end = strstr(start, "\n\n")); start = end + 2) {
+        size_t previous = 0;
+        bool   first = true;
+
+        *end = 0;
+        for (char *line = strtok(start, "\n"); line; line = strtok(NULL, "\n")) {
+            size_t i = position(files, line);
+            assert(first || i > previous);
+            if (first) {
+                assert(first_set || i > last);
+                last = i;
+            }
+            previous  = i;
+            first     = false;
+            first_set = false;
+        }
+    }
+}
+
+/**
+ * Find duplicates beneath root, walked in order and filtered by expression.
+ * @param   root        Directory to walk
+ * @param   argv        Expression arguments (NULL-terminated)
+ * @param   jobs        Number of hashing threads
+ * @param   r           Pointer to Report structure to fill in
+ * @return  Number of sets found.
+ **/
+ssize_t find_dupes(const char *root, char *argv[], size_t jobs, Report *r) {
+    int argc = 0;
+    while (argv[argc]) argc++;
+
+    List  files = {0};
+    Expr *expr  = expr_parse(argc, argv, NULL);
+    assert(expr);
+    find_files(root, &files, expr);
+
+    memset(r, 0, sizeof(Report));
+    ssize_t sets = dupes_find(&files, jobs, false, report_set, r);
+    assert(sets == (ssize_t)r->sets);
+    check_order(r, &files);
+
+    list_delete(&files, false);
+    expr_delete(expr);
+    return sets;
+}
+
+/* Tests */
+
+int test_00_dupes_find() {
+    char root[] = "/tmp/dupes.unit.XXXXXX";
+    char path[BUFSIZ];
+    assert(mkdtemp(root));
+    assert(chdir(root) == 0);
+
+    // Fixture: small and large sets, near misses at the head, tail, and
+    // buffer boundary, empty files, links, and a directory
+    assert(mkdir("a", 0755) == 0 && mkdir("b", 0755) == 0);
+    make_file("a/x", 100, 1, -1);
+    make_file("b/y", 100, 1, -1);
+    make_file("z", 100, 1, -1);
+    make_file("a/w", 100, 2, -1);                       // Same size, other content
+    make_file("big1", 300000, 3, -1);
+    make_file("big2", 300000, 3, -1);
+    make_file("big3", 300000, 3, 299999);               // Same head, other tail
+    make_file("big4", 300000, 3, 0);                    // Other head
+    make_file("big5", 300000, 3, DUPES_BUFSIZE);        // Differs right after first buffer
+    make_file("big6", 300000, 3, DUPES_HEAD);           // Differs right after head
+    make_file("head1", DUPES_HEAD, 4, -1);
+    make_file("head2", DUPES_HEAD, 4, -1);
+    make_file("head3", DUPES_HEAD + 1, 4, -1);          // Longer by a byte
+    make_file("e1", 0, 0, -1);
+    make_file("e2", 0, 0, -1);
+    make_file("solo", 200, 5, -1);
+    assert(link("solo", "b/hard") == 0);                // Same file, not a copy
+    assert(symlink("z", "sym") == 0);
+    assert(mkdir("c", 0755) == 0);
+
+    // Test: sets in walk order, each in walk order, same for every job count
+    char *everything[] = {NULL};
+    char *expected =
+        "./a/x\n./b/y\n./z\n\n"
+        "./big1\n./big2\n\n"
+        "./head1\n./head2\n\n";
+    for (size_t jobs = 1; jobs <= 8; jobs *= 2) {
+        Report r;
+        assert(find_dupes(".", everything, jobs, &r) == 3);
+        canonical(&r);
+        assert(streq(r.text, expected));
+    }
+
+    // Test: expression limits which files are compared
+    Report r;
+    char  *named[] = {"-name", "big*", NULL};
+    assert(find_dupes(".", named, 2, &r) == 1);
+    canonical(&r);
+    assert(streq(r.text, "./big1\n./big2\n\n"));
+
+    char *typed[] = {"-type", "d", NULL};
+    assert(find_dupes(".", typed, 2, &r) == 0 && r.length == 0);
+
+    // Test: files that vanish after the walk are skipped
+    List files = {0};
+    find_files(".", &files, NULL);
+    assert(unlink("big2") == 0);
+    memset(&r, 0, sizeof(r));
+    assert(dupes_find(&files, 4, false, report_set, &r) == 2);
+    check_order(&r, &files);
+    canonical(&r);
+    assert(streq(r.text, "./a/x\n./b/y\n./z\n\n./head1\n./head2\n\n"));
+    list_delete(&files, false);
+
+    // Test: no files
+    memset(&r, 0, sizeof(r));
+    assert(dupes_find(&files, 4, false, report_set, &r) == 0);
+
+    assert(chdir("/") == 0);
+    snprintf(path, BUFSIZ, "rm -fr %s", root);
+    assert(system(path) == 0);
+    return EXIT_SUCCESS;
+}
+
+int test_01_dupes_many() {
+    char root[] = "/tmp/dupes.unit.XXXXXX";
+    char path[BUFSIZ];
+    assert(mkdtemp(root));
+    assert(chdir(root) == 0);
+
+    // Fixture: many files drawn from fewer contents, with sizes around the
+    // head and buffer boundaries and several contents of each size
+    static const size_t sizes[] = {
+        1, 31, 32, 33, DUPES_HEAD - 1, DUPES_HEAD, DUPES_HEAD + 1,
+        DUPES_BUFSIZE - 1, DUPES_BUFSIZE, DUPES_BUFSIZE + 1, 3 * DUPES_BUFSIZE + 7,
+    };
+    unsigned int seed  = 20289;
+    int          users[CONTENTS] = {0};
+    int          owner[FILES];
+    for (int i = 0; i < FILES; i++) {
+        int c = rand_r(&seed) % CONTENTS;
+        snprintf(path, BUFSIZ, "f%04d", i);
+        make_file(path, sizes[c % nargs(sizes)], c, -1);
+        owner[i] = c;
+        users[c]++;
+    }
+
+    // Test: every content used more than once is exactly one set
+    size_t expected = 0;
+    for (int c = 0; c < CONTENTS; c++) {
+        expected += users[c] > 1;
+    }
+
+    char  *files[] = {NULL};
+    Report r;
+    assert(find_dupes(".", files, 4, &r) == (ssize_t)expected);
+
+    char *start = r.text;
+    for (size_t s = 0; s < r.sets; s++) {
+        char *end = strstr(start, "\n\n");
+        assert(end);
+        *end = 0;
+
+        int c = -1, count = 0;
+        for (char *line = strtok(start, "\n"); line; line = strtok(NULL, "\n"), count++) {
+            int i = atoi(line + strlen("./f"));
+            if (c < 0) c = owner[i];
+            assert(owner[i] == c);
+        }
+        assert(count == users[c]);
+        start = end + 2;
+    }
+
+    assert(chdir("/") == 0);
+    snprintf(path, BUFSIZ, "rm -fr %s", root);
+    assert(system(path) == 0);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test dupes_find\n");
+        fprintf(stderr, "    1  Test dupes_find on many files\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_dupes_find(); break;
+        case 1:  status = test_01_dupes_many(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,69 @@
+/* entry.c: Entry functions */
+
+#include "findit.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+
+/* Entry Functions */
+
+/**
+ * Initialize Entry structure for a path resolved from the current directory.
+ * @param   e           Pointer to Entry structure
+ * @param   path        Path string (must outlive the Entry)
+ **/
+void    entry_init(Entry *e, const char *path) {
+    size_t end   = strlen(path);
+    size_t start;
+
+    e->path   = path;
+    e->length = end;
+    e->name   = path;
+    e->dirfd  = AT_FDCWD;
+    e->type   = DT_UNKNOWN;
+    e->status = 0;
+    e->follow = false;
+    e->prune  = false;
+
+    // Basename is the last component, ignoring trailing slashes
+    while (end > 1 && path[end - 1] == '/') end--;
+    for (start = end; start > 0 && path[start - 1] != '/'; start--);
+    if (start == end && end > 0) start = end - 1;
+
+    e->base    = start;
+    e->baselen = end - start;
+}
+
+/**
+ * Return lstat information for entry (stat information when following links,
+ * unless the link is broken), fetching it relative to the parent directory on
+ * first use and reusing it for every later predicate.
+ * @param   e           Pointer to Entry structure
+ * @return  Pointer to cached stat structure or NULL on failure.
+ **/
+struct stat *   entry_stat(Entry *e) {
+    if (!e->status) {
+        e->status = fstatat(e->dirfd, e->name, &e->st, e->follow ? 0 : AT_SYMLINK_NOFOLLOW) < 0 ? -1 : 1;
+        if (e->status < 0 && e->follow) {
+            e->status = fstatat(e->dirfd, e->name, &e->st, AT_SYMLINK_NOFOLLOW) < 0 ? -1 : 1;
+        }
+    }
+    return e->status > 0 ? &e->st : NULL;
+}
+
+/**
+ * Return file type bits (S_IFMT) of entry, using d_type from readdir when the
+ * file system reports it (and it is not a link to follow) so that no stat is
+ * needed.
+ * @param   e           Pointer to Entry structure
+ * @return  File type bits or 0 if the type cannot be determined.
+ **/
+mode_t          entry_type(Entry *e) {
+    if (e->type != DT_UNKNOWN && !(e->follow && e->type == DT_LNK)) return DTTOIF(e->type);
+
+    struct stat *s = entry_stat(e);
+    return s ? (s->st_mode & S_IFMT) : 0;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
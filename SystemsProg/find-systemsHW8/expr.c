@@ -0,0 +1,612 @@
+/* expr.c: Filter expression functions */
+
+#include "findit.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define	streq(a, b) (strcmp(a, b) == 0)
+
+/* Costs */
+
+#define COST_NAME       1       // String match on basename
+#define COST_TYPE       2       // Usually d_type, otherwise one cached stat
+#define COST_STAT       4       // One stat, shared by every stat predicate
+#define COST_ACCESS     8       // Always a faccessat system call
+#define COST_EMPTY      16      // Stat, or opening and reading a directory
+#define COST_PRUNE      0       // Flag store (never reordered, see expr_optimize)
+#define COST_CONTAINS   1024    // Opening and reading whole file, always last
+
+/* Parser Structure */
+
+typedef struct {
+    char  **tokens;     // Expression tokens (global options removed)
+    size_t  ntokens;    // Number of tokens
+    size_t  next;       // Index of next token to consume
+} Parser;
+
+/* Predicate Structure */
+
+typedef struct {
+    const char *flag;                               // Command line flag
+    Filter      filter;                             // Filter function
+    Bound       bound;                              // Range test (may be NULL)
+    int         cost;                               // Estimated cost
+    bool        argument;                           // Whether flag takes an argument
+    bool        effect;                             // Whether filter has side effects
+    bool        stat;                               // Whether filter stats every entry
+    bool      (*parse)(Options *, const char *);    // Fill in operands
+} Predicate;
+
+/* Operand Functions */
+
+static bool parse_type(Options *options, const char *arg) {
+    switch (arg[0] && !arg[1] ? arg[0] : 0) {
+        case 'f': options->type = S_IFREG;  break;
+        case 'd': options->type = S_IFDIR;  break;
+        case 'l': options->type = S_IFLNK;  break;
+        case 'b': options->type = S_IFBLK;  break;
+        case 'c': options->type = S_IFCHR;  break;
+        case 'p': options->type = S_IFIFO;  break;
+        case 's': options->type = S_IFSOCK; break;
+        default:  return false;
+    }
+    return true;
+}
+
+static bool parse_name(Options *options, const char *arg) {
+    options->name    = (char *)arg;
+    options->matcher = matcher_create(arg, false);
+    return options->matcher != NULL;
+}
+
+static bool parse_iname(Options *options, const char *arg) {
+    options->name    = (char *)arg;
+    options->matcher = matcher_create(arg, true);
+    return options->matcher != NULL;
+}
+
+/**
+ * Parse signed number such as "+7" into options.
+ * @param   options     Pointer to Options structure
+ * @param   arg         Operand
+ * @param   end         Set to first byte after number
+ * @return  Whether or not a number was parsed.
+ **/
+static bool parse_number(Options *options, const char *arg, char **end) {
+    options->compare = *arg == '+' ? 1 : (*arg == '-' ? -1 : 0);
+    if (options->compare) arg++;
+    if (*arg < '0' || *arg > '9') return false;
+
+    options->number = strtoll(arg, end, 10);
+    return true;
+}
+
+static bool parse_size(Options *options, const char *arg) {
+    char *end;
+    if (!parse_number(options, arg, &end)) return false;
+
+    switch (*end) {
+        case 'c':  options->unit = 1;          break;
+        case 'w':  options->unit = 2;          break;
+        case 0:
+        case 'b':  options->unit = 512;        break;
+        case 'k':  options->unit = 1 << 10;    break;
+        case 'M':  options->unit = 1 << 20;    break;
+        case 'G':  options->unit = 1 << 30;    break;
+        default:   return false;
+    }
+    return !*end || !end[1];
+}
+
+static bool parse_mtime(Options *options, const char *arg) {
+    char *end;
+    return parse_number(options, arg, &end) && !*end &&
+           clock_gettime(CLOCK_REALTIME, &options->time) == 0;
+}
+
+static bool parse_newer(Options *options, const char *arg) {
+    struct stat s;
+    if (lstat(arg, &s) < 0) return false;
+    options->time = s.st_mtim;
+    return true;
+}
+
+static bool parse_empty(Options *options, const char *arg) {
+    return true;
+}
+
+static bool parse_prune(Options *options, const char *arg) {
+    return true;
+}
+
+static bool parse_contains(Options *options, const char *arg) {
+    options->name   = (char *)arg;
+    options->length = strlen(arg);
+    return true;
+}
+
+static bool parse_executable(Options *options, const char *arg) {
+    options->mode = X_OK;
+    return true;
+}
+
+static bool parse_readable(Options *options, const char *arg) {
+    options->mode = R_OK;
+    return true;
+}
+
+static bool parse_writable(Options *options, const char *arg) {
+    options->mode = W_OK;
+    return true;
+}
+
+/* Predicate Table */
+
+static Predicate Predicates[] = {
+    {"-type",       filter_by_type,     NULL,           COST_TYPE,     true,  false, false, parse_type},
+    {"-name",       filter_by_name,     NULL,           COST_NAME,     true,  false, false, parse_name},
+    {"-iname",      filter_by_name,     NULL,           COST_NAME,     true,  false, false, parse_iname},
+    {"-size",       filter_by_size,     bound_by_size,  COST_STAT,     true,  false, true,  parse_size},
+    {"-mtime",      filter_by_mtime,    bound_by_mtime, COST_STAT,     true,  false, true,  parse_mtime},
+    {"-newer",      filter_by_newer,    bound_by_newer, COST_STAT,     true,  false, true,  parse_newer},
+    {"-empty",      filter_by_empty,    NULL,           COST_EMPTY,    false, false, true,  parse_empty},
+    {"-executable", filter_by_mode,     NULL,           COST_ACCESS,   false, false, false, parse_executable},
+    {"-readable",   filter_by_mode,     NULL,           COST_ACCESS,   false, false, false, parse_readable},
+    {"-writable",   filter_by_mode,     NULL,           COST_ACCESS,   false, false, false, parse_writable},
+    {"-prune",      filter_by_prune,    NULL,           COST_PRUNE,    false, true,  false, parse_prune},
+    {"-contains",   filter_by_contains, NULL,           COST_CONTAINS, true,  false, false, parse_contains},
+    {NULL,          NULL,               NULL,           0,             false, false, false, NULL},
+};
+
+/* Node Functions */
+
+/**
+ * Allocate a new Expr structure.
+ * @param   type        Type of expression node
+ * @return  Pointer to new Expr structure (must be deleted).
+ **/
+static Expr *expr_create(ExprType type) {
+    Expr *e = calloc(1, sizeof(Expr));
+    if (e) {
+        e->type = type;
+    }
+    return e;
+}
+
+/**
+ * Add child to operator node.
+ * @param   e           Pointer to operator Expr structure
+ * @param   child       Pointer to child Expr structure (owned by e on success)
+ * @return  Whether or not the child was added.
+ **/
+static bool expr_add(Expr *e, Expr *child) {
+    Expr **children = realloc(e->children, (e->nchildren + 1) * sizeof(Expr *));
+    if (!children) return false;
+
+    e->children = children;
+    e->children[e->nchildren++] = child;
+    e->cost   += child->cost;
+    e->effect |= child->effect;
+    e->stat   |= child->stat;
+    return true;
+}
+
+/* Parser Functions */
+
+static Expr *parse_or(Parser *p);
+
+/**
+ * Peek at next token without consuming it.
+ * @param   p           Pointer to Parser structure
+ * @return  Next token or NULL at end of expression.
+ **/
+static const char *parse_peek(Parser *p) {
+    return p->next < p->ntokens ? p->tokens[p->next] : NULL;
+}
+
+/**
+ * Parse a predicate or a parenthesized expression.
+ * @param   p           Pointer to Parser structure
+ * @return  Pointer to new Expr structure or NULL on error.
+ **/
+static Expr *parse_primary(Parser *p) {
+    const char *token = parse_peek(p);
+    if (!token) return NULL;
+    p->next++;
+
+    if (streq(token, "(")) {
+        Expr *e = parse_or(p);
+        const char *close = parse_peek(p);
+        if (!e || !close || !streq(close, ")")) {
+            expr_delete(e);
+            return NULL;
+        }
+        p->next++;
+        return e;
+    }
+
+    for (Predicate *d = Predicates; d->flag; d++) {
+        if (!streq(token, d->flag)) continue;
+
+        const char *arg = NULL;
+        if (d->argument) {
+            if (!(arg = parse_peek(p))) return NULL;
+            p->next++;
+        }
+
+        Expr *e = expr_create(EXPR_FILTER);
+        if (!e) return NULL;
+        e->filter = d->filter;
+        e->bound  = d->bound;
+        e->cost   = d->cost;
+        e->effect = d->effect;
+        e->stat   = d->stat;
+        if (!d->parse(&e->options, arg)) {
+            expr_delete(e);
+            return NULL;
+        }
+        return e;
+    }
+
+    return NULL;
+}
+
+/**
+ * Parse an optionally negated primary.
+ * @param   p           Pointer to Parser structure
+ * @return  Pointer to new Expr structure or NULL on error.
+ **/
+static Expr *parse_not(Parser *p) {
+    const char *token = parse_peek(p);
+    if (token && (streq(token, "!") || streq(token, "-not"))) {
+        p->next++;
+
+        Expr *child = parse_not(p);
+        Expr *e     = child ? expr_create(EXPR_NOT) : NULL;
+        if (!e || !expr_add(e, child)) {
+            expr_delete(child);
+            free(e);
+            return NULL;
+        }
+        return e;
+    }
+    return parse_primary(p);
+}
+
+/**
+ * Parse a chain of explicitly or implicitly AND-ed terms.
+ * @param   p           Pointer to Parser structure
+ * @return  Pointer to new Expr structure or NULL on error.
+ **/
+static Expr *parse_and(Parser *p) {
+    Expr *first = parse_not(p);
+    if (!first) return NULL;
+
+    Expr *e = NULL;
+    for (const char *token = parse_peek(p); token; token = parse_peek(p)) {
+        if (streq(token, "-o") || streq(token, "-or") || streq(token, ")")) break;
+        if (streq(token, "-a") || streq(token, "-and")) p->next++;
+
+        Expr *next = parse_not(p);
+        if (!next) {
+            expr_delete(e ? e : first);
+            return NULL;
+        }
+
+        if (!e) {
+            if (!(e = expr_create(EXPR_AND)) || !expr_add(e, first)) {
+                free(e);
+                expr_delete(first);
+                expr_delete(next);
+                return NULL;
+            }
+        }
+        if (!expr_add(e, next)) {
+            expr_delete(e);
+            expr_delete(next);
+            return NULL;
+        }
+    }
+
+    return e ? e : first;
+}
+
+/**
+ * Parse a chain of OR-ed terms.
+ * @param   p           Pointer to Parser structure
+ * @return  Pointer to new Expr structure or NULL on error.
+ **/
+static Expr *parse_or(Parser *p) {
+    Expr *first = parse_and(p);
+    if (!first) return NULL;
+
+    Expr *e = NULL;
+    for (const char *token = parse_peek(p); token; token = parse_peek(p)) {
+        if (!streq(token, "-o") && !streq(token, "-or")) break;
+        p->next++;
+
+        Expr *next = parse_and(p);
+        if (!next) {
+            expr_delete(e ? e : first);
+            return NULL;
+        }
+
+        if (!e) {
+            if (!(e = expr_create(EXPR_OR)) || !expr_add(e, first)) {
+                free(e);
+                expr_delete(first);
+                expr_delete(next);
+                return NULL;
+            }
+        }
+        if (!expr_add(e, next)) {
+            expr_delete(e);
+            expr_delete(next);
+            return NULL;
+        }
+    }
+
+    return e ? e : first;
+}
+
+/**
+ * Consume global option at argv[i] into walk settings.
+ * @param   argc        Number of arguments
+ * @param   argv        Array of arguments
+ * @param   i           Index of current argument (advanced past operands)
+ * @param   walk        Pointer to Walk structure (NULL accepts none)
+ * @return  1 if consumed, 0 if not a global option, -1 on invalid operand.
+ **/
+static int parse_global(int argc, char *argv[], int *i, Walk *walk) {
+    if (!walk) return 0;
+
+    if (streq(argv[*i], "-j")) {
+        if (*i + 1 >= argc || atoi(argv[*i + 1]) < 1) return -1;
+        walk->jobs = atoi(argv[++*i]);
+        return 1;
+    }
+    if (streq(argv[*i], "-unordered")) {
+        walk->unordered = true;
+        return 1;
+    }
+    if (streq(argv[*i], "-dirbuf")) {
+        if (*i + 1 >= argc || atoi(argv[*i + 1]) < DIR_MINIMUM) return -1;
+        walk->dirbuf = atoi(argv[++*i]);
+        return 1;
+    }
+    if (streq(argv[*i], "-readdir")) {
+        walk->readdir = true;
+        return 1;
+    }
+    if (streq(argv[*i], "-uring")) {
+        walk->uring = true;
+        return 1;
+    }
+    if (streq(argv[*i], "-mindepth")) {
+        if (*i + 1 >= argc || atoi(argv[*i + 1]) < 0) return -1;
+        walk->mindepth = atoi(argv[++*i]);
+        return 1;
+    }
+    if (streq(argv[*i], "-maxdepth")) {
+        if (*i + 1 >= argc || atoi(argv[*i + 1]) < 0) return -1;
+        walk->maxdepth = atoi(argv[++*i]) + 1;
+        return 1;
+    }
+    if (streq(argv[*i], "-xdev")) {
+        walk->xdev = true;
+        return 1;
+    }
+    if (streq(argv[*i], "-L")) {
+        walk->follow = true;
+        return 1;
+    }
+    return 0;
+}
+
+/* Expression Functions */
+
+/**
+ * Compile command line arguments into an expression tree.  Global options
+ * (such as -j) may appear anywhere and are stored in walk instead.
+ * @param   argc        Number of arguments
+ * @param   argv        Array of arguments
+ * @param   walk        Pointer to Walk structure for global options (may be NULL)
+ * @return  Pointer to new Expr structure (must be deleted) or NULL on error.
+ **/
+Expr *  expr_parse(int argc, char *argv[], Walk *walk) {
+    Parser p = {0};
+    p.tokens = calloc(argc + 1, sizeof(char *));
+    if (!p.tokens) return NULL;
+
+    // Separate global options from expression tokens, keeping predicate
+    // operands attached to their flag
+    for (int i = 0; i < argc; i++) {
+        int status = parse_global(argc, argv, &i, walk);
+        if (status < 0) {
+            free(p.tokens);
+            return NULL;
+        }
+        if (status > 0) continue;
+
+        p.tokens[p.ntokens++] = argv[i];
+        for (Predicate *d = Predicates; d->flag; d++) {
+            if (d->argument && streq(argv[i], d->flag) && i + 1 < argc) {
+                p.tokens[p.ntokens++] = argv[++i];
+                break;
+            }
+        }
+    }
+
+    Expr *e = NULL;
+    if (!p.ntokens) {
+        e = expr_create(EXPR_TRUE);
+    } else if ((e = parse_or(&p)) && p.next < p.ntokens) {
+        // Leftover tokens (such as an unmatched ")")
+        expr_delete(e);
+        e = NULL;
+    }
+
+    free(p.tokens);
+    if (e) {
+        expr_optimize(e);
+    }
+    return e;
+}
+
+/**
+ * Determine whether flag is a predicate that takes an operand (such as -name).
+ * @param   flag        Command line argument
+ * @return  Whether or not the argument after flag is its operand.
+ **/
+bool    expr_operand(const char *flag) {
+    for (Predicate *d = Predicates; d->flag; d++) {
+        if (d->argument && streq(flag, d->flag)) return true;
+    }
+    return false;
+}
+
+/**
+ * Flatten nested operators of the same kind and reorder the operands of every
+ * AND and OR so that the cheapest ones run first.  Reordering predicates that
+ * are free of side effects never changes the result, only how many system
+ * calls short-circuiting saves; operands with side effects (-prune) act as
+ * barriers that nothing is moved across.
+ * @param   e           Pointer to Expr structure
+ **/
+void    expr_optimize(Expr *e) {
+    if (!e) return;
+
+    for (size_t i = 0; i < e->nchildren; i++) {
+        expr_optimize(e->children[i]);
+    }
+
+    if (e->type != EXPR_AND && e->type != EXPR_OR) return;
+
+    // Pull grandchildren of the same operator up into this node
+    for (size_t i = 0; i < e->nchildren; i++) {
+        Expr *c = e->children[i];
+        if (c->type != e->type) continue;
+
+        Expr **children = realloc(e->children, (e->nchildren + c->nchildren - 1) * sizeof(Expr *));
+        if (!children) return;
+        e->children = children;
+
+        memmove(e->children + i + c->nchildren, e->children + i + 1, (e->nchildren - i - 1) * sizeof(Expr *));
+        memcpy(e->children + i, c->children, c->nchildren * sizeof(Expr *));
+        e->nchildren += c->nchildren - 1;
+        i += c->nchildren - 1;
+
+        free(c->children);
+        free(c);
+    }
+
+    // Stable insertion sort by cost keeps equal-cost operands in order
+    for (size_t i = 1; i < e->nchildren; i++) {
+        Expr  *c = e->children[i];
+        size_t j = i;
+        if (c->effect) continue;
+        while (j > 0 && !e->children[j - 1]->effect && e->children[j - 1]->cost > c->cost) {
+            e->children[j] = e->children[j - 1];
+            j--;
+        }
+        e->children[j] = c;
+    }
+}
+
+/**
+ * Evaluate expression on entry, short-circuiting AND and OR.
+ * @param   e           Pointer to Expr structure
+ * @param   entry       Pointer to Entry structure
+ * @return  Whether or not the entry matches the expression.
+ **/
+bool    expr_evaluate(Expr *e, Entry *entry) {
+    switch (e->type) {
+        case EXPR_TRUE:
+            return true;
+        case EXPR_FILTER:
+            return e->filter(entry, &e->options);
+        case EXPR_NOT:
+            return !expr_evaluate(e->children[0], entry);
+        case EXPR_AND:
+            for (size_t i = 0; i < e->nchildren; i++) {
+                if (!expr_evaluate(e->children[i], entry)) return false;
+            }
+            return true;
+        case EXPR_OR:
+            for (size_t i = 0; i < e->nchildren; i++) {
+                if (expr_evaluate(e->children[i], entry)) return true;
+            }
+            return false;
+    }
+    return false;
+}
+
+/**
+ * Bound expression over every entry whose metadata lies within range.
+ * @param   e           Pointer to Expr structure
+ * @param   range       Pointer to Range structure
+ * @return  -1 if no such entry matches, 1 if every one does, 0 otherwise.
+ **/
+static int expr_bound(Expr *e, const Range *range) {
+    int bound;
+
+    switch (e->type) {
+        case EXPR_TRUE:
+            return 1;
+        case EXPR_FILTER:
+            return e->bound ? e->bound(range, &e->options) : 0;
+        case EXPR_NOT:
+            return -expr_bound(e->children[0], range);
+        case EXPR_AND:
+            bound = 1;
+            for (size_t i = 0; i < e->nchildren && bound >= 0; i++) {
+                int b = expr_bound(e->children[i], range);
+                bound = b < bound ? b : bound;
+            }
+            return bound;
+        case EXPR_OR:
+            bound = -1;
+            for (size_t i = 0; i < e->nchildren && bound <= 0; i++) {
+                int b = expr_bound(e->children[i], range);
+                bound = b > bound ? b : bound;
+            }
+            return bound;
+    }
+    return 0;
+}
+
+/**
+ * Determine if any entry whose size and mtime lie within range could match
+ * expression, so that callers holding such a summary for a whole subtree
+ * (such as an index) can skip it without looking at its entries.
+ * @param   e           Pointer to Expr structure
+ * @param   range       Pointer to Range structure
+ * @return  Whether or not some entry within range might match.
+ **/
+bool    expr_possible(Expr *e, const Range *range) {
+    return expr_bound(e, range) >= 0;
+}
+
+/**
+ * Deallocate expression tree.
+ * @param   e           Pointer to Expr structure
+ **/
+void    expr_delete(Expr *e) {
+    if (!e) return;
+
+    for (size_t i = 0; i < e->nchildren; i++) {
+        expr_delete(e->children[i]);
+    }
+    matcher_delete(e->options.matcher);
+    free(e->children);
+    free(e);
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,218 @@
+/* expr.unit.c: filter expression unit test */
+
+#include "findit.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+#define nargs(a)    (sizeof(a) / sizeof((a)[0]))
+
+/* Globals */
+
+int Calls = 0;
+
+/* Functions */
+
+Expr *parse(int argc, char *argv[]) {
+    return expr_parse(argc, argv, NULL);
+}
+
+bool matches(Expr *e, const char *path) {
+    Entry entry;
+    entry_init(&entry, path);
+    return expr_evaluate(e, &entry);
+}
+
+bool filter_by_count(Entry *entry, Options *options) {
+    Calls++;
+    return true;
+}
+
+/* Tests */
+
+int test_00_expr_parse() {
+    // Test: empty expression matches everything
+    Expr *e = parse(0, NULL);
+    assert(e && e->type == EXPR_TRUE);
+    assert(matches(e, "Makefile"));
+    expr_delete(e);
+
+    // Test: repeated flags keep their own operands
+    char *names[] = {"-name", "*.c", "-name", "f*"};
+    e = parse(nargs(names), names);
+    assert(e && e->type == EXPR_AND && e->nchildren == 2);
+    assert(streq(e->children[0]->options.name, "*.c"));
+    assert(streq(e->children[1]->options.name, "f*"));
+    expr_delete(e);
+
+    // Test: global options are stored in walk, not expression
+    Walk walk = {0};
+    char *global[] = {"-j", "4", "-type", "d", "-unordered"};
+    e = expr_parse(nargs(global), global, &walk);
+    assert(e && e->type == EXPR_FILTER);
+    assert(e->options.type == S_IFDIR);
+    assert(walk.jobs == 4 && walk.unordered);
+    expr_delete(e);
+
+    // Test: name operand that looks like a global option
+    char *tricky[] = {"-name", "-j"};
+    e = expr_parse(nargs(tricky), tricky, &walk);
+    assert(e && e->type == EXPR_FILTER && streq(e->options.name, "-j"));
+    expr_delete(e);
+
+    // Test: errors
+    char *missing[]   = {"-type"};
+    char *badtype[]   = {"-type", "x"};
+    char *unclosed[]  = {"(", "-name", "a"};
+    char *unopened[]  = {"-name", "a", ")"};
+    char *dangling[]  = {"-name", "a", "-o"};
+    char *leading[]   = {"-o", "-name", "a"};
+    char *unknown[]   = {"-bogus"};
+    char *empty[]     = {"(", ")"};
+    char *nojobs[]    = {"-j", "0"};
+    assert(!parse(nargs(missing), missing));
+    assert(!parse(nargs(badtype), badtype));
+    assert(!parse(nargs(unclosed), unclosed));
+    assert(!parse(nargs(unopened), unopened));
+    assert(!parse(nargs(dangling), dangling));
+    assert(!parse(nargs(leading), leading));
+    assert(!parse(nargs(unknown), unknown));
+    assert(!parse(nargs(empty), empty));
+    assert(!expr_parse(nargs(nojobs), nojobs, &walk));
+    assert(!parse(nargs(global), global));
+    return EXIT_SUCCESS;
+}
+
+int test_01_expr_evaluate() {
+    // Test: or
+    char *either[] = {"-name", "*.c", "-o", "-name", "Makefile"};
+    Expr *e = parse(nargs(either), either);
+    assert(e && e->type == EXPR_OR);
+    assert(matches(e, "filter.c"));
+    assert(matches(e, "./Makefile"));
+    assert(!matches(e, "findit.h"));
+    expr_delete(e);
+
+    // Test: not
+    char *negate[] = {"!", "-name", "*.c"};
+    e = parse(nargs(negate), negate);
+    assert(e && e->type == EXPR_NOT);
+    assert(!matches(e, "filter.c"));
+    assert(matches(e, "findit.h"));
+    expr_delete(e);
+
+    // Test: and binds tighter than or
+    char *precedence[] = {"-name", "Makefile", "-o", "-name", "*.c", "-not", "-name", "f*"};
+    e = parse(nargs(precedence), precedence);
+    assert(matches(e, "Makefile"));
+    assert(matches(e, "list.c"));
+    assert(!matches(e, "filter.c"));
+    expr_delete(e);
+
+    // Test: parentheses
+    char *grouped[] = {"(", "-name", "*.c", "-or", "-name", "*.h", ")", "-and", "-type", "f"};
+    e = parse(nargs(grouped), grouped);
+    assert(matches(e, "filter.c"));
+    assert(matches(e, "findit.h"));
+    assert(!matches(e, "Makefile"));
+    assert(!matches(e, "missing.c"));
+    expr_delete(e);
+    return EXIT_SUCCESS;
+}
+
+int test_02_expr_optimize() {
+    // Test: cheap predicates run first, nested ands are flattened
+    char *costly[] = {"-readable", "(", "-type", "f", "-name", "*.c", ")"};
+    Expr *e = parse(nargs(costly), costly);
+    assert(e && e->type == EXPR_AND && e->nchildren == 3);
+    assert(e->children[0]->filter == filter_by_name);
+    assert(e->children[1]->filter == filter_by_type);
+    assert(e->children[2]->filter == filter_by_mode);
+    assert(matches(e, "filter.c"));
+    assert(!matches(e, "Makefile"));
+
+    // Test: and short-circuits on first false operand
+    e->children[2]->filter = filter_by_count;
+    Calls = 0;
+    assert(!matches(e, "Makefile"));
+    assert(Calls == 0);
+    assert(matches(e, "filter.c"));
+    assert(Calls == 1);
+    expr_delete(e);
+
+    // Test: or short-circuits on first true operand
+    char *either[] = {"-readable", "-o", "-name", "*.c"};
+    e = parse(nargs(either), either);
+    assert(e && e->type == EXPR_OR && e->nchildren == 2);
+    assert(e->children[0]->filter == filter_by_name);
+    e->children[1]->filter = filter_by_count;
+    Calls = 0;
+    assert(matches(e, "filter.c"));
+    assert(Calls == 0);
+    assert(matches(e, "Makefile"));
+    assert(Calls == 1);
+    expr_delete(e);
+
+    // Test: nothing is moved across -prune, which has a side effect
+    char *prune[] = {"-readable", "-prune", "-name", "*.c", "-o", "-type", "d"};
+    e = parse(nargs(prune), prune);
+    assert(e && e->type == EXPR_OR && e->nchildren == 2 && e->effect);
+    assert(e->children[0]->type == EXPR_AND && e->children[0]->effect);
+    assert(e->children[0]->children[0]->filter == filter_by_mode);
+    assert(e->children[0]->children[1]->filter == filter_by_prune);
+    assert(e->children[0]->children[2]->filter == filter_by_name);
+    assert(e->children[1]->filter == filter_by_type);
+
+    Entry entry;
+    entry_init(&entry, "filter.c");
+    assert(expr_evaluate(e, &entry) && entry.prune);
+    entry_init(&entry, "Makefile");
+    assert(!expr_evaluate(e, &entry) && entry.prune);
+    expr_delete(e);
+
+    // Test: -contains runs after every other predicate
+    char *contents[] = {"-contains", "Filter", "-readable", "-type", "f", "-name", "*.c"};
+    e = parse(nargs(contents), contents);
+    assert(e && e->type == EXPR_AND && e->nchildren == 4);
+    assert(e->children[3]->filter == filter_by_contains);
+    assert(matches(e, "filter.c"));
+    assert(!matches(e, "match.c"));
+    expr_delete(e);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test expr_parse\n");
+        fprintf(stderr, "    1  Test expr_evaluate\n");
+        fprintf(stderr, "    2  Test expr_optimize\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_expr_parse(); break;
+        case 1:  status = test_01_expr_evaluate(); break;
+        case 2:  status = test_02_expr_optimize(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
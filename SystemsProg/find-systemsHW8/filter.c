@@ -5,51 +5,305 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <fcntl.h>
 #include <fnmatch.h>
-#include <libgen.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+/* Macros */
+
+#define	streq(a, b) (strcmp(a, b) == 0)
+
+#define NSEC_PER_SEC    1000000000LL
+#define SEC_PER_DAY     (24 * 60 * 60)
+
+#define CONTAINS_BUFSIZE    (64 * 1024) // Bytes read from a file at a time
+
+/* Functions */
+
+/**
+ * Convert time to nanoseconds.
+ * @param   t           Pointer to timespec structure
+ * @return  Nanoseconds since the epoch.
+ **/
+static int64_t nanoseconds(const struct timespec *t) {
+    return (int64_t)t->tv_sec * NSEC_PER_SEC + t->tv_nsec;
+}
+
+/**
+ * Number of -size units in size, rounded up as find does.
+ * @param   size        Size in bytes
+ * @param   options     Pointer to options structure
+ * @return  Size in units.
+ **/
+static int64_t size_units(int64_t size, Options *options) {
+    return (size + options->unit - 1) / options->unit;
+}
+
+/**
+ * Number of whole days between modification time and the reference time,
+ * rounded down as find does.
+ * @param   mtime       Modification time in nanoseconds
+ * @param   options     Pointer to options structure
+ * @return  Age in days.
+ **/
+static int64_t mtime_days(int64_t mtime, Options *options) {
+    int64_t age = nanoseconds(&options->time) - mtime;
+    int64_t day = SEC_PER_DAY * NSEC_PER_SEC;
+    return age >= 0 ? age / day : -((-age + day - 1) / day);
+}
+
+/**
+ * Compare value with signed operand.
+ * @param   value       Value of entry
+ * @param   options     Pointer to options structure
+ * @return  Whether or not value is less than, equal to, or more than operand.
+ **/
+static bool compare(int64_t value, Options *options) {
+    if (options->compare < 0) return value < options->number;
+    if (options->compare > 0) return value > options->number;
+    return value == options->number;
+}
+
+/**
+ * Compare every value in [lo, hi] with signed operand.
+ * @param   lo          Smallest value
+ * @param   hi          Largest value
+ * @param   options     Pointer to options structure
+ * @return  -1 if no value matches, 1 if every value does, 0 otherwise.
+ **/
+static int compare_range(int64_t lo, int64_t hi, Options *options) {
+    int64_t n = options->number;
+    if (options->compare < 0) return hi < n ? 1 : (lo >= n ? -1 : 0);
+    if (options->compare > 0) return lo > n ? 1 : (hi <= n ? -1 : 0);
+    return (lo == n && hi == n) ? 1 : ((hi < n || lo > n) ? -1 : 0);
+}
+
 /* Filter Functions */
 
 /**
- * Determines if file at specified path has matching file type.
- * @param   path        Path string
+ * Determines if file at specified entry has matching file type.
+ * @param   entry       Pointer to entry structure
+ * @param   options     Pointer to options structure
+ * @return  true if file at specified entry has matching file type specified
+ * in options.
+ **/
+bool	filter_by_type(Entry *entry, Options *options) {
+    // Use d_type or cached lstat of entry
+    return entry_type(entry) == options->type;
+}
+
+/**
+ * Determines if file at specified entry has matching basename.
+ * @param   entry       Pointer to entry structure
+ * @param   options     Pointer to options structure
+ * @return  true if file at specified entry has basename that matches
+ * specified pattern in options.
+ **/
+bool	filter_by_name(Entry *entry, Options *options) {
+    // Use compiled matcher on basename bytes from walker
+    const char *base = entry->path + entry->base;
+    if (options->matcher) {
+        return matcher_match(options->matcher, base, entry->baselen);
+    }
+
+    // Otherwise use fnmatch, copying basename only if it has trailing slashes
+    if (!base[entry->baselen]) {
+        return !fnmatch(options->name, base, 0);
+    }
+
+    char *copy = strndup(base, entry->baselen);
+    bool  match = copy && !fnmatch(options->name, copy, 0);
+    free(copy);
+    return match;
+}
+
+/**
+ * Determines if file at specified entry has matching access mode.
+ * @param   entry       Pointer to entry structure
+ * @param   options     Pointer to options structure
+ * @return  true if file at specified entry has matching access mode
+ * specified in options.
+ **/
+bool	filter_by_mode(Entry *entry, Options *options) {
+    // Use faccessat relative to parent directory
+    return !faccessat(entry->dirfd, entry->name, options->mode, 0);
+}
+
+/**
+ * Determines if file at specified entry has matching size (-size), in units
+ * rounded up.
+ * @param   entry       Pointer to entry structure
+ * @param   options     Pointer to options structure
+ * @return  true if size of file compares with operand in options.
+ **/
+bool	filter_by_size(Entry *entry, Options *options) {
+    struct stat *s = entry_stat(entry);
+    return s && compare(size_units(s->st_size, options), options);
+}
+
+/**
+ * Determines if file at specified entry has matching age (-mtime), in whole
+ * days since modification.
+ * @param   entry       Pointer to entry structure
+ * @param   options     Pointer to options structure
+ * @return  true if age of file compares with operand in options.
+ **/
+bool	filter_by_mtime(Entry *entry, Options *options) {
+    struct stat *s = entry_stat(entry);
+    return s && compare(mtime_days(nanoseconds(&s->st_mtim), options), options);
+}
+
+/**
+ * Determines if file at specified entry was modified after reference file
+ * (-newer).
+ * @param   entry       Pointer to entry structure
  * @param   options     Pointer to options structure
- * @return  true if file at specified path has matching file type specified in
- * options.
+ * @return  true if file is newer than reference time in options.
  **/
-bool	filter_by_type(const char *path, Options *options) { 
-    // Use lstat
+bool	filter_by_newer(Entry *entry, Options *options) {
+    struct stat *s = entry_stat(entry);
+    return s && nanoseconds(&s->st_mtim) > nanoseconds(&options->time);
+}
+
+/**
+ * Determines if file at specified entry is an empty regular file or an empty
+ * directory (-empty).
+ * @param   entry       Pointer to entry structure
+ * @param   options     Pointer to options structure
+ * @return  true if file at specified entry is empty.
+ **/
+bool	filter_by_empty(Entry *entry, Options *options) {
+    mode_t type = entry_type(entry);
+    if (type == S_IFREG) {
+        struct stat *s = entry_stat(entry);
+        return s && s->st_size == 0;
+    }
+    if (type != S_IFDIR) return false;
+
+    // Directory is empty if it has nothing but . and ..
+    int fd = openat(entry->dirfd, entry->name, O_RDONLY | O_DIRECTORY | (entry->follow ? 0 : O_NOFOLLOW) | O_CLOEXEC);
+    Dir d;
+    if (fd < 0 || !dir_open(&d, fd, DIR_MINIMUM, false)) return false;
+
+    const char   *name;
+    unsigned char dtype;
+    bool          empty = true;
+    while (empty && dir_read(&d, &name, &dtype)) {
+        empty = streq(name, ".") || streq(name, "..");
+    }
+    dir_close(&d);
+    return empty;
+}
+
+/**
+ * Marks entry so that the walk does not descend into it (-prune).
+ * @param   entry       Pointer to entry structure
+ * @param   options     Pointer to options structure
+ * @return  true
+ **/
+bool	filter_by_prune(Entry *entry, Options *options) {
+    entry->prune = true;
+    return true;
+}
+
+/**
+ * Search file by reading it in chunks, keeping the last length - 1 bytes of
+ * each chunk so occurrences that straddle two chunks are found.
+ * @param   fd          File descriptor
+ * @param   literal     Bytes to find
+ * @param   length      Length of literal
+ * @return  Whether or not file contains literal.
+ **/
+static bool contains_read(int fd, const char *literal, size_t length) {
+    char    stack[CONTAINS_BUFSIZE];
+    size_t  size   = length > CONTAINS_BUFSIZE / 2 ? 2 * length : CONTAINS_BUFSIZE;
+    char   *buffer = size > CONTAINS_BUFSIZE ? malloc(size) : stack;
+    size_t  used   = 0;
+    bool    found  = false;
+    ssize_t n;
+
+    if (!buffer) return false;
+    while (!found && (n = read(fd, buffer + used, size - used)) > 0) {
+        used += n;
+        found = match_search(buffer, used, literal, length) != NULL;
+        if (used >= length) {
+            memmove(buffer, buffer + used - (length - 1), length - 1);
+            used = length - 1;
+        }
+    }
+
+    if (buffer != stack) free(buffer);
+    return found;
+}
+
+/**
+ * Determines if regular file at specified entry contains literal bytes
+ * (-contains).  Files are read in chunks rather than mapped, so one that is
+ * truncated while it is searched just ends early instead of raising SIGBUS.
+ * @param   entry       Pointer to entry structure
+ * @param   options     Pointer to options structure
+ * @return  true if file at specified entry is a regular file that contains
+ * the bytes in options.
+ **/
+bool	filter_by_contains(Entry *entry, Options *options) {
+    if (entry_type(entry) != S_IFREG) return false;
+
+    int fd = openat(entry->dirfd, entry->name, O_RDONLY | O_NOCTTY | (entry->follow ? 0 : O_NOFOLLOW) | O_CLOEXEC);
+    if (fd < 0) return false;
+
     struct stat s;
-    if (lstat(path, &s) < 0) return false;
-    
-    return ((s.st_mode & S_IFMT) == options->type);
+    bool found = false;
+    if (fstat(fd, &s) < 0 || !S_ISREG(s.st_mode)) {
+        found = false;
+    } else if (!options->length) {
+        found = true;
+    } else {
+        if (s.st_size > CONTAINS_BUFSIZE) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+        found = contains_read(fd, options->name, options->length);
+    }
+
+    close(fd);
+    return found;
 }
 
+/* Bound Functions */
+
 /**
- * Determines if file at specified path has matching basename.
- * @param   path        Path string
+ * Determines if -size could match files whose sizes lie within range.
+ * @param   range       Pointer to range structure
  * @param   options     Pointer to options structure
- * @return  true if file at specified path has basename that matches specified
- * pattern in options.
+ * @return  -1 if none could match, 1 if all would, 0 otherwise.
  **/
-bool	filter_by_name(const char *path, Options *options) {
-    // Use basename and fnmatch
-    return !fnmatch(options->name, basename((char *)path), 0);
+int	bound_by_size(const Range *range, Options *options) {
+    return compare_range(size_units(range->size[0], options), size_units(range->size[1], options), options);
 }
 
 /**
- * Determines if file at specified path has matching access mode.
- * @param   path        Path string
+ * Determines if -mtime could match files whose mtimes lie within range.
+ * @param   range       Pointer to range structure
  * @param   options     Pointer to options structure
- * @return  true if file at specified path has matching access mode specified
- * in options.
+ * @return  -1 if none could match, 1 if all would, 0 otherwise.
+ **/
+int	bound_by_mtime(const Range *range, Options *options) {
+    // Newest file is youngest
+    return compare_range(mtime_days(range->mtime[1], options), mtime_days(range->mtime[0], options), options);
+}
+
+/**
+ * Determines if -newer could match files whose mtimes lie within range.
+ * @param   range       Pointer to range structure
+ * @param   options     Pointer to options structure
+ * @return  -1 if none could match, 1 if all would, 0 otherwise.
  **/
-bool	filter_by_mode(const char *path, Options *options) {
-    // Use access
-    return !access(path, options->mode);
+int	bound_by_newer(const Range *range, Options *options) {
+    int64_t reference = nanoseconds(&options->time);
+    if (range->mtime[0] > reference)  return 1;
+    if (range->mtime[1] <= reference) return -1;
+    return 0;
 }
 
 /* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -3,14 +3,29 @@
 #include "findit.h"
 
 #include <assert.h>
+#include <dirent.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+
+/* Functions */
+
+Entry *entry(const char *path) {
+    static Entry e;
+    entry_init(&e, path);
+    return &e;
+}
+
 /* Tests */
 
 int test_00_filter_by_type() {
@@ -18,25 +33,25 @@ int test_00_filter_by_type() {
 
     // Test directories
     o.type = S_IFDIR;
-    assert(filter_by_type(".", &o));
-    assert(filter_by_type("..", &o));
-    assert(filter_by_type("/tmp", &o));
-    assert(!filter_by_type("Makefile", &o));
-    assert(!filter_by_type("filter.c", &o));
-    assert(!filter_by_type("list.c", &o));
-    assert(!filter_by_type("/root/.ssh", &o));
-    assert(!filter_by_type("CHUPABLAHBLA", &o));
+    assert(filter_by_type(entry("."), &o));
+    assert(filter_by_type(entry(".."), &o));
+    assert(filter_by_type(entry("/tmp"), &o));
+    assert(!filter_by_type(entry("Makefile"), &o));
+    assert(!filter_by_type(entry("filter.c"), &o));
+    assert(!filter_by_type(entry("list.c"), &o));
+    assert(!filter_by_type(entry("/root/.ssh"), &o));
+    assert(!filter_by_type(entry("CHUPABLAHBLA"), &o));
 
     // Test files
     o.type = S_IFREG;
-    assert(!filter_by_type(".", &o));
-    assert(!filter_by_type("..", &o));
-    assert(!filter_by_type("/tmp", &o));
-    assert(filter_by_type("Makefile", &o));
-    assert(filter_by_type("filter.c", &o));
-    assert(filter_by_type("list.c", &o));
-    assert(!filter_by_type("/root/.ssh", &o));
-    assert(!filter_by_type("CHUPABLAHBLA", &o));
+    assert(!filter_by_type(entry("."), &o));
+    assert(!filter_by_type(entry(".."), &o));
+    assert(!filter_by_type(entry("/tmp"), &o));
+    assert(filter_by_type(entry("Makefile"), &o));
+    assert(filter_by_type(entry("filter.c"), &o));
+    assert(filter_by_type(entry("list.c"), &o));
+    assert(!filter_by_type(entry("/root/.ssh"), &o));
+    assert(!filter_by_type(entry("CHUPABLAHBLA"), &o));
     return EXIT_SUCCESS;
 }
 
@@ -45,19 +60,19 @@ int test_01_filter_by_name() {
     
     // Test no pattern
     o.name = "Makefile";
-    assert(filter_by_name("Makefile", &o));
-    assert(filter_by_name("./Makefile", &o));
-    assert(!filter_by_name("Makefiles", &o));
-    assert(!filter_by_name("makefile", &o));
-    assert(!filter_by_name("./Makefile/asdf", &o));
+    assert(filter_by_name(entry("Makefile"), &o));
+    assert(filter_by_name(entry("./Makefile"), &o));
+    assert(!filter_by_name(entry("Makefiles"), &o));
+    assert(!filter_by_name(entry("makefile"), &o));
+    assert(!filter_by_name(entry("./Makefile/asdf"), &o));
     
     // Test pattern
     o.name = "*.c";
-    assert(!filter_by_name("Makefile", &o));
-    assert(!filter_by_name("./Makefile", &o));
-    assert(filter_by_name("filter.c", &o));
-    assert(filter_by_name("./filter.c", &o));
-    assert(!filter_by_name("./filter.ch", &o));
+    assert(!filter_by_name(entry("Makefile"), &o));
+    assert(!filter_by_name(entry("./Makefile"), &o));
+    assert(filter_by_name(entry("filter.c"), &o));
+    assert(filter_by_name(entry("./filter.c"), &o));
+    assert(!filter_by_name(entry("./filter.ch"), &o));
     return EXIT_SUCCESS;
 }
 
@@ -66,21 +81,239 @@ int test_02_filter_by_mode() {
     
     // Test readable
     o.mode = R_OK;
-    assert(filter_by_mode("Makefile", &o));
-    assert(filter_by_mode("filter.unit", &o));
-    assert(!filter_by_mode("/root/.ssh", &o));
+    assert(filter_by_mode(entry("Makefile"), &o));
+    assert(filter_by_mode(entry("filter.unit"), &o));
+    assert(!filter_by_mode(entry("/root/.ssh"), &o));
     
     // Test writable
     o.mode = W_OK;
-    assert(filter_by_mode("Makefile", &o));
-    assert(filter_by_mode("filter.unit", &o));
-    assert(!filter_by_mode("/root/.ssh", &o));
+    assert(filter_by_mode(entry("Makefile"), &o));
+    assert(filter_by_mode(entry("filter.unit"), &o));
+    assert(!filter_by_mode(entry("/root/.ssh"), &o));
 
     // Test executable
     o.mode = X_OK;
-    assert(!filter_by_mode("Makefile", &o));
-    assert(filter_by_mode("filter.unit", &o));
-    assert(!filter_by_mode("/root/.ssh", &o));
+    assert(!filter_by_mode(entry("Makefile"), &o));
+    assert(filter_by_mode(entry("filter.unit"), &o));
+    assert(!filter_by_mode(entry("/root/.ssh"), &o));
+    return EXIT_SUCCESS;
+}
+
+int test_03_filter_relative() {
+    Options o = {0};
+    int dirfd = open("..", O_RDONLY | O_DIRECTORY);
+    assert(dirfd >= 0);
+
+    char cwd[BUFSIZ];
+    assert(getcwd(cwd, BUFSIZ));
+    char *name = strrchr(cwd, '/') + 1;
+
+    // Test: name resolved relative to dirfd, not current directory
+    Entry e = {
+        .path    = name,
+        .length  = strlen(name),
+        .base    = 0,
+        .baselen = strlen(name),
+        .name    = name,
+        .dirfd   = dirfd,
+    };
+    o.type = S_IFDIR;
+    assert(filter_by_type(&e, &o));
+    o.mode = R_OK;
+    assert(filter_by_mode(&e, &o));
+    o.name = name;
+    assert(filter_by_name(&e, &o));
+
+    e.name = "filter.c";
+    o.type = S_IFREG;
+    assert(!filter_by_type(&e, &o));
+    assert(!filter_by_mode(&e, &o));
+
+    // Test: basename ignores trailing slashes without modifying path
+    char path[] = "/tmp/";
+    entry_init(&e, path);
+    o.name = "tmp";
+    assert(filter_by_name(&e, &o));
+    assert(streq(path, "/tmp/"));
+
+    close(dirfd);
+    return EXIT_SUCCESS;
+}
+
+int test_04_entry_stat() {
+    Options o = {0};
+    Entry e;
+
+    // Test: stat fetched once and cached
+    entry_init(&e, "Makefile");
+    assert(e.status == 0);
+    struct stat *s = entry_stat(&e);
+    assert(s && S_ISREG(s->st_mode));
+    assert(e.status == 1);
+    assert(entry_stat(&e) == s);
+
+    // Test: failure is cached too
+    entry_init(&e, "CHUPABLAHBLA");
+    assert(!entry_stat(&e));
+    assert(e.status == -1);
+    assert(entry_type(&e) == 0);
+
+    // Test: d_type answers -type without a stat
+    entry_init(&e, "CHUPABLAHBLA");
+    e.type = DT_DIR;
+    o.type = S_IFDIR;
+    assert(filter_by_type(&e, &o));
+    assert(e.status == 0);
+    o.type = S_IFREG;
+    assert(!filter_by_type(&e, &o));
+    assert(e.status == 0);
+
+    // Test: unknown d_type falls back to (cached) stat
+    entry_init(&e, "Makefile");
+    assert(filter_by_type(&e, &o));
+    assert(e.status == 1);
+    return EXIT_SUCCESS;
+}
+
+int test_05_filter_by_stat() {
+    char root[] = "/tmp/filter.unit.XXXXXX";
+    char path[BUFSIZ];
+    assert(mkdtemp(root));
+
+    // Fixture: 1000 byte file modified 10 days ago, empty file, empty directory
+    time_t now = time(NULL);
+    snprintf(path, BUFSIZ, "%s/old", root);
+    int fd = open(path, O_CREAT | O_WRONLY, 0644);
+    assert(fd >= 0 && ftruncate(fd, 1000) == 0);
+    struct timespec times[] = {{now, 0}, {now - 10 * 24 * 60 * 60 - 60, 0}};
+    assert(futimens(fd, times) == 0);
+    close(fd);
+    snprintf(path, BUFSIZ, "%s/new", root);
+    assert((fd = open(path, O_CREAT | O_WRONLY, 0644)) >= 0);
+    close(fd);
+    snprintf(path, BUFSIZ, "%s/dir", root);
+    assert(mkdir(path, 0755) == 0);
+
+    char old[BUFSIZ], new[BUFSIZ], dir[BUFSIZ];
+    snprintf(old, BUFSIZ, "%s/old", root);
+    snprintf(new, BUFSIZ, "%s/new", root);
+    snprintf(dir, BUFSIZ, "%s/dir", root);
+
+    // Test: -size rounds up to units
+    Options o = {.unit = 512, .number = 2};
+    assert(filter_by_size(entry(old), &o));
+    assert(!filter_by_size(entry(new), &o));
+    o.compare = -1;
+    assert(filter_by_size(entry(new), &o));
+    assert(!filter_by_size(entry(old), &o));
+    o = (Options){.unit = 1, .number = 999, .compare = 1};
+    assert(filter_by_size(entry(old), &o));
+    o.number = 1000;
+    assert(!filter_by_size(entry(old), &o));
+
+    // Test: -mtime counts whole days
+    o = (Options){.number = 10, .time = {now, 0}};
+    assert(filter_by_mtime(entry(old), &o));
+    assert(!filter_by_mtime(entry(new), &o));
+    o.compare = 1;
+    o.number  = 9;
+    assert(filter_by_mtime(entry(old), &o));
+    assert(!filter_by_mtime(entry(new), &o));
+    o.compare = -1;
+    o.number  = 1;
+    assert(filter_by_mtime(entry(new), &o));
+
+    // Test: -newer
+    o = (Options){.time = {now - 60, 0}};
+    assert(filter_by_newer(entry(new), &o));
+    assert(!filter_by_newer(entry(old), &o));
+
+    // Test: -empty
+    assert(filter_by_empty(entry(new), &o));
+    assert(filter_by_empty(entry(dir), &o));
+    assert(!filter_by_empty(entry(old), &o));
+    assert(!filter_by_empty(entry(root), &o));
+    assert(!filter_by_empty(entry("CHUPABLAHBLA"), &o));
+
+    // Test: bounds over ranges of sizes and mtimes
+    int64_t second = 1000000000LL;
+    Range   range  = {{0, 1000}, {(now - 100) * second, (now - 50) * second}};
+    o = (Options){.unit = 1, .number = 2000, .compare = 1};
+    assert(bound_by_size(&range, &o) < 0);
+    o.number = 500;
+    assert(bound_by_size(&range, &o) == 0);
+    o = (Options){.unit = 1, .number = 2000, .compare = -1};
+    assert(bound_by_size(&range, &o) > 0);
+    o = (Options){.time = {now - 10, 0}};
+    assert(bound_by_newer(&range, &o) < 0);
+    o.time.tv_sec = now - 200;
+    assert(bound_by_newer(&range, &o) > 0);
+    o.time.tv_sec = now - 75;
+    assert(bound_by_newer(&range, &o) == 0);
+    o = (Options){.number = 0, .time = {now, 0}};
+    assert(bound_by_mtime(&range, &o) > 0);
+    o.compare = 1;
+    assert(bound_by_mtime(&range, &o) < 0);
+
+    snprintf(path, BUFSIZ, "rm -fr %s", root);
+    assert(system(path) == 0);
+    return EXIT_SUCCESS;
+}
+
+int test_06_filter_by_contains() {
+    char root[] = "/tmp/filter.unit.XXXXXX";
+    char path[BUFSIZ];
+    assert(mkdtemp(root));
+
+    // Fixture: small file, large file with text only at its very end, and a
+    // symbolic link to the small file
+    char small[BUFSIZ], large[BUFSIZ], link[BUFSIZ];
+    snprintf(small, BUFSIZ, "%s/small", root);
+    snprintf(large, BUFSIZ, "%s/large", root);
+    snprintf(link,  BUFSIZ, "%s/link", root);
+
+    int fd = open(small, O_CREAT | O_WRONLY, 0644);
+    assert(fd >= 0 && write(fd, "one needle\n", 11) == 11);
+    close(fd);
+    fd = open(large, O_CREAT | O_WRONLY, 0644);
+    assert(fd >= 0 && ftruncate(fd, 1 << 20) == 0);
+    assert(pwrite(fd, "haystack", 8, (1 << 20) - 8) == 8);
+    close(fd);
+    assert(symlink("small", link) == 0);
+
+    // Test: read small files, map large ones
+    Options o = {.name = "needle", .length = 6};
+    assert(filter_by_contains(entry(small), &o));
+    assert(!filter_by_contains(entry(large), &o));
+    o = (Options){.name = "haystack", .length = 8};
+    assert(filter_by_contains(entry(large), &o));
+    assert(!filter_by_contains(entry(small), &o));
+
+    // Test: only regular files, links only when followed
+    o = (Options){.name = "", .length = 0};
+    assert(filter_by_contains(entry(small), &o));
+    assert(!filter_by_contains(entry(root), &o));
+    assert(!filter_by_contains(entry(link), &o));
+    assert(!filter_by_contains(entry("CHUPABLAHBLA"), &o));
+    Entry *e = entry(link);
+    e->follow = true;
+    assert(filter_by_contains(e, &o));
+
+    // Test: files that report no size are read to the end
+    o = (Options){.name = "Name:", .length = 5};
+    assert(filter_by_contains(entry("/proc/self/status"), &o));
+
+    // Test: text longer than the read buffer
+    char *longer = malloc(100000);
+    assert(longer);
+    memset(longer, 'x', 100000);
+    o = (Options){.name = longer, .length = 100000};
+    assert(!filter_by_contains(entry(small), &o));
+    assert(!filter_by_contains(entry(large), &o));
+    free(longer);
+
+    snprintf(path, BUFSIZ, "rm -fr %s", root);
+    assert(system(path) == 0);
     return EXIT_SUCCESS;
 }
 
@@ -93,6 +326,10 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "    0  Test filter_by_type\n");
         fprintf(stderr, "    1  Test filter_by_name\n");
         fprintf(stderr, "    2  Test filter_by_mode\n");
+        fprintf(stderr, "    3  Test filters relative to directory\n");
+        fprintf(stderr, "    4  Test entry_stat\n");
+        fprintf(stderr, "    5  Test stat filters and bounds\n");
+        fprintf(stderr, "    6  Test filter_by_contains\n");
         return EXIT_FAILURE;
     }
 
@@ -103,6 +340,10 @@ int main(int argc, char *argv[]) {
         case 0:  status = test_00_filter_by_type(); break;
         case 1:  status = test_01_filter_by_name(); break;
         case 2:  status = test_02_filter_by_mode(); break;
+        case 3:  status = test_03_filter_relative(); break;
+        case 4:  status = test_04_entry_stat(); break;
+        case 5:  status = test_05_filter_by_stat(); break;
+        case 6:  status = test_06_filter_by_contains(); break;
         default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
     }
 
@@ -0,0 +1,373 @@
+/* findit.bench.c: List, filter, and walk benchmark suite */
+
+#include "findit.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Fixture Structure */
+
+typedef struct {
+    const char *root;       // Synthetic tree
+    size_t      count;      // Number of list operations (list_* benchmarks)
+    List        list;       // List operated on
+    Store       store;      // Flat store operated on (store_* benchmarks)
+    Expr       *expr;       // Parsed predicate (filter benchmarks)
+} Fixture;
+
+/* Benchmark Structure */
+
+typedef struct {
+    const char *name;                   // Name printed in results
+    char       *argv[3];                // Predicate to parse (NULL if none)
+    void      (*setup)(Fixture *);      // Prepare fixture (untimed)
+    size_t    (*run)(Fixture *);        // Timed operations, returns count
+} Benchmark;
+
+/* Functions */
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Create a tree of directories under root with fanout subdirectories and
+ * fanout files per directory, depth levels deep.
+ * @param   root        Directory to populate
+ * @param   fanout      Number of subdirectories and files per directory
+ * @param   depth       Number of levels to create
+ * @return  Number of entries created.
+ **/
+size_t make_tree(const char *root, int fanout, int depth) {
+    size_t count = 0;
+
+    for (int i = 0; i < fanout; i++) {
+        char path[BUFSIZ];
+        snprintf(path, BUFSIZ, "%s/file%d.txt", root, i);
+        int fd = open(path, O_CREAT | O_WRONLY, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "open: %s: %s\n", path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+        count++;
+
+        if (depth > 0) {
+            snprintf(path, BUFSIZ, "%s/dir%d", root, i);
+            if (mkdir(path, 0755) < 0) {
+                fprintf(stderr, "mkdir: %s: %s\n", path, strerror(errno));
+                exit(EXIT_FAILURE);
+            }
+            count += 1 + make_tree(path, fanout, depth - 1);
+        }
+    }
+
+    return count;
+}
+
+/* Setup Functions */
+
+void setup_none(Fixture *f) {
+}
+
+void setup_paths(Fixture *f) {
+    find_files(f->root, &f->list, NULL);
+}
+
+void setup_store(Fixture *f) {
+    find_files(f->root, &f->list, NULL);
+    for (Node *n = f->list.head; n; n = n->next) {
+        store_append(&f->store, n->data.string, strlen(n->data.string));
+    }
+}
+
+/* Run Functions */
+
+size_t run_find_files(Fixture *f) {
+    find_files(f->root, &f->list, NULL);
+
+    size_t count = 0;
+    for (Node *n = f->list.head; n; n = n->next) count++;
+    return count;
+}
+
+size_t run_list_append(Fixture *f) {
+    for (size_t i = 0; i < f->count; i++) {
+        list_append(&f->list, (Data){.string = "entry"});
+    }
+    return f->count;
+}
+
+size_t run_list_append_string(Fixture *f) {
+    for (size_t i = 0; i < f->count; i++) {
+        list_append_string(&f->list, "entry", 5);
+    }
+    return f->count;
+}
+
+size_t run_list_filter(Fixture *f) {
+    size_t count = 0;
+    for (Node *n = f->list.head; n; n = n->next) count++;
+
+    list_filter(&f->list, f->expr->filter, &f->expr->options, true);
+    return count;
+}
+
+size_t run_store_filter(Fixture *f) {
+    size_t count = f->store.count;
+    store_filter(&f->store, f->expr->filter, &f->expr->options);
+    return count;
+}
+
+size_t run_filter(Fixture *f) {
+    size_t count = 0;
+    for (Node *n = f->list.head; n; n = n->next, count++) {
+        Entry e;
+        entry_init(&e, n->data.string);
+        f->expr->filter(&e, &f->expr->options);
+    }
+    return count;
+}
+
+/* Benchmark Table */
+
+static Benchmark Benchmarks[] = {
+    {"find_files",          {NULL},                     setup_none,  run_find_files},
+    {"list_append",         {NULL},                     setup_none,  run_list_append},
+    {"list_append_string",  {NULL},                     setup_none,  run_list_append_string},
+    {"list_filter",         {"-name", "*.txt"},         setup_paths, run_list_filter},
+    {"list_filter_iname",   {"-iname", "*ILE1*"},       setup_paths, run_list_filter},
+    {"store_filter",        {"-name", "*.txt"},         setup_store, run_store_filter},
+    {"store_filter_iname",  {"-iname", "*ILE1*"},       setup_store, run_store_filter},
+    {"filter_by_type",      {"-type", "f"},             setup_paths, run_filter},
+    {"filter_by_name",      {"-name", "file1*"},        setup_paths, run_filter},
+    {"filter_by_mode",      {"-readable"},              setup_paths, run_filter},
+    {"filter_by_size",      {"-size", "+1k"},           setup_paths, run_filter},
+    {"filter_by_mtime",     {"-mtime", "-1"},           setup_paths, run_filter},
+    {"filter_by_newer",     {"-newer", "/"},            setup_paths, run_filter},
+    {"filter_by_empty",     {"-empty"},                 setup_paths, run_filter},
+    {"filter_by_prune",     {"-prune"},                 setup_paths, run_filter},
+    {NULL,                  {NULL},                     NULL,        NULL},
+};
+
+/* Measurement Functions */
+
+/**
+ * Prepare fixture for benchmark.
+ * @param   b           Pointer to Benchmark structure
+ * @param   f           Pointer to Fixture structure
+ **/
+void bench_setup(Benchmark *b, Fixture *f) {
+    int argc = 0;
+    while (argc < 3 && b->argv[argc]) argc++;
+
+    memset(&f->list, 0, sizeof(List));
+    memset(&f->store, 0, sizeof(Store));
+    f->expr = argc ? expr_parse(argc, b->argv, NULL) : NULL;
+    if (argc && !f->expr) {
+        fprintf(stderr, "expr_parse: %s: invalid predicate\n", b->name);
+        exit(EXIT_FAILURE);
+    }
+    b->setup(f);
+}
+
+/**
+ * Release fixture after benchmark.
+ * @param   f           Pointer to Fixture structure
+ **/
+void bench_teardown(Fixture *f) {
+    list_delete(&f->list, false);
+    store_delete(&f->store);
+    expr_delete(f->expr);
+    f->expr = NULL;
+}
+
+/**
+ * Time benchmark in a child process, best of rounds, so that its peak
+ * resident set size is its own.
+ * @param   b           Pointer to Benchmark structure
+ * @param   f           Pointer to Fixture structure
+ * @param   rounds      Number of rounds
+ * @param   ops         Set to number of operations per round
+ * @param   maxrss      Set to peak resident set size in KiB
+ * @return  Best elapsed time in seconds (negative on failure).
+ **/
+double bench_time(Benchmark *b, Fixture *f, int rounds, size_t *ops, long *maxrss) {
+    int fds[2];
+    if (pipe(fds) < 0) return -1;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        double best = 0;
+        size_t count = 0;
+        for (int r = 0; r < rounds; r++) {
+            bench_setup(b, f);
+            double start   = now();
+            count          = b->run(f);
+            double elapsed = now() - start;
+            bench_teardown(f);
+
+            if (!r || elapsed < best) best = elapsed;
+        }
+        if (write(fds[1], &best, sizeof(best)) != sizeof(best) ||
+            write(fds[1], &count, sizeof(count)) != sizeof(count)) {
+            _exit(EXIT_FAILURE);
+        }
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    double best = -1;
+    if (read(fds[0], &best, sizeof(best)) != sizeof(best) ||
+        read(fds[0], ops, sizeof(*ops)) != sizeof(*ops)) {
+        best = -1;
+    }
+    close(fds[0]);
+
+    struct rusage usage;
+    int status;
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        return -1;
+    }
+    *maxrss = usage.ru_maxrss;
+    return best;
+}
+
+/**
+ * Count system calls made by one round of benchmark, by running it in a
+ * child process traced from its first stop to its second.
+ * @param   b           Pointer to Benchmark structure
+ * @param   f           Pointer to Fixture structure
+ * @return  Number of system calls or -1 if they cannot be traced.
+ **/
+long bench_syscalls(Benchmark *b, Fixture *f) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) < 0) _exit(EXIT_FAILURE);
+        bench_setup(b, f);
+
+        pid_t self = getpid();
+        kill(self, SIGSTOP);
+        b->run(f);
+        kill(self, SIGSTOP);
+        _exit(EXIT_SUCCESS);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) return -1;
+    ptrace(PTRACE_SETOPTIONS, pid, NULL, (void *)(PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL));
+
+    // Each system call stops once on entry and once on exit
+    long calls    = 0;
+    bool entering = true;
+    ptrace(PTRACE_SYSCALL, pid, NULL, NULL);
+    while (waitpid(pid, &status, 0) == pid && WIFSTOPPED(status)) {
+        int signal = WSTOPSIG(status);
+        if (signal == SIGSTOP) break;
+        if (signal == (SIGTRAP | 0x80)) {
+            calls   += entering;
+            entering = !entering;
+            signal   = 0;
+        }
+        ptrace(PTRACE_SYSCALL, pid, NULL, (void *)(long)signal);
+    }
+
+    bool stopped = WIFSTOPPED(status);
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+
+    // The kill that ended the traced round is not part of it
+    return stopped ? calls - 1 : -1;
+}
+
+/* Main Execution */
+
+void usage(int status) {
+    fprintf(stderr, "Usage: findit.bench [-f FANOUT] [-d DEPTH] [-n COUNT] [-r ROUNDS] [-t DIR]\n\n");
+    fprintf(stderr, "   -f FANOUT   Subdirectories and files per directory (default 8)\n");
+    fprintf(stderr, "   -d DEPTH    Levels of subdirectories (default 4)\n");
+    fprintf(stderr, "   -n COUNT    Appends per list_append round (default 1000000)\n");
+    fprintf(stderr, "   -r ROUNDS   Rounds per benchmark, best is reported (default 5)\n");
+    fprintf(stderr, "   -t DIR      Directory to build tree in (default /dev/shm)\n");
+    exit(status);
+}
+
+int main(int argc, char *argv[]) {
+    int         fanout = 8;
+    int         depth  = 4;
+    int         rounds = 5;
+    size_t      count  = 1000000;
+    const char *dir    = "/dev/shm";
+
+    int option;
+    while ((option = getopt(argc, argv, "f:d:n:r:t:h")) != -1) {
+        switch (option) {
+            case 'f': fanout = atoi(optarg); break;
+            case 'd': depth  = atoi(optarg); break;
+            case 'n': count  = strtoul(optarg, NULL, 10); break;
+            case 'r': rounds = atoi(optarg); break;
+            case 't': dir    = optarg; break;
+            case 'h': usage(EXIT_SUCCESS); break;
+            default:  usage(EXIT_FAILURE); break;
+        }
+    }
+    if (fanout < 1 || depth < 0 || rounds < 1 || optind != argc) usage(EXIT_FAILURE);
+
+    // Fall back to /tmp where there is no tmpfs at /dev/shm
+    char root[BUFSIZ];
+    snprintf(root, BUFSIZ, "%s/findit.bench.XXXXXX", access(dir, W_OK) ? "/tmp" : dir);
+    if (!mkdtemp(root)) {
+        fprintf(stderr, "mkdtemp: %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    make_tree(root, fanout, depth);
+
+    Fixture f = {.root = root, .count = count};
+
+    printf("benchmark\tfanout\tdepth\tops\tns/op\tsyscalls/op\tmaxrss_kb\n");
+    fflush(stdout);
+    for (Benchmark *b = Benchmarks; b->name; b++) {
+        size_t ops    = 0;
+        long   maxrss = 0;
+        double best   = bench_time(b, &f, rounds, &ops, &maxrss);
+        if (best < 0 || !ops) {
+            fprintf(stderr, "%s: benchmark failed\n", b->name);
+            continue;
+        }
+
+        long calls = bench_syscalls(b, &f);
+        printf("%s\t%d\t%d\t%zu\t%.1f\t", b->name, fanout, depth, ops, best * 1e9 / ops);
+        if (calls < 0) {
+            printf("NA");
+        } else {
+            printf("%.3f", (double)calls / ops);
+        }
+        printf("\t%ld\n", maxrss);
+        fflush(stdout);
+    }
+
+    char command[sizeof(root) + 8];
+    snprintf(command, sizeof(command), "rm -fr %s", root);
+    return system(command) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -2,7 +2,7 @@
 
 #include "findit.h"
 
-#include <dirent.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,6 +14,11 @@
 
 #define	streq(a, b) (strcmp(a, b) == 0)
 
+/* Globals */
+
+bool    Print0 = false;     // Terminate each path with NUL instead of newline (-print0)
+bool    Dupes  = false;     // Print sets of matching files with identical contents (-dupes)
+
 /* Functions */
 
 /**
@@ -21,130 +26,204 @@
  * @param   status      Exit status
  **/
 void usage(int status) {
-    fprintf(stderr, "Usage: findit PATH [OPTIONS]\n\n");
+    fprintf(stderr, "Usage: findit PATH [OPTIONS] [EXPRESSION]\n");
+    fprintf(stderr, "       findit --index FILE [OPTIONS] [EXPRESSION]\n");
+    fprintf(stderr, "       findit --watch PATH [OPTIONS] [EXPRESSION]\n");
+    fprintf(stderr, "       findit --build-index PATH FILE\n");
+    fprintf(stderr, "       findit --refresh-index FILE\n\n");
+    fprintf(stderr, "Index:\n\n");
+    fprintf(stderr, "   --index FILE		Search index FILE instead of walking the file system\n");
+    fprintf(stderr, "   --build-index PATH FILE	Write index of PATH to FILE\n");
+    fprintf(stderr, "   --refresh-index FILE	Update FILE, rereading only directories whose mtime changed\n\n");
+    fprintf(stderr, "Watch:\n\n");
+    fprintf(stderr, "   --watch PATH		Walk PATH, then keep printing '+ path' for each new match and\n");
+    fprintf(stderr, "			'- path' for each removed one until PATH is removed\n\n");
     fprintf(stderr, "Options:\n\n");
-    fprintf(stderr, "   -type [f|d]	File is of type f for regular file or d for directory\n");
+    fprintf(stderr, "   -j N		Walk directories with N threads (same output order)\n");
+    fprintf(stderr, "   -unordered	With -j, print matches as soon as found, in any order\n");
+    fprintf(stderr, "   -dirbuf BYTES	Read directories in batches of BYTES (default %d)\n", DIR_BUFSIZE);
+    fprintf(stderr, "   -readdir	Read directories with libc readdir\n");
+    fprintf(stderr, "   -uring	Stat entries of each directory in batches through io_uring\n");
+    fprintf(stderr, "   -dupes	Print sets of matching files with identical contents, a blank line after each\n");
+    fprintf(stderr, "   -print0	Terminate each path with NUL instead of newline\n");
+    fprintf(stderr, "   -mindepth N	Do not test or print entries less than N levels below PATH\n");
+    fprintf(stderr, "   -maxdepth N	Descend at most N levels below PATH\n");
+    fprintf(stderr, "   -xdev		Do not descend into directories on other file systems\n");
+    fprintf(stderr, "   -L		Follow symbolic links, skipping directories that loop\n");
+    fprintf(stderr, "\nExpression:\n\n");
+    fprintf(stderr, "   -type [fdlbcps]	File is of type f for regular file, d for directory, etc.\n");
     fprintf(stderr, "   -name pattern	Name of file matches shell pattern\n");
+    fprintf(stderr, "   -iname pattern	Like -name, but ignoring case\n");
+    fprintf(stderr, "   -size [+-]N[cwbkMG]	Size is less than, exactly, or more than N units (default b, 512 bytes)\n");
+    fprintf(stderr, "   -mtime [+-]N	Modified less than, exactly, or more than N days ago\n");
+    fprintf(stderr, "   -newer file	Modified more recently than file\n");
+    fprintf(stderr, "   -empty	File is an empty regular file or directory\n");
     fprintf(stderr, "   -executable	File is executable or directory is searchable by user\n");
     fprintf(stderr, "   -readable	File is readable by user\n");
     fprintf(stderr, "   -writable	File is writable by user\n");
+    fprintf(stderr, "   -prune	Always true; do not descend into directory\n");
+    fprintf(stderr, "   -contains text	File is a regular file whose contents include text\n");
+    fprintf(stderr, "   ( EXPR )	Group expressions\n");
+    fprintf(stderr, "   ! EXPR	EXPR is false (also -not)\n");
+    fprintf(stderr, "   EXPR EXPR	Both are true (also -a, -and)\n");
+    fprintf(stderr, "   EXPR -o EXPR	Either is true (also -or)\n");
     exit(status);
 }
 
 /**
- * Recursively walk specified directory, adding all file system entities to
- * specified files list.
- * @param   root        Directory to walk
- * @param   files       List of files found
+ * Report failed operation on path and exit.
+ * @param   path        Path operated on
  **/
-void	find_files(const char *root, List *files) {
-    // Add root to files
-    list_append(files, (Data)strdup(root));
-
-    // Walk directory
-    //  - Skip current and parent directory entries
-    //  - Form full path to entry
-    //  - Recursively walk directories or add entry to files list
-    DIR *d = opendir(root);
-    if (!d) return;
-
-    for (struct dirent *e = readdir(d); e; e = readdir(d)) {
-        if (streq(e->d_name, ".") || streq(e->d_name, "..")) {
-            continue;
-        }
-
-        char path[BUFSIZ];
-        sprintf(path, "%s/%s", root, e->d_name);
-    
-        /*
-        struct stat s;
-        if (stat(path, &s) < 0) {
-            continue;
-        }
-        */
+void    fail(const char *path) {
+    fprintf(stderr, "findit: %s: %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+}
 
-        if (e->d_type == DT_DIR){
-            find_files(path, files);
+/**
+ * Take output options out of arguments, wherever they appear, leaving the
+ * rest (predicate operands included) for expr_parse.
+ * @param   argc        Number of arguments
+ * @param   argv        Array of arguments (compacted in place)
+ * @return  Number of arguments left.
+ **/
+int     parse_output(int argc, char *argv[]) {
+    int n = 0;
+    for (int i = 0; i < argc; i++) {
+        if (streq(argv[i], "-print0")) {
+            Print0 = true;
+        } else if (streq(argv[i], "-dupes")) {
+            Dupes = true;
         } else {
-            list_append(files, (Data)strdup(path));
+            argv[n++] = argv[i];
+            if (expr_operand(argv[i]) && i + 1 < argc) argv[n++] = argv[++i];
         }
     }
-
-    closedir(d);
+    return n;
 }
 
 /**
- * Iteratively filter list of files with each filter in list of filters.
- * @param   files       List of files
- * @param   filters     List of filters
- * @param   options     Pointer to options structure
+ * Write set of duplicate paths followed by an empty record.
+ * @param   paths       Paths of files with identical contents
+ * @param   n           Number of paths
+ * @param   arg         Pointer to Output structure
  **/
-void	filter_files(List *files, List *filters, Options *options) {
-    // Apply each filter to list of files
-    for (Node *curr = filters->head; curr; curr = curr->next){
-        list_filter(files, curr->data.function, options, true);
+void    output_dupes(const char **paths, size_t n, void *arg) {
+    for (size_t i = 0; i < n; i++) {
+        output_write(arg, paths[i], strlen(paths[i]));
     }
+    output_write(arg, "", 0);
+}
 
+/**
+ * Print sets of duplicates among files (hashing with a thread per walker, or
+ * DUPES_JOBS when walking alone), then release files.
+ * @param   files       List of matching paths
+ * @param   walk        Pointer to Walk structure
+ * @param   output      Pointer to Output structure
+ **/
+void    print_dupes(List *files, Walk *walk, Output *output) {
+    size_t jobs = walk->jobs > 1 ? walk->jobs : DUPES_JOBS;
+    if (dupes_find(files, jobs, walk->follow, output_dupes, output) < 0) fail("dupes");
+    list_delete(files, false);
 }
 
 /* Main Execution */
 
 int main(int argc, char *argv[]) {
-    // TODO: Parse command line arguments */
-    List files = {0};
-    List filters = {0};
-    Options options = {0};
-    char root[BUFSIZ];
-    //char name[BUFSIZ];
+    Walk walk = {
+        .jobs    = 1,
+        .visit   = output_entry,
+    };
+    Output output;
 
     if (argc < 2) usage(EXIT_FAILURE);
 
-    strncpy(root, argv[1], BUFSIZ);
-
-    int i = 2;
-
-    while (i < argc){
-        if (streq(argv[i], "-type")){
-            i++;
-            if (streq(argv[i], "d")){
-                options.type = S_IFDIR;
-            } else {
-                options.type = S_IFREG;
-            }
-            list_append(&filters, (Data)filter_by_type);
-        
-        } else if (streq(argv[i], "-name")){
-            i++;
-            options.name =argv[i];
-            list_append(&filters, (Data)filter_by_name);
-       
-        } else if (streq(argv[i], "-executable")){
-            options.mode = X_OK;
-            list_append(&filters, (Data)filter_by_mode);
-        } else if (streq(argv[i], "-writable")){
-            options.mode = W_OK;
-            list_append(&filters, (Data)filter_by_mode);
-        } else if (streq(argv[i], "-readable")){
-            options.mode = R_OK;
-            list_append(&filters, (Data)filter_by_mode);
-        
-        }else{
-            usage(EXIT_FAILURE);
+    // Index maintenance
+    if (streq(argv[1], "--build-index")) {
+        if (argc != 4) usage(EXIT_FAILURE);
+        if (!index_build(argv[2], argv[3], NULL)) fail(argv[3]);
+        return EXIT_SUCCESS;
+    }
+
+    if (streq(argv[1], "--refresh-index")) {
+        if (argc != 3) usage(EXIT_FAILURE);
+        if (!index_refresh(argv[2])) fail(argv[2]);
+        return EXIT_SUCCESS;
+    }
+
+    // Search index instead of walking
+    if (streq(argv[1], "--index")) {
+        if (argc < 3) usage(EXIT_FAILURE);
+
+        Index x;
+        if (!index_open(&x, argv[2])) fail(argv[2]);
+
+        walk.expr = expr_parse(parse_output(argc - 3, argv + 3), argv + 3, &walk);
+        if (!walk.expr) usage(EXIT_FAILURE);
+
+        if (!output_open(&output, STDOUT_FILENO, 0, Print0 ? 0 : '\n')) fail("stdout");
+        walk.arg = &output;
+        if (Dupes) {
+            List files = {0};
+            walk.visit = walk_collect;
+            walk.arg   = &files;
+            index_walk(&x, &walk);
+            print_dupes(&files, &walk, &output);
+        } else {
+            index_walk(&x, &walk);
         }
 
-        i++;
+        expr_delete(walk.expr);
+        index_close(&x);
+        if (!output_close(&output)) fail("stdout");
+        return EXIT_SUCCESS;
     }
 
-    // TODO: Find files, filter files, print files
-    find_files(root, &files);
-    
-    filter_files(&files, &filters, &options);
+    // Walk once, then follow changes
+    if (streq(argv[1], "--watch")) {
+        if (argc < 3) usage(EXIT_FAILURE);
 
-    list_output(&files, stdout);
+        walk.expr = expr_parse(parse_output(argc - 3, argv + 3), argv + 3, &walk);
+        if (!walk.expr) usage(EXIT_FAILURE);
+
+        // Watch before walking, so nothing changed meanwhile is missed
+        Watch w;
+        if (!output_open(&output, STDOUT_FILENO, 0, Print0 ? 0 : '\n')) fail("stdout");
+        if (!watch_open(&w, argv[2], &walk, &output)) fail(argv[2]);
+
+        walk.arg = &output;
+        walk_files(argv[2], &walk);
+        if (!output_flush(&output)) fail("stdout");
+        while (watch_poll(&w, -1));
+
+        watch_close(&w);
+        expr_delete(walk.expr);
+        if (!output_close(&output)) fail("stdout");
+        return EXIT_SUCCESS;
+    }
+
+    const char *root = argv[1];
+
+    // Compile filter expression (and global options)
+    walk.expr = expr_parse(parse_output(argc - 2, argv + 2), argv + 2, &walk);
+    if (!walk.expr) usage(EXIT_FAILURE);
+
+    // Find, filter, and print files as they are discovered
+    if (!output_open(&output, STDOUT_FILENO, 0, Print0 ? 0 : '\n')) fail("stdout");
+    walk.arg = &output;
+    if (Dupes) {
+        // Sets can only be known once every match has been found
+        List files = {0};
+        walk.visit = walk_collect;
+        walk.arg   = &files;
+        walk_files(root, &walk);
+        print_dupes(&files, &walk, &output);
+    } else {
+        walk_files(root, &walk);
+    }
 
-    node_delete(files.head, true, true);
-    node_delete(filters.head, false, true);
-    
+    expr_delete(walk.expr);
+    if (!output_close(&output)) fail("stdout");
     return EXIT_SUCCESS;
 }
 
@@ -3,23 +3,120 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+/* Matcher Structure */
+
+#define MATCH_MAX_STATES    63  // Non-star elements that fit in a uint64_t
+
+typedef enum {
+    MATCH_EXACT,        // Literal name
+    MATCH_PREFIX,       // Literal followed by *
+    MATCH_SUFFIX,       // * followed by literal
+    MATCH_SUBSTRING,    // Literal surrounded by *
+    MATCH_GLOB,         // Bit-parallel automaton
+    MATCH_FNMATCH,      // Fallback to fnmatch
+} MatchType;
+
+typedef struct {
+    MatchType   type;       // Strategy chosen at compile time
+    bool        icase;      // Ignore case (-iname)
+    char       *pattern;    // Original pattern (MATCH_FNMATCH)
+    char       *literal;    // Literal bytes, lower case if icase
+    size_t      length;     // Length of literal
+    size_t      states;     // Number of non-star elements (MATCH_GLOB)
+    uint64_t    star;       // States with a * self-loop (MATCH_GLOB)
+    uint64_t    table[256]; // States entered on each byte (MATCH_GLOB)
+} Matcher;
+
+Matcher *   matcher_create(const char *pattern, bool icase);
+bool        matcher_match(Matcher *m, const char *s, size_t n);
+void        matcher_delete(Matcher *m);
+
+const char *match_search(const char *s, size_t n, const char *literal, size_t length);
+
 /* Options Structure */
 
 typedef struct {
     int   type;         // File type (-type)
     char *name;         // File name pattern (-name)
     int   mode;         // Access modes (-executable, -readable, -writable)
+    Matcher *matcher;   // Compiled name pattern (-name, -iname)
+    int   compare;      // Operand sign: -1 less than, 0 exactly, 1 more than
+    int64_t number;     // Operand value (-size units, -mtime days)
+    int64_t unit;       // Bytes per unit (-size)
+    struct timespec time;   // Reference time (-mtime now, -newer file mtime)
+    size_t length;      // Length of name (-contains)
 } Options;
 
+/* Range Structure */
+
+typedef struct {
+    int64_t size[2];    // Smallest and largest size in bytes
+    int64_t mtime[2];   // Oldest and newest modification time in nanoseconds
+} Range;
+
+/* Entry Structure */
+
+typedef struct {
+    const char *path;       // Full path to entry
+    size_t      length;     // Length of path
+    size_t      base;       // Offset of basename in path
+    size_t      baselen;    // Length of basename
+    const char *name;       // Name of entry relative to dirfd
+    int         dirfd;      // Parent directory (AT_FDCWD for root)
+    unsigned char type;     // d_type from readdir (DT_UNKNOWN if not known)
+    int         status;     // 0 if not stat'd yet, 1 if st is valid, -1 if failed
+    struct stat st;         // Cached lstat of entry (stat if following links)
+    bool        follow;     // Follow symbolic links (-L)
+    bool        prune;      // Set by -prune to keep walk out of directory
+} Entry;
+
+void            entry_init(Entry *e, const char *path);
+struct stat *   entry_stat(Entry *e);
+mode_t          entry_type(Entry *e);
+
 /* Filter Functions */
 
-typedef bool (*Filter)(const char *path, Options *options);
+typedef bool (*Filter)(Entry *entry, Options *options);
+typedef int  (*Bound)(const Range *range, Options *options);
+
+bool	filter_by_type(Entry *entry, Options *options);
+bool	filter_by_name(Entry *entry, Options *options);
+bool	filter_by_mode(Entry *entry, Options *options);
+bool	filter_by_size(Entry *entry, Options *options);
+bool	filter_by_mtime(Entry *entry, Options *options);
+bool	filter_by_newer(Entry *entry, Options *options);
+bool	filter_by_empty(Entry *entry, Options *options);
+bool	filter_by_prune(Entry *entry, Options *options);
+bool	filter_by_contains(Entry *entry, Options *options);
+
+int	bound_by_size(const Range *range, Options *options);
+int	bound_by_mtime(const Range *range, Options *options);
+int	bound_by_newer(const Range *range, Options *options);
+
+/* Arena Structure */
+
+#define ARENA_CHUNK     (64 * 1024)         // Size of first chunk
+#define ARENA_MAXCHUNK  (4 * 1024 * 1024)   // Largest chunk grown to
+
+typedef struct Chunk Chunk;
+
+typedef struct Arena Arena;
+struct Arena {
+    Chunk  *chunks;     // Current chunk, followed by older ones
+    Arena  *owner;      // Arena this one was merged into (NULL if none)
+};
 
-bool	filter_by_type(const char *path, Options *options);
-bool	filter_by_name(const char *path, Options *options);
-bool	filter_by_mode(const char *path, Options *options);
+Arena * arena_create(void);
+void *  arena_alloc(Arena *a, size_t size);
+void    arena_merge(Arena *dst, Arena *src);
+void    arena_delete(Arena *a);
 
 /* Data Union */
 
@@ -34,6 +131,7 @@ typedef struct Node Node;
 struct Node {
     Data    data;       // Data value
     Node   *next;       // Pointer to next Node
+    Arena  *arena;      // Arena holding Node and its string (NULL if heap)
 };
 
 Node *  node_create(Data data, Node *next);
@@ -44,10 +142,286 @@ void    node_delete(Node *n, bool release, bool recursive);
 typedef struct {
     Node   *head;       // Pointer to first Node
     Node   *tail;       // Pointer to last Node
+    Arena  *arena;      // Arena for list_append_string (NULL until used)
 } List;
 
 void    list_append(List *l, Data data);
+void    list_append_string(List *l, const char *s, size_t n);
 void    list_filter(List *l, Filter filter, Options *options, bool release);
 void    list_output(List *l, FILE *stream);
+void    list_delete(List *l, bool release);
+
+/* Store Structure */
+
+#define STORE_CAPACITY  (64 * 1024) // Initial size of byte blob
+#define STORE_SLOTS     1024        // Initial number of paths
+#define STORE_PADDING   64          // Readable bytes kept past end of blob
+
+typedef struct {
+    char       *bytes;      // NUL-terminated paths, back to back
+    size_t      size;       // Number of bytes used
+    size_t      capacity;   // Allocated size of bytes (not counting padding)
+    size_t     *offsets;    // Offset of each path in bytes
+    uint32_t   *bases;      // Offset of each basename in its path
+    uint32_t   *baselens;   // Length of each basename
+    size_t      count;      // Number of paths
+    size_t      slots;      // Allocated size of offsets, bases, and baselens
+} Store;
+
+bool    store_append(Store *s, const char *path, size_t n);
+size_t  store_match(Store *s, Filter filter, Options *options, bool *matches);
+bool    store_filter(Store *s, Filter filter, Options *options);
+void    store_delete(Store *s);
+
+/* Expression Structure */
+
+typedef enum {
+    EXPR_TRUE,          // Matches everything
+    EXPR_FILTER,        // Filter function with its own options
+    EXPR_NOT,           // Negation of single child
+    EXPR_AND,           // All children match (short-circuit)
+    EXPR_OR,            // Any child matches (short-circuit)
+} ExprType;
+
+typedef struct Expr Expr;
+struct Expr {
+    ExprType    type;       // Type of node
+    Filter      filter;     // Filter function (EXPR_FILTER)
+    Bound       bound;      // Range test of filter (NULL if it has none)
+    Options     options;    // Operands of filter function (EXPR_FILTER)
+    int         cost;       // Estimated cost of evaluating node
+    bool        effect;     // Node or a descendant has side effects (-prune)
+    bool        stat;       // Node or a descendant stats every entry
+    Expr      **children;   // Operands of operator
+    size_t      nchildren;  // Number of operands
+};
+
+/* Dir Structure */
+
+#define DIR_BUFSIZE     (64 * 1024) // Default getdents64 buffer size
+#define DIR_MINIMUM     1024        // Smallest buffer that fits any record
+
+typedef struct {
+    int         fd;         // Directory file descriptor
+    DIR        *stream;     // libc stream (readdir backend)
+    char       *buffer;     // Batch of raw records (getdents64 backend)
+    size_t      size;       // Size of buffer
+    size_t      offset;     // Offset of next record in buffer
+    size_t      length;     // Number of valid bytes in buffer
+} Dir;
+
+bool    dir_open(Dir *d, int fd, size_t size, bool libc);
+bool    dir_read(Dir *d, const char **name, unsigned char *type);
+int     dir_fd(Dir *d);
+void    dir_close(Dir *d);
+
+/* Output Structure */
+
+#define OUTPUT_BUFSIZE  (256 * 1024)    // Default output buffer size
+
+typedef struct {
+    int         fd;         // File descriptor to write to
+    char       *buffer;     // Pending output
+    size_t      size;       // Size of buffer
+    size_t      length;     // Number of pending bytes
+    char        delimiter;  // Byte written after each path
+    bool        failed;     // Whether or not a write has failed
+    bool        line;       // Whether or not each path is flushed (terminals)
+} Output;
+
+bool    output_open(Output *o, int fd, size_t size, char delimiter);
+bool    output_write(Output *o, const char *s, size_t n);
+bool    output_flush(Output *o);
+bool    output_close(Output *o);
+void    output_entry(Entry *entry, void *arg);
+
+/* Path Structure */
+
+#define PATH_CAPACITY   256     // Initial size of path buffer
+
+typedef struct {
+    char   *data;       // Path string
+    size_t  length;     // Length of path string
+    size_t  capacity;   // Allocated size of data
+} Path;
+
+bool    path_init(Path *p, const char *s);
+bool    path_push(Path *p, const char *name);
+void    path_pop(Path *p, size_t length);
+
+/* Index Structures */
+
+#define INDEX_MAGIC     "FINDIDX2"  // Magic (and version) of index files
+
+typedef struct {
+    char        magic[8];   // INDEX_MAGIC
+    uint32_t    record;     // sizeof(IndexRecord), rejects foreign layouts
+    uint32_t    reserved;   // Zero
+    uint64_t    count;      // Number of records (root first, in pre-order)
+    uint64_t    strings;    // File offset of path strings
+    uint64_t    size;       // Size of path strings
+} IndexHeader;
+
+typedef struct {
+    uint64_t    path;       // Offset of NUL-terminated path in strings
+    uint32_t    length;     // Length of path
+    uint32_t    base;       // Offset of basename in path
+    uint64_t    end;        // Index of first record after this subtree
+    uint64_t    dev;        // Device
+    uint64_t    ino;        // Inode number
+    int64_t     size;       // Size in bytes
+    int64_t     mtime;      // Modification time (seconds)
+    uint32_t    mtime_nsec; // Modification time (nanoseconds)
+    uint32_t    mode;       // Type and permission bits
+    uint32_t    uid;        // Owner
+    uint32_t    gid;        // Group
+    Range       range;      // Sizes and mtimes of everything below (if any)
+} IndexRecord;
+
+typedef struct {
+    void               *map;        // Mapped index file
+    size_t              mapsize;    // Size of mapping
+    const IndexHeader  *header;     // Header at start of mapping
+    const IndexRecord  *records;    // Records following header
+    const char         *strings;    // Path strings
+} Index;
+
+/* Set Structure */
+
+#define SET_CAPACITY    1024    // Initial number of slots (power of two)
+
+typedef struct {
+    uint64_t    dev;        // Device
+    uint64_t    ino;        // Inode number (0 for an empty slot)
+} SetKey;
+
+typedef struct {
+    pthread_mutex_t lock;       // Serializes walker threads
+    SetKey         *slots;      // Open-addressing table, probed linearly
+    size_t          capacity;   // Number of slots (power of two)
+    size_t          count;      // Number of keys
+} Set;
+
+bool    set_init(Set *s);
+bool    set_insert(Set *s, dev_t dev, ino_t ino);
+bool    set_contains(Set *s, dev_t dev, ino_t ino);
+void    set_destroy(Set *s);
+
+/* Ring Structure */
+
+#define RING_ENTRIES    64      // Operations in flight per batch
+
+typedef struct {
+    int                     fd;         // io_uring descriptor (-1 if unavailable)
+    unsigned                entries;    // Number of submission queue entries
+    void                   *sq;         // Mapped submission queue ring
+    void                   *cq;         // Mapped completion queue ring (may be sq)
+    struct io_uring_sqe    *sqes;       // Mapped submission queue entries
+    size_t                  sqsize;     // Size of sq mapping
+    size_t                  cqsize;     // Size of cq mapping
+    size_t                  sqesize;    // Size of sqes mapping
+    unsigned               *sqhead;     // Submission queue head (kernel)
+    unsigned               *sqtail;     // Submission queue tail (ours)
+    unsigned               *sqmask;     // Submission queue index mask
+    unsigned               *sqarray;    // Submission queue indices into sqes
+    unsigned               *cqhead;     // Completion queue head (ours)
+    unsigned               *cqtail;     // Completion queue tail (kernel)
+    unsigned               *cqmask;     // Completion queue index mask
+    struct io_uring_cqe    *cqes;       // Completion queue entries
+    struct statx           *buffers;    // statx results, one per entry
+} Ring;
+
+bool    ring_open(Ring *r, unsigned entries);
+size_t  ring_stat(Ring *r, int dirfd, const char **names, size_t n, int flags, struct stat *sts, bool *ok);
+void    ring_close(Ring *r);
+
+/* Walk Structure */
+
+typedef void (*Visitor)(Entry *entry, void *arg);
+
+typedef struct {
+    Expr       *expr;       // Filter expression (NULL keeps everything)
+    size_t      jobs;       // Number of walker threads
+    bool        unordered;  // Visit matches as workers find them
+    size_t      dirbuf;     // getdents64 buffer size (0 for DIR_BUFSIZE)
+    bool        readdir;    // Read directories with libc readdir instead
+    size_t      mindepth;   // Shallowest depth to visit (root is 0)
+    size_t      maxdepth;   // Deepest depth to visit plus one (0 for no limit)
+    bool        xdev;       // Stay on the file system of root
+    dev_t       dev;        // Device of root (set by walk for -xdev)
+    bool        follow;     // Follow symbolic links (-L)
+    Set        *seen;       // Directories walked so far (set by walk for -L)
+    bool        uring;      // Batch stats of each directory through io_uring (-uring)
+    Visitor     visit;      // Called with each matching entry
+    void       *arg;        // Argument passed to visit
+} Walk;
+
+/* Walk Functions */
+
+void	walk_files(const char *root, Walk *walk);
+void	find_files(const char *root, List *files, Expr *expr);
+void	find_files_parallel(const char *root, List *files, Expr *expr, size_t jobs);
+void	walk_collect(Entry *e, void *arg);
+
+/* Dupes Functions */
+
+#define DUPES_HEAD      4096        // Bytes hashed to tell same-size files apart
+#define DUPES_BUFSIZE   (64 * 1024) // Read buffer of each hashing thread
+#define DUPES_JOBS      4           // Hashing threads when walking with one
+#define DUPES_MAXJOBS   64          // Most hashing threads
+
+typedef void (*DupesVisitor)(const char **paths, size_t n, void *arg);
+
+ssize_t dupes_find(List *files, size_t jobs, bool follow, DupesVisitor visit, void *arg);
+
+/* Watch Structure */
+
+#define WATCH_CAPACITY  1024        // Initial number of slots (power of two)
+#define WATCH_BUFSIZE   (64 * 1024) // inotify event buffer size
+
+typedef struct {
+    int         wd;         // Watch descriptor (0 for an empty slot)
+    int         parent;     // Watch descriptor of parent directory (-1 for root)
+    uint32_t    depth;      // Depth below root
+    char       *name;       // Name within parent (path for root)
+} WatchSlot;
+
+typedef struct {
+    int         fd;         // inotify descriptor
+    WatchSlot  *slots;      // Open-addressing table keyed by wd, probed linearly
+    size_t      capacity;   // Number of slots (power of two)
+    size_t      count;      // Number of watched directories
+    int         root;       // Watch descriptor of root (-1 once gone)
+    dev_t       dev;        // Device of root (for -xdev)
+    bool        full;       // Whether or not the watch limit was reached
+    Walk       *walk;       // Expression and options to test changes with
+    Output     *output;     // Where changes are reported
+    Path        path;       // Path of current event (root first)
+    size_t      rootlen;    // Length of root in path
+    char       *record;     // Sign and path of current report
+    size_t      recordsize; // Allocated size of record
+    char       *buffer;     // inotify events
+} Watch;
+
+bool    watch_open(Watch *w, const char *root, Walk *walk, Output *output);
+bool    watch_poll(Watch *w, int timeout);
+void    watch_close(Watch *w);
+
+/* Index Functions */
+
+bool    index_build(const char *root, const char *path, const Index *old);
+bool    index_refresh(const char *path);
+bool    index_open(Index *x, const char *path);
+void    index_close(Index *x);
+void    index_walk(const Index *x, Walk *walk);
+
+/* Expression Functions */
+
+Expr *  expr_parse(int argc, char *argv[], Walk *walk);
+bool    expr_operand(const char *flag);
+void    expr_optimize(Expr *e);
+bool    expr_evaluate(Expr *e, Entry *entry);
+bool    expr_possible(Expr *e, const Range *range);
+void    expr_delete(Expr *e);
 
 /* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,552 @@
+/* index.c: On-disk file system index functions */
+
+#include "findit.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define	streq(a, b) (strcmp(a, b) == 0)
+
+#define INDEX_NONE      ((size_t)-1)    // No record
+#define INDEX_CAPACITY  1024            // Initial number of records
+
+/* Builder Structures */
+
+typedef struct {
+    IndexRecord *records;       // Records in pre-order
+    size_t       count;         // Number of records
+    size_t       capacity;      // Allocated number of records
+    char        *strings;       // Path strings
+    size_t       size;          // Size of path strings
+    size_t       allocated;     // Allocated size of path strings
+    const Index *old;           // Previous index to reuse (NULL for none)
+    bool         failed;        // Whether or not an allocation failed
+} Builder;
+
+typedef struct {
+    const char  *name;          // Basename of old record
+    size_t       index;         // Index of old record
+} Child;
+
+/* Builder Functions */
+
+/**
+ * Copy metadata into record.
+ * @param   r           Pointer to IndexRecord structure
+ * @param   st          Metadata to copy
+ **/
+static void record_stat(IndexRecord *r, const struct stat *st) {
+    r->dev        = st->st_dev;
+    r->ino        = st->st_ino;
+    r->size       = st->st_size;
+    r->mtime      = st->st_mtim.tv_sec;
+    r->mtime_nsec = st->st_mtim.tv_nsec;
+    r->mode       = st->st_mode;
+    r->uid        = st->st_uid;
+    r->gid        = st->st_gid;
+}
+
+/**
+ * Append record for path with the given metadata.
+ * @param   b           Pointer to Builder structure
+ * @param   path        Path string
+ * @param   length      Length of path
+ * @param   base        Offset of basename in path
+ * @param   st          Metadata of path
+ * @return  Index of new record or INDEX_NONE on failure.
+ **/
+static size_t builder_add(Builder *b, const char *path, size_t length, size_t base, const struct stat *st) {
+    if (b->count == b->capacity) {
+        size_t       capacity = b->capacity ? 2 * b->capacity : INDEX_CAPACITY;
+        IndexRecord *records  = realloc(b->records, capacity * sizeof(IndexRecord));
+        if (!records) goto failure;
+        b->records  = records;
+        b->capacity = capacity;
+    }
+
+    if (b->size + length + 1 > b->allocated) {
+        size_t allocated = 2 * b->allocated > b->size + length + 1 ? 2 * b->allocated : b->size + length + 1 + BUFSIZ;
+        char  *strings   = realloc(b->strings, allocated);
+        if (!strings) goto failure;
+        b->strings   = strings;
+        b->allocated = allocated;
+    }
+
+    IndexRecord *r = &b->records[b->count];
+    memset(r, 0, sizeof(IndexRecord));
+    r->path       = b->size;
+    r->length     = length;
+    r->base       = base;
+    r->end        = b->count + 1;
+    record_stat(r, st);
+
+    memcpy(b->strings + b->size, path, length + 1);
+    b->size += length + 1;
+    return b->count++;
+
+failure:
+    b->failed = true;
+    return INDEX_NONE;
+}
+
+/**
+ * Append copy of record from the previous index.
+ * @param   b           Pointer to Builder structure
+ * @param   index       Index of record in previous index
+ * @return  Index of new record or INDEX_NONE on failure.
+ **/
+static size_t builder_copy(Builder *b, size_t index) {
+    const IndexRecord *o = &b->old->records[index];
+    struct stat st = {
+        .st_dev  = o->dev,
+        .st_ino  = o->ino,
+        .st_size = o->size,
+        .st_mode = o->mode,
+        .st_uid  = o->uid,
+        .st_gid  = o->gid,
+        .st_mtim = {o->mtime, o->mtime_nsec},
+    };
+    return builder_add(b, b->old->strings + o->path, o->length, o->base, &st);
+}
+
+/**
+ * Compare Child structures by name.
+ * @param   a           Pointer to first Child structure
+ * @param   b           Pointer to second Child structure
+ * @return  Result of strcmp on names.
+ **/
+static int child_compare(const void *a, const void *b) {
+    return strcmp(((const Child *)a)->name, ((const Child *)b)->name);
+}
+
+static void builder_scan(Builder *b, int fd, Path *path, size_t self, size_t old);
+
+/**
+ * Descend into subdirectory of open directory.
+ * @param   b           Pointer to Builder structure
+ * @param   dirfd       Parent directory file descriptor
+ * @param   name        Name of subdirectory
+ * @param   path        Path to subdirectory
+ * @param   self        Index of subdirectory's record
+ * @param   old         Index of subdirectory's record in previous index
+ **/
+static void builder_descend(Builder *b, int dirfd, const char *name, Path *path, size_t self, size_t old) {
+    int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd >= 0) {
+        builder_scan(b, fd, path, self, old);
+    }
+}
+
+/**
+ * Reuse the entries of a directory that has not changed since the previous
+ * index, still descending into each subdirectory (whose own entries may have
+ * changed).
+ * @param   b           Pointer to Builder structure
+ * @param   fd          Directory file descriptor
+ * @param   path        Path to directory (restored on return)
+ * @param   old         Index of directory's record in previous index
+ **/
+static void builder_keep(Builder *b, int fd, Path *path, size_t old) {
+    const IndexRecord *records = b->old->records;
+    size_t             length  = path->length;
+
+    for (size_t i = old + 1; i < records[old].end; i = records[i].end) {
+        size_t self = builder_copy(b, i);
+        if (self == INDEX_NONE) return;
+
+        if (S_ISDIR(records[i].mode)) {
+            const char *name = b->old->strings + records[i].path + records[i].base;
+            if (path_push(path, name)) {
+                builder_descend(b, fd, name, path, self, i);
+                path_pop(path, length);
+            }
+        }
+    }
+}
+
+/**
+ * Read the entries of a directory that is new or has changed since the
+ * previous index, matching subdirectories to their previous records by name.
+ * @param   b           Pointer to Builder structure
+ * @param   fd          Directory file descriptor (closed on return)
+ * @param   path        Path to directory (restored on return)
+ * @param   old         Index of directory's record in previous index (or INDEX_NONE)
+ **/
+static void builder_read(Builder *b, int fd, Path *path, size_t old) {
+    Dir d;
+    if (!dir_open(&d, fd, 0, false)) return;
+
+    // Previous entries of this directory, sorted by name
+    Child *children  = NULL;
+    size_t nchildren = 0;
+    if (old != INDEX_NONE) {
+        const IndexRecord *records = b->old->records;
+        for (size_t i = old + 1; i < records[old].end; i = records[i].end) {
+            nchildren++;
+        }
+        if ((children = calloc(nchildren, sizeof(Child)))) {
+            size_t n = 0;
+            for (size_t i = old + 1; i < records[old].end; i = records[i].end) {
+                children[n].name  = b->old->strings + records[i].path + records[i].base;
+                children[n].index = i;
+                n++;
+            }
+            qsort(children, nchildren, sizeof(Child), child_compare);
+        } else {
+            nchildren = 0;
+        }
+    }
+
+    int           dfd    = dir_fd(&d);
+    size_t        length = path->length;
+    const char   *name;
+    unsigned char type;
+    struct stat   st;
+
+    while (dir_read(&d, &name, &type)) {
+        if (streq(name, ".") || streq(name, "..")) {
+            continue;
+        }
+
+        if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0 || !path_push(path, name)) {
+            continue;
+        }
+
+        size_t self = builder_add(b, path->data, path->length, length + 1, &st);
+        if (self != INDEX_NONE && S_ISDIR(st.st_mode)) {
+            Child  key   = {name, INDEX_NONE};
+            Child *found = nchildren ? bsearch(&key, children, nchildren, sizeof(Child), child_compare) : NULL;
+            builder_descend(b, dfd, name, path, self, found ? found->index : INDEX_NONE);
+        }
+
+        path_pop(path, length);
+    }
+
+    free(children);
+    dir_close(&d);
+}
+
+/**
+ * Record the entries of a directory (and its subdirectories), reusing the
+ * previous index's entries if the directory's mtime has not changed.
+ * @param   b           Pointer to Builder structure
+ * @param   fd          Directory file descriptor (closed on return)
+ * @param   path        Path to directory (restored on return)
+ * @param   self        Index of directory's record
+ * @param   old         Index of directory's record in previous index (or INDEX_NONE)
+ **/
+static void builder_scan(Builder *b, int fd, Path *path, size_t self, size_t old) {
+    struct stat st;
+    bool        same = false;
+
+    if (old != INDEX_NONE && fstat(fd, &st) == 0) {
+        const IndexRecord *o = &b->old->records[old];
+        same = o->dev == (uint64_t)st.st_dev && o->ino == (uint64_t)st.st_ino &&
+               o->mtime == st.st_mtim.tv_sec && o->mtime_nsec == (uint32_t)st.st_mtim.tv_nsec;
+
+        // Record the directory as it is now, so it is not rescanned next time
+        record_stat(&b->records[self], &st);
+    }
+
+    if (same) {
+        builder_keep(b, fd, path, old);
+        close(fd);
+    } else {
+        builder_read(b, fd, path, old);
+    }
+
+    if (!b->failed) {
+        b->records[self].end = b->count;
+    }
+}
+
+/**
+ * Fill in each directory's range with the sizes and mtimes of everything
+ * below it, children before parents.
+ * @param   b           Pointer to Builder structure
+ **/
+static void builder_summarize(Builder *b) {
+    for (size_t i = b->count; i-- > 0; ) {
+        IndexRecord *r = &b->records[i];
+        Range       *s = &r->range;
+
+        s->size[0]  = s->mtime[0] = INT64_MAX;
+        s->size[1]  = s->mtime[1] = INT64_MIN;
+        for (size_t j = i + 1; j < r->end; j = b->records[j].end) {
+            IndexRecord *c     = &b->records[j];
+            int64_t      mtime = c->mtime * 1000000000LL + c->mtime_nsec;
+
+            if (c->size < s->size[0])   s->size[0]  = c->size;
+            if (c->size > s->size[1])   s->size[1]  = c->size;
+            if (mtime < s->mtime[0])    s->mtime[0] = mtime;
+            if (mtime > s->mtime[1])    s->mtime[1] = mtime;
+            if (c->end > j + 1) {
+                if (c->range.size[0] < s->size[0])      s->size[0]  = c->range.size[0];
+                if (c->range.size[1] > s->size[1])      s->size[1]  = c->range.size[1];
+                if (c->range.mtime[0] < s->mtime[0])    s->mtime[0] = c->range.mtime[0];
+                if (c->range.mtime[1] > s->mtime[1])    s->mtime[1] = c->range.mtime[1];
+            }
+        }
+    }
+}
+
+/**
+ * Write the builder's records to path, replacing any existing file only once
+ * the new index is complete.
+ * @param   b           Pointer to Builder structure
+ * @param   path        Path of index file
+ * @return  Whether or not the index was written.
+ **/
+static bool builder_write(Builder *b, const char *path) {
+    char temporary[BUFSIZ];
+    if (snprintf(temporary, BUFSIZ, "%s.%d", path, getpid()) >= BUFSIZ) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+
+    int fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+
+    FILE *stream = fdopen(fd, "w");
+    if (!stream) {
+        close(fd);
+        unlink(temporary);
+        return false;
+    }
+
+    IndexHeader header = {
+        .record  = sizeof(IndexRecord),
+        .count   = b->count,
+        .strings = sizeof(IndexHeader) + b->count * sizeof(IndexRecord),
+        .size    = b->size,
+    };
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+
+    bool written = fwrite(&header, sizeof(header), 1, stream) == 1 &&
+                   fwrite(b->records, sizeof(IndexRecord), b->count, stream) == b->count &&
+                   fwrite(b->strings, 1, b->size, stream) == b->size;
+    if (fclose(stream) != 0) written = false;
+
+    if (!written || rename(temporary, path) < 0) {
+        unlink(temporary);
+        return false;
+    }
+    return true;
+}
+
+/* Index Functions */
+
+/**
+ * Build index of every file system entity under root (root included, in the
+ * same order as a serial walk) and write it to path.  A relative root is
+ * recorded from the working directory, so that the index names the same
+ * files wherever it is searched or refreshed from.  With a previous index
+ * of the same root, directories whose mtime has not changed are not read
+ * again: their entries (and the metadata recorded for them) are reused.
+ * @param   root        Directory to index
+ * @param   path        Path of index file
+ * @param   old         Previous index to reuse (NULL for none)
+ * @return  Whether or not the index was written.
+ **/
+bool    index_build(const char *root, const char *path, const Index *old) {
+    char absolute[PATH_MAX];
+    if (root[0] != '/') {
+        if (!getcwd(absolute, sizeof(absolute))) return false;
+
+        size_t n = strlen(absolute);
+        if (!streq(root, ".") &&
+            (size_t)snprintf(absolute + n, sizeof(absolute) - n, "%s%s", n > 1 ? "/" : "", root) >= sizeof(absolute) - n) {
+            errno = ENAMETOOLONG;
+            return false;
+        }
+        root = absolute;
+    }
+
+    Builder b = {0};
+    if (old && old->header->count && streq(old->strings + old->records[0].path, root)) {
+        b.old = old;
+    }
+
+    struct stat st;
+    if (lstat(root, &st) < 0) return false;
+
+    Entry e;
+    entry_init(&e, root);
+    size_t self = builder_add(&b, root, e.length, e.base, &st);
+
+    int  fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    Path p;
+    if (self != INDEX_NONE && fd >= 0) {
+        if (path_init(&p, root)) {
+            builder_scan(&b, fd, &p, self, b.old ? 0 : INDEX_NONE);
+            free(p.data);
+        } else {
+            close(fd);
+            b.failed = true;
+        }
+    }
+
+    if (!b.failed) {
+        builder_summarize(&b);
+    }
+
+    bool written = !b.failed && builder_write(&b, path);
+    if (b.failed) errno = ENOMEM;
+    free(b.records);
+    free(b.strings);
+    return written;
+}
+
+/**
+ * Rebuild index at path from its own root, reusing unchanged directories.
+ * @param   path        Path of index file
+ * @return  Whether or not the index was written.
+ **/
+bool    index_refresh(const char *path) {
+    Index x;
+    if (!index_open(&x, path)) return false;
+
+    bool written = x.header->count && index_build(x.strings + x.records[0].path, path, &x);
+    index_close(&x);
+    return written;
+}
+
+/**
+ * Map index file and check that every record lies within it.
+ * @param   x           Pointer to Index structure
+ * @param   path        Path of index file
+ * @return  Whether or not the index could be opened.
+ **/
+bool    index_open(Index *x, const char *path) {
+    memset(x, 0, sizeof(Index));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(IndexHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return false;
+    }
+
+    x->mapsize = st.st_size;
+    x->map     = mmap(NULL, x->mapsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (x->map == MAP_FAILED) {
+        x->map = NULL;
+        return false;
+    }
+
+    x->header  = x->map;
+    x->records = (const IndexRecord *)(x->header + 1);
+    x->strings = (const char *)x->map + x->header->strings;
+
+    const IndexHeader *h  = x->header;
+    bool               ok = !memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) &&
+                            h->record == sizeof(IndexRecord) &&
+                            h->count <= (x->mapsize - sizeof(IndexHeader)) / sizeof(IndexRecord) &&
+                            h->strings == sizeof(IndexHeader) + h->count * sizeof(IndexRecord) &&
+                            h->size <= x->mapsize - h->strings;
+
+    for (size_t i = 0; ok && i < h->count; i++) {
+        const IndexRecord *r = &x->records[i];
+        ok = r->path < h->size && r->length < h->size - r->path &&
+             x->strings[r->path + r->length] == 0 && r->base <= r->length &&
+             r->end > i && r->end <= h->count;
+    }
+
+    if (!ok) {
+        index_close(x);
+        errno = EINVAL;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Unmap index file.
+ * @param   x           Pointer to Index structure
+ **/
+void    index_close(Index *x) {
+    if (x->map) {
+        munmap(x->map, x->mapsize);
+    }
+    memset(x, 0, sizeof(Index));
+}
+
+/**
+ * Visit each record of index that matches the walk's filter expression, in
+ * the order it was indexed.  Entries carry the indexed metadata, so name,
+ * type, and stat based predicates never touch the file system (access
+ * predicates and -empty on directories still ask the kernel).  Subtrees whose
+ * size and mtime ranges rule out any match are skipped entirely, as are those
+ * the walk would not descend into (-prune, -maxdepth, -xdev).
+ * @param   x           Pointer to Index structure
+ * @param   walk        Pointer to Walk structure
+ **/
+void    index_walk(const Index *x, Walk *walk) {
+    size_t   *ends     = NULL;  // End of each directory being walked
+    size_t    depth    = 0;     // Number of directories being walked
+    size_t    capacity = 0;
+    uint64_t  dev      = x->header->count ? x->records[0].dev : 0;
+
+    for (size_t i = 0, next; i < x->header->count; i = next) {
+        const IndexRecord *r = &x->records[i];
+        Entry              e;
+
+        while (depth && ends[depth - 1] <= i) depth--;
+
+        entry_init(&e, x->strings + r->path);
+        e.type   = IFTODT(r->mode);
+        e.status = 1;
+        memset(&e.st, 0, sizeof(e.st));
+        e.st.st_dev            = r->dev;
+        e.st.st_ino            = r->ino;
+        e.st.st_size           = r->size;
+        e.st.st_mode           = r->mode;
+        e.st.st_uid            = r->uid;
+        e.st.st_gid            = r->gid;
+        e.st.st_mtim.tv_sec    = r->mtime;
+        e.st.st_mtim.tv_nsec   = r->mtime_nsec;
+
+        if (depth >= walk->mindepth && (!walk->expr || expr_evaluate(walk->expr, &e))) {
+            walk->visit(&e, walk->arg);
+        }
+
+        next = i + 1;
+        if (r->end == next) continue;
+
+        bool descend = !e.prune &&
+                       (!walk->maxdepth || depth + 1 < walk->maxdepth) &&
+                       (!walk->xdev || r->dev == dev) &&
+                       (!walk->expr || expr_possible(walk->expr, &r->range));
+        if (descend && depth == capacity) {
+            size_t  grown = capacity ? 2 * capacity : PATH_CAPACITY;
+            size_t *array = realloc(ends, grown * sizeof(size_t));
+            if (array) {
+                ends     = array;
+                capacity = grown;
+            }
+        }
+        if (descend && depth < capacity) {
+            ends[depth++] = r->end;
+        } else {
+            next = r->end;
+        }
+    }
+
+    free(ends);
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,374 @@
+/* index.unit.c: file system index unit test */
+
+#include "findit.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+#define nargs(a)    (sizeof(a) / sizeof((a)[0]))
+
+#define TEMPLATE    "/tmp/index.unit.XXXXXX"
+
+/* Functions */
+
+/**
+ * Create a tree of directories under root with fanout subdirectories and
+ * fanout files per directory, depth levels deep.
+ * @param   root        Directory to populate
+ * @param   fanout      Number of subdirectories and files per directory
+ * @param   depth       Number of levels to create
+ * @return  Number of entries created.
+ **/
+size_t make_tree(const char *root, int fanout, int depth) {
+    size_t count = 0;
+
+    for (int i = 0; i < fanout; i++) {
+        char path[BUFSIZ];
+        snprintf(path, BUFSIZ, "%s/file%d.txt", root, i);
+        int fd = open(path, O_CREAT | O_WRONLY, 0644);
+        assert(fd >= 0);
+        close(fd);
+        count++;
+
+        if (depth > 0) {
+            snprintf(path, BUFSIZ, "%s/dir%d", root, i);
+            assert(mkdir(path, 0755) == 0);
+            count += 1 + make_tree(path, fanout, depth - 1);
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Create a temporary tree and a path for its index.
+ * @param   root        Buffer to store temporary directory path in
+ * @param   index       Buffer to store index path in
+ * @param   count       Number of entries created beneath root
+ **/
+void make_root(char *root, char *index, size_t *count) {
+    strcpy(root, TEMPLATE);
+    assert(mkdtemp(root));
+    *count = make_tree(root, 3, 2);
+    snprintf(index, BUFSIZ, "%s.index", root);
+}
+
+/**
+ * Remove temporary tree and its index.
+ * @param   root        Temporary directory path
+ * @param   index       Index path
+ **/
+void remove_root(const char *root, const char *index) {
+    char command[BUFSIZ];
+    snprintf(command, BUFSIZ, "rm -fr %s", root);
+    assert(system(command) == 0);
+    unlink(index);
+}
+
+/**
+ * Visitor that appends a copy of the entry's path to a List.
+ * @param   e           Pointer to Entry structure
+ * @param   arg         Pointer to List structure
+ **/
+void collect_entry(Entry *e, void *arg) {
+    list_append_string((List *)arg, e->path, e->length);
+}
+
+/**
+ * Determine if index and a fresh walk of root agree on every path, in order,
+ * for the given expression.
+ * @param   root        Directory to walk
+ * @param   index       Index path
+ * @param   argc        Number of expression arguments
+ * @param   argv        Expression arguments
+ * @return  Number of paths visited.
+ **/
+size_t agree(const char *root, const char *index, int argc, char *argv[]) {
+    List expected = {0};
+    List actual   = {0};
+    Walk walk     = {.jobs = 1, .visit = collect_entry};
+
+    walk.expr = expr_parse(argc, argv, &walk);
+    assert(walk.expr);
+    walk.arg  = &expected;
+    walk_files(root, &walk);
+
+    Index x;
+    assert(index_open(&x, index));
+    walk.arg  = &actual;
+    index_walk(&x, &walk);
+    index_close(&x);
+    expr_delete(walk.expr);
+
+    size_t count = 0;
+    Node  *e     = expected.head;
+    Node  *a     = actual.head;
+    for (; e && a; e = e->next, a = a->next, count++) {
+        assert(streq(e->data.string, a->data.string));
+    }
+    assert(!e && !a);
+
+    list_delete(&expected, true);
+    list_delete(&actual, true);
+    return count;
+}
+
+/**
+ * Look up size recorded in index for path.
+ * @param   index       Index path
+ * @param   path        Path to look up
+ * @return  Recorded size or -1 if path is not indexed.
+ **/
+int64_t indexed_size(const char *index, const char *path) {
+    Index x;
+    assert(index_open(&x, index));
+
+    int64_t size = -1;
+    for (size_t i = 0; i < x.header->count; i++) {
+        if (streq(x.strings + x.records[i].path, path)) {
+            size = x.records[i].size;
+        }
+    }
+    index_close(&x);
+    return size;
+}
+
+/* Tests */
+
+int test_00_index_build() {
+    char root[sizeof(TEMPLATE)];
+    char index[BUFSIZ];
+    size_t count;
+    make_root(root, index, &count);
+
+    // Test: every path, in walk order, with and without filters
+    assert(index_build(root, index, NULL));
+    assert(agree(root, index, 0, NULL) == count + 1);
+
+    char *files[]   = {"-type", "f"};
+    char *dirs[]    = {"-type", "d", "-name", "dir[02]"};
+    char *either[]  = {"-name", "file1*", "-o", "!", "-executable"};
+    assert(agree(root, index, nargs(files), files) > 0);
+    assert(agree(root, index, nargs(dirs), dirs) > 0);
+    assert(agree(root, index, nargs(either), either) > 0);
+
+    // Test: depth limits and pruning skip subtrees the same way
+    char *depth[]   = {"-mindepth", "2", "-maxdepth", "2"};
+    char *pruned[]  = {"-name", "dir1", "-prune", "-o", "-type", "f"};
+    char *xdev[]    = {"-xdev", "-maxdepth", "1"};
+    assert(agree(root, index, nargs(depth), depth) == 3 * 6);
+    assert(agree(root, index, nargs(pruned), pruned) > 0);
+    assert(agree(root, index, nargs(xdev), xdev) == 1 + 6);
+
+    // Test: index records metadata
+    char path[BUFSIZ];
+    snprintf(path, BUFSIZ, "%s/file0.txt", root);
+    assert(indexed_size(index, path) == 0);
+
+    // Test: root that is not a directory indexes just itself
+    assert(index_build(path, index, NULL));
+    assert(agree(path, index, 0, NULL) == 1);
+
+    // Test: missing root
+    snprintf(path, BUFSIZ, "%s/missing", root);
+    assert(!index_build(path, index, NULL));
+
+    remove_root(root, index);
+    return EXIT_SUCCESS;
+}
+
+int test_01_index_refresh() {
+    char root[sizeof(TEMPLATE)];
+    char index[BUFSIZ];
+    char path[BUFSIZ];
+    size_t count;
+    make_root(root, index, &count);
+    assert(index_build(root, index, NULL));
+
+    // Test: added and removed entries in changed directories are found
+    snprintf(path, BUFSIZ, "%s/dir1/added", root);
+    assert(mkdir(path, 0755) == 0);
+    snprintf(path, BUFSIZ, "%s/dir1/added/new.txt", root);
+    int fd = open(path, O_CREAT | O_WRONLY, 0644);
+    assert(fd >= 0);
+    close(fd);
+    snprintf(path, BUFSIZ, "%s/dir2/dir0/file2.txt", root);
+    assert(unlink(path) == 0);
+
+    // Test: directories whose mtime did not change are not read again
+    snprintf(path, BUFSIZ, "%s/dir0/file0.txt", root);
+    fd = open(path, O_WRONLY);
+    assert(fd >= 0);
+    assert(write(fd, "data", 4) == 4);
+    close(fd);
+
+    assert(index_refresh(index));
+    assert(agree(root, index, 0, NULL) == count + 1 + 2 - 1);
+    assert(indexed_size(index, path) == 0);
+
+    // Test: a full build sees the change, and refreshing again is stable
+    assert(index_build(root, index, NULL));
+    assert(indexed_size(index, path) == 4);
+    assert(index_refresh(index));
+    assert(indexed_size(index, path) == 4);
+    assert(agree(root, index, 0, NULL) == count + 1 + 2 - 1);
+
+    remove_root(root, index);
+    return EXIT_SUCCESS;
+}
+
+int test_02_index_open() {
+    char root[sizeof(TEMPLATE)];
+    char index[BUFSIZ];
+    size_t count;
+    make_root(root, index, &count);
+    assert(index_build(root, index, NULL));
+
+    // Test: truncated and corrupted indexes are rejected
+    Index x;
+    struct stat st;
+    assert(stat(index, &st) == 0);
+    assert(truncate(index, st.st_size - 1) == 0);
+    assert(!index_open(&x, index));
+
+    assert(index_build(root, index, NULL));
+    int fd = open(index, O_WRONLY);
+    assert(fd >= 0);
+    assert(pwrite(fd, "X", 1, 0) == 1);
+    close(fd);
+    assert(!index_open(&x, index));
+    assert(!index_refresh(index));
+
+    // Test: missing index
+    unlink(index);
+    assert(!index_open(&x, index));
+
+    remove_root(root, index);
+    return EXIT_SUCCESS;
+}
+
+int test_03_index_range() {
+    char root[sizeof(TEMPLATE)];
+    char index[BUFSIZ];
+    char path[BUFSIZ];
+    size_t count;
+    make_root(root, index, &count);
+
+    // Fixture: one large file deep in dir1
+    snprintf(path, BUFSIZ, "%s/dir1/dir2/file0.txt", root);
+    assert(truncate(path, 1 << 20) == 0);
+    assert(index_build(root, index, NULL));
+
+    // Test: directory ranges cover everything below them
+    Index x;
+    assert(index_open(&x, index));
+    for (size_t i = 0; i < x.header->count; i++) {
+        const IndexRecord *r = &x.records[i];
+        for (size_t j = i + 1; j < r->end; j++) {
+            assert(r->range.size[0] <= x.records[j].size && x.records[j].size <= r->range.size[1]);
+        }
+        if (streq(x.strings + r->path, root)) {
+            assert(r->range.size[1] == 1 << 20);
+        }
+    }
+
+    // Test: subtrees that cannot match are ruled out, others are not
+    char *large[] = {"-size", "+100k"};
+    Walk  walk    = {0};
+    walk.expr = expr_parse(nargs(large), large, &walk);
+    for (size_t i = 0; i < x.header->count; i++) {
+        const IndexRecord *r = &x.records[i];
+        if (r->end == i + 1) continue;
+        bool inside = !strncmp(path, x.strings + r->path, r->length) && path[r->length] == '/';
+        assert(expr_possible(walk.expr, &r->range) == inside);
+    }
+    expr_delete(walk.expr);
+    index_close(&x);
+
+    // Test: pruned queries agree with the walk
+    char *small[]  = {"-size", "-100k", "-type", "f"};
+    char *either[] = {"-size", "+100k", "-o", "-name", "dir0"};
+    char *negate[] = {"!", "-size", "+100k"};
+    assert(agree(root, index, nargs(large), large) == 1);
+    assert(agree(root, index, nargs(small), small) > 0);
+    assert(agree(root, index, nargs(either), either) > 1);
+    assert(agree(root, index, nargs(negate), negate) == count);
+
+    remove_root(root, index);
+    return EXIT_SUCCESS;
+}
+
+int test_04_index_relative() {
+    char root[sizeof(TEMPLATE)];
+    char index[BUFSIZ];
+    char path[BUFSIZ];
+    size_t count;
+    make_root(root, index, &count);
+
+    // Test: a relative root is recorded from the working directory
+    char cwd[BUFSIZ];
+    assert(getcwd(cwd, sizeof(cwd)));
+    assert(chdir("/tmp") == 0);
+    assert(index_build(root + strlen("/tmp/"), index, NULL));
+    assert(chdir("/") == 0);
+    assert(agree(root, index, 0, NULL) == count + 1);
+
+    // Test: access predicates and -empty test the indexed files, not ones
+    // that happen to share their relative paths under the working directory
+    snprintf(path, BUFSIZ, "%s/dir0/file0.txt", root);
+    assert(chmod(path, 0) == 0);
+    char *unreadable[] = {"!", "-readable"};
+    char *empty[]      = {"-type", "d", "-empty"};
+    size_t denied      = agree(root, index, nargs(unreadable), unreadable);
+    assert(getuid() == 0 ? denied == 0 : denied == 1);
+    assert(agree(root, index, nargs(empty), empty) == 0);
+
+    // Test: refreshing from elsewhere rebuilds the same tree
+    assert(index_refresh(index));
+    assert(agree(root, index, 0, NULL) == count + 1);
+
+    assert(chdir(cwd) == 0);
+    remove_root(root, index);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test index_build\n");
+        fprintf(stderr, "    1  Test index_refresh\n");
+        fprintf(stderr, "    2  Test index_open\n");
+        fprintf(stderr, "    3  Test index ranges\n");
+        fprintf(stderr, "    4  Test index of relative root\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_index_build(); break;
+        case 1:  status = test_01_index_refresh(); break;
+        case 2:  status = test_02_index_open(); break;
+        case 3:  status = test_03_index_range(); break;
+        case 4:  status = test_04_index_relative(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -1,8 +1,11 @@
 /* list.c: Singly Linked List */
 
+#define _GNU_SOURCE     // fputs_unlocked
+
 #include "findit.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 /* Node Functions */
 
@@ -23,23 +26,41 @@ Node *  node_create(Data data, Node *next) {
 }
 
 /**
- * Deallocate Node structure.
+ * Free heap nodes from n on (or n alone), stepping over arena nodes.
+ * @param   n           Pointer to Node structure
+ * @param   release     Whether or not to free Data strings of heap Nodes
+ * @param   recursive   Whether or not to continue with next Node structure
+ * @return  Arena of the arena nodes stepped over (NULL if none).
+ **/
+static Arena *node_free(Node *n, bool release, bool recursive) {
+    Arena *arena = NULL;
+
+    // Iterate rather than recurse, so long lists cannot overflow the stack
+    while (n) {
+        Node *next = recursive ? n->next : NULL;
+        if (n->arena) {
+            arena = n->arena;
+        } else {
+            if (release) free(n->data.string);
+            free(n);
+        }
+        n = next;
+    }
+    return arena;
+}
+
+/**
+ * Deallocate Node structure.  Nodes from an arena are only reclaimed all at
+ * once: deleting one recursively frees every heap node after it and then
+ * releases the whole arena (strings included), while deleting one alone does
+ * nothing.
  * @param   n           Pointer to Node structure
  * @param   release     Whether or not to free Data string
  * @param   recursive   Whether or not to recursively delete next Node structure
  **/
 void    node_delete(Node *n, bool release, bool recursive) {
-    // Handle base case, recursive case, and then release data and Node
-    if (n  == NULL) return;
-    
-    if (recursive){
-        node_delete(n->next, release, recursive);
-    }
-    
-    if (release) free(n->data.string);
-    free(n);
-
-    return;
+    Arena *arena = node_free(n, release, recursive);
+    if (recursive) arena_delete(arena);
 }
 
 /* List Functions */
@@ -50,23 +71,48 @@ void    node_delete(Node *n, bool release, bool recursive) {
  * @param   data        Data value to append
  **/
 void    list_append(List *l, Data data) {
-    Node* n = l->head;
+    Node *n = node_create(data, NULL);
+    if (!n) return;
 
-    if(!n){
-        l->head = node_create(data, NULL);
-        l->tail = l->head;
-        return;
+    if (l->tail) {
+        l->tail->next = n;
+    } else {
+        l->head = n;
     }
-    while(n->next){
-        n = n->next;
+    l->tail = n;
+}
+
+/**
+ * Append copy of string to end of specified List, allocating both the Node
+ * and the string from the List's arena (so the List must be released with
+ * list_delete or node_delete on its head).
+ * @param   l           Pointer to List structure
+ * @param   s           String bytes (need not be NUL-terminated)
+ * @param   n           Number of bytes
+ **/
+void    list_append_string(List *l, const char *s, size_t n) {
+    if (!l->arena && !(l->arena = arena_create())) return;
+
+    Node *node = arena_alloc(l->arena, sizeof(Node) + n + 1);
+    if (!node) return;
+
+    node->data.string = (char *)(node + 1);
+    node->next        = NULL;
+    node->arena       = l->arena;
+    memcpy(node->data.string, s, n);
+    node->data.string[n] = 0;
+
+    if (l->tail) {
+        l->tail->next = node;
+    } else {
+        l->head = node;
     }
-    n->next = node_create(data, NULL);
-    l->tail = n->next;
+    l->tail = node;
 }
 
 /**
- * Filter list by applying the filter function to each Data string in List with
- * the given options:
+ * Filter list by applying the filter function to an Entry for each Data string
+ * in List with the given options:
  *
  *  - If filter function returns true, then keep current Node.
  *  - Otherwise, remove current Node from List and delete it.
@@ -81,11 +127,13 @@ void    list_filter(List *l, Filter filter, Options *options, bool release) {
     // to determine whether or not to keep the Node.
     Node* n = l->head;
     Node* prev = NULL;
+    Entry e;
 
     if (!n) return;
 
     while(n){
-        if(filter(n->data.string, options)){
+        entry_init(&e, n->data.string);
+        if(filter(&e, options)){
             prev = n;
             n = n->next;
         }else{
@@ -114,11 +162,28 @@ void    list_filter(List *l, Filter filter, Options *options, bool release) {
  * @param   stream      File stream to output to
  **/
 void    list_output(List *l, FILE *stream) {
-    //  Iterate though List and output each Data string to given stream
-    // (one string per line).
+    // Lock stream once for the whole list rather than once per string
+    flockfile(stream);
     for (Node* n = l->head; n; n=n->next){
-        fprintf(stream, "%s\n", n->data.string);
+        fputs_unlocked(n->data.string, stream);
+        putc_unlocked('\n', stream);
     }
+    funlockfile(stream);
+}
+
+/**
+ * Deallocate every Node in List (and its arena) and reset it to empty.
+ * @param   l           Pointer to List structure
+ * @param   release     Whether or not to free Data strings of heap Nodes
+ **/
+void    list_delete(List *l, bool release) {
+    // Heap nodes are freed even in a list with an arena, and the arena is
+    // released even once filtering has removed all of its nodes
+    Arena *arena = node_free(l->head, release, true);
+    arena_delete(l->arena ? l->arena : arena);
+    l->head  = NULL;
+    l->tail  = NULL;
+    l->arena = NULL;
 }
 
 /* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -16,8 +16,8 @@
 
 /* Functions */
 
-bool filter_by_length(const char *path, Options *options) {
-    return strlen(path) > options->type;
+bool filter_by_length(Entry *entry, Options *options) {
+    return strlen(entry->path) > options->type;
 }
 
 /* Tests */
@@ -195,6 +195,102 @@ int test_04_list_output() {
     return EXIT_SUCCESS;
 }
 
+int test_05_list_append_string() {
+    List l = {NULL};
+    Options o = {0};
+    char buffer[BUFSIZ];
+
+    // Test: strings are copied (and terminated) into the list's arena
+    list_append_string(&l, "filter.c/", 8);
+    assert(l.head && l.head == l.tail && l.arena);
+    assert(l.head->arena == l.arena);
+    assert(streq(l.head->data.string, "filter.c"));
+
+    // Test: many appends stay in order and span several chunks
+    size_t count = 1000000;
+    for (size_t i = 0; i < count; i++) {
+        int n = snprintf(buffer, BUFSIZ, "entry-%zu", i);
+        list_append_string(&l, buffer, n);
+    }
+    assert(streq(l.tail->data.string, "entry-999999"));
+    assert(l.arena->chunks);
+
+    size_t i = 0;
+    for (Node *n = l.head->next; n; n = n->next, i++) {
+        snprintf(buffer, BUFSIZ, "entry-%zu", i);
+        assert(streq(n->data.string, buffer));
+    }
+    assert(i == count);
+
+    // Test: filtering arena nodes leaves the arena to reclaim them
+    o.type = strlen("entry-99999");
+    list_filter(&l, filter_by_length, &o, true);
+    assert(streq(l.head->data.string, "entry-100000"));
+    assert(streq(l.tail->data.string, "entry-999999"));
+    list_delete(&l, true);
+    assert(!l.head && !l.tail && !l.arena);
+
+    // Test: merged arenas are released with the arena they merged into
+    List a = {NULL};
+    List b = {NULL};
+    list_append_string(&a, "a", 1);
+    list_append_string(&b, "b", 1);
+    arena_merge(a.arena, b.arena);
+    a.tail->next = b.head;
+    node_delete(b.head, false, false);
+    node_delete(a.head, true, true);
+
+    // Test: heap nodes mixed in with arena nodes are freed along with them,
+    // by node_delete and by list_delete alike
+    a = (List){NULL};
+    list_append(&a, (Data)strdup("before"));
+    list_append_string(&a, "arena", 5);
+    list_append(&a, (Data)strdup("after"));
+    assert(!a.head->arena && a.head->next->arena && !a.tail->arena);
+    node_delete(a.head, true, true);
+    a = (List){NULL};
+    list_append_string(&a, "arena", 5);
+    list_append(&a, (Data)strdup("after"));
+    list_delete(&a, true);
+    assert(!a.head && !a.tail && !a.arena);
+
+    // Test: deleting a long heap list does not recurse
+    for (size_t i = 0; i < count; i++) {
+        list_append(&l, (Data)strdup("heap"));
+    }
+    list_delete(&l, true);
+    return EXIT_SUCCESS;
+}
+
+int test_06_list_long() {
+    size_t count = 10000000;
+    Data   d     = {.string="node"};
+
+    // Test: deleting ten million heap nodes does not recurse
+    Node *head = NULL;
+    for (size_t i = 0; i < count; i++) {
+        head = node_create(d, head);
+        assert(head);
+    }
+    node_delete(head, false, true);
+
+    // Test: same for a list whose nodes live in an arena
+    List l = {NULL};
+    for (size_t i = 0; i < count; i++) {
+        list_append_string(&l, d.string, 4);
+    }
+    assert(l.head && streq(l.tail->data.string, "node"));
+
+    size_t i = 0;
+    for (Node *n = l.head; n; n = n->next) {
+        i++;
+    }
+    assert(i == count);
+    list_delete(&l, true);
+    assert(!l.head && !l.tail && !l.arena);
+    return EXIT_SUCCESS;
+}
+
 /* Main Execution */
 
 int main(int argc, char *argv[]) {
@@ -206,6 +302,8 @@ int main(int argc, char *argv[]) {
         fprintf(stderr, "    2  Test list_append\n");
         fprintf(stderr, "    3  Test list_filter\n");
         fprintf(stderr, "    4  Test list_output\n");
+        fprintf(stderr, "    5  Test list_append_string\n");
+        fprintf(stderr, "    6  Test ten million node lists\n");
         return EXIT_FAILURE;
     }
 
@@ -218,6 +316,8 @@ int main(int argc, char *argv[]) {
         case 2:  status = test_02_list_append(); break;
         case 3:  status = test_03_list_filter(); break;
         case 4:  status = test_04_list_output(); break;
+        case 5:  status = test_05_list_append_string(); break;
+        case 6:  status = test_06_list_long(); break;
         default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
     }
 
@@ -0,0 +1,361 @@
+/* match.c: Compiled shell pattern matcher */
+
+#define _GNU_SOURCE     // memmem, FNM_CASEFOLD
+
+#include "findit.h"
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Element Structure */
+
+typedef struct {
+    bool        star;       // Element is *
+    uint64_t    set[4];     // Bytes accepted by element (256 bits)
+    int         byte;       // Single byte accepted, or -1 for a set
+} Element;
+
+/* Set Functions */
+
+static void set_add(uint64_t set[4], unsigned char c) {
+    set[c / 64] |= (uint64_t)1 << (c % 64);
+}
+
+static bool set_has(const uint64_t set[4], unsigned char c) {
+    return set[c / 64] & ((uint64_t)1 << (c % 64));
+}
+
+/**
+ * Replace set with every byte whose lower case form is in set, which is how
+ * fnmatch compares under FNM_CASEFOLD.
+ * @param   set         Set of bytes
+ **/
+static void set_fold(uint64_t set[4]) {
+    uint64_t folded[4] = {0};
+    for (int c = 0; c < 256; c++) {
+        if (set_has(set, tolower(c))) set_add(folded, c);
+    }
+    for (int i = 0; i < 4; i++) {
+        set[i] = folded[i];
+    }
+}
+
+/**
+ * Parse a bracket expression starting just after the opening '['.
+ * @param   p           Pointer to pattern position (advanced past ']')
+ * @param   set         Set of bytes to fill in
+ * @param   icase       Whether or not to ignore case
+ * @return  Whether or not the bracket expression is supported.
+ **/
+static bool parse_bracket(const char **p, uint64_t set[4], bool icase) {
+    const char *s = *p;
+    bool negate   = false;
+
+    if (*s == '!' || *s == '^') {
+        negate = true;
+        s++;
+    }
+
+    uint64_t accept[4]  = {0};   // Literal bytes and ranges
+    uint64_t classes[4] = {0};   // Character class members (never folded)
+    bool     first      = true;
+    while (*s && (first || *s != ']')) {
+        first = false;
+
+        if (s[0] == '[' && s[1] == ':') {
+            static const struct { const char *name; int (*test)(int); } Classes[] = {
+                {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank},
+                {"cntrl", iscntrl}, {"digit", isdigit}, {"graph", isgraph},
+                {"lower", islower}, {"print", isprint}, {"punct", ispunct},
+                {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit},
+                {NULL, NULL},
+            };
+            const char *end = strstr(s + 2, ":]");
+            if (!end) return false;
+
+            int (*test)(int) = NULL;
+            for (size_t i = 0; Classes[i].name; i++) {
+                if (strlen(Classes[i].name) == (size_t)(end - s - 2) &&
+                    !strncmp(Classes[i].name, s + 2, end - s - 2)) {
+                    test = Classes[i].test;
+                }
+            }
+            if (!test) return false;
+
+            for (int c = 0; c < 256; c++) {
+                if (test(c)) set_add(classes, c);
+            }
+            s = end + 2;
+            continue;
+        }
+
+        // Equivalence classes and collating symbols are left to fnmatch
+        if (s[0] == '[' && (s[1] == '=' || s[1] == '.')) return false;
+
+        if (*s == '\\' && s[1]) s++;
+        unsigned char lo = *s++;
+        unsigned char hi = lo;
+        if (s[0] == '-' && s[1] && s[1] != ']') {
+            s++;
+            if (*s == '\\' && s[1]) s++;
+            hi = *s++;
+        }
+        if (icase) {
+            lo = tolower(lo);
+            hi = tolower(hi);
+        }
+        for (int c = lo; c <= hi; c++) {
+            set_add(accept, c);
+        }
+    }
+
+    // Unterminated bracket is a literal '[' to fnmatch
+    if (*s != ']') return false;
+
+    // Fold case before negating, so [!a] rejects 'A' too
+    if (icase) set_fold(accept);
+
+    for (int i = 0; i < 4; i++) {
+        set[i] = negate ? ~(accept[i] | classes[i]) : (accept[i] | classes[i]);
+    }
+    *p = s + 1;
+    return true;
+}
+
+/**
+ * Split pattern into elements, collapsing runs of '*'.
+ * @param   pattern     Shell pattern
+ * @param   icase       Whether or not to ignore case
+ * @param   elements    Array with room for strlen(pattern) elements
+ * @param   n           Number of elements parsed
+ * @return  Whether or not every construct in pattern is supported.
+ **/
+static bool parse_pattern(const char *pattern, bool icase, Element *elements, size_t *n) {
+    *n = 0;
+    for (const char *p = pattern; *p; ) {
+        Element *e = &elements[*n];
+        memset(e, 0, sizeof(Element));
+        e->byte = -1;
+
+        if (*p == '*') {
+            while (*p == '*') p++;
+            e->star = true;
+        } else if (*p == '?') {
+            memset(e->set, 0xff, sizeof(e->set));
+            p++;
+        } else if (*p == '[') {
+            p++;
+            if (!parse_bracket(&p, e->set, icase)) return false;
+        } else {
+            if (*p == '\\') {
+                if (!p[1]) return false;
+                p++;
+            }
+            e->byte = (unsigned char)*p++;
+            set_add(e->set, icase ? tolower(e->byte) : e->byte);
+            if (icase) set_fold(e->set);
+        }
+        (*n)++;
+    }
+    return true;
+}
+
+/**
+ * Compare bytes, optionally ignoring case (literal is already lower case).
+ * @param   s           String bytes
+ * @param   literal     Literal bytes
+ * @param   n           Number of bytes
+ * @param   icase       Whether or not to ignore case
+ * @return  Whether or not the bytes are equal.
+ **/
+static bool match_bytes(const char *s, const char *literal, size_t n, bool icase) {
+    if (!icase) return !memcmp(s, literal, n);
+
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char)s[i]) != (unsigned char)literal[i]) return false;
+    }
+    return true;
+}
+
+/* Matcher Functions */
+
+/**
+ * Compile shell pattern into a Matcher:
+ *
+ *  - Patterns of literal bytes with '*' only at the ends become an exact,
+ *    prefix, suffix, or substring comparison.
+ *  - Other patterns become a bit-parallel automaton with one state per
+ *    element, stepping all states with one table lookup per byte.
+ *  - Anything else (or too long) falls back to fnmatch.
+ *
+ * @param   pattern     Shell pattern (as for fnmatch without flags)
+ * @param   icase       Whether or not to ignore case (-iname)
+ * @return  Pointer to new Matcher structure (must be deleted).
+ **/
+Matcher *   matcher_create(const char *pattern, bool icase) {
+    Matcher *m        = calloc(1, sizeof(Matcher));
+    size_t   length   = strlen(pattern);
+    Element *elements = calloc(length + 1, sizeof(Element));
+    if (!m || !elements || !(m->pattern = strdup(pattern))) {
+        free(elements);
+        free(m);
+        return NULL;
+    }
+    m->icase = icase;
+
+    size_t n;
+    if (!parse_pattern(pattern, icase, elements, &n)) {
+        m->type = MATCH_FNMATCH;
+        free(elements);
+        return m;
+    }
+
+    // Literal with optional leading and trailing stars
+    bool   leading  = n > 0 && elements[0].star;
+    bool   trailing = n > leading && elements[n - 1].star;
+    bool   literal  = true;
+    for (size_t i = leading; i < n - trailing; i++) {
+        literal = literal && elements[i].byte >= 0;
+    }
+
+    if (literal && (m->literal = malloc(n + 1))) {
+        for (size_t i = leading; i < n - trailing; i++) {
+            unsigned char c = elements[i].byte;
+            m->literal[m->length++] = icase ? tolower(c) : c;
+        }
+        m->literal[m->length] = 0;
+
+        if (leading && trailing) m->type = MATCH_SUBSTRING;
+        else if (leading)        m->type = MATCH_SUFFIX;
+        else if (trailing)       m->type = MATCH_PREFIX;
+        else                     m->type = MATCH_EXACT;
+        free(elements);
+        return m;
+    }
+
+    // Bit-parallel automaton: bit i set means i elements have been matched
+    m->type = MATCH_GLOB;
+    for (size_t i = 0; i < n; i++) {
+        Element *e = &elements[i];
+        if (e->star) {
+            m->star |= (uint64_t)1 << m->states;
+            continue;
+        }
+
+        if (++m->states > MATCH_MAX_STATES) {
+            m->type = MATCH_FNMATCH;
+            break;
+        }
+
+        for (int c = 0; c < 256; c++) {
+            if (set_has(e->set, c)) {
+                m->table[c] |= (uint64_t)1 << m->states;
+            }
+        }
+    }
+
+    free(elements);
+    return m;
+}
+
+/**
+ * Determine if string matches compiled pattern.
+ * @param   m           Pointer to Matcher structure
+ * @param   s           String bytes (need not be NUL-terminated)
+ * @param   n           Number of bytes
+ * @return  Whether or not the string matches.
+ **/
+bool        matcher_match(Matcher *m, const char *s, size_t n) {
+    switch (m->type) {
+        case MATCH_EXACT:
+            return n == m->length && match_bytes(s, m->literal, n, m->icase);
+        case MATCH_PREFIX:
+            return n >= m->length && match_bytes(s, m->literal, m->length, m->icase);
+        case MATCH_SUFFIX:
+            return n >= m->length && match_bytes(s + n - m->length, m->literal, m->length, m->icase);
+        case MATCH_SUBSTRING:
+            if (!m->icase) return memmem(s, n, m->literal, m->length) != NULL;
+            for (size_t i = 0; i + m->length <= n; i++) {
+                if (match_bytes(s + i, m->literal, m->length, true)) return true;
+            }
+            return false;
+        case MATCH_GLOB: {
+            uint64_t states = 1;
+            for (size_t i = 0; i < n && states; i++) {
+                states = ((states << 1) & m->table[(unsigned char)s[i]]) | (states & m->star);
+            }
+            return states & ((uint64_t)1 << m->states);
+        }
+        case MATCH_FNMATCH: {
+            int   flags = m->icase ? FNM_CASEFOLD : 0;
+            char *copy  = strndup(s, n);
+            bool  match = copy && !fnmatch(m->pattern, copy, flags);
+            free(copy);
+            return match;
+        }
+    }
+    return false;
+}
+
+/**
+ * Deallocate Matcher structure.
+ * @param   m           Pointer to Matcher structure
+ **/
+void        matcher_delete(Matcher *m) {
+    if (!m) return;
+    free(m->pattern);
+    free(m->literal);
+    free(m);
+}
+
+/* Search Functions */
+
+/**
+ * Find first occurrence of literal in bytes.  Sixteen positions at a time are
+ * tested for the literal's first and last byte, and only positions that have
+ * both are compared in full.
+ * @param   s           Bytes to search
+ * @param   n           Number of bytes
+ * @param   literal     Bytes to find
+ * @param   length      Length of literal
+ * @return  Pointer to first occurrence in s (NULL if there is none).
+ **/
+const char *match_search(const char *s, size_t n, const char *literal, size_t length) {
+    if (!length) return s;
+    if (length > n) return NULL;
+
+    unsigned char first = literal[0];
+    unsigned char last  = literal[length - 1];
+    size_t        i     = 0;
+
+#ifdef __SSE2__
+    __m128i vfirst = _mm_set1_epi8(first);
+    __m128i vlast  = _mm_set1_epi8(last);
+    for (; i + length - 1 + 16 <= n; i += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(s + i)), vfirst);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(s + i + length - 1)), vlast);
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(a, b));
+        while (mask) {
+            size_t j = i + __builtin_ctz(mask);
+            if (!memcmp(s + j + 1, literal + 1, length - 1)) return s + j;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i + length <= n; i++) {
+        if ((unsigned char)s[i] == first && (unsigned char)s[i + length - 1] == last &&
+            !memcmp(s + i + 1, literal + 1, length - 1)) {
+            return s + i;
+        }
+    }
+    return NULL;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
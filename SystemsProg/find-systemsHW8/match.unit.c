@@ -0,0 +1,174 @@
+/* match.unit.c: compiled pattern matcher unit test */
+
+#define _GNU_SOURCE     // FNM_CASEFOLD
+
+#include "findit.h"
+
+#include <assert.h>
+#include <fnmatch.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Functions */
+
+bool agrees(const char *pattern, const char *string, bool icase) {
+    Matcher *m = matcher_create(pattern, icase);
+    assert(m);
+    bool expected = !fnmatch(pattern, string, icase ? FNM_CASEFOLD : 0);
+    bool actual   = matcher_match(m, string, strlen(string));
+    matcher_delete(m);
+    if (expected != actual) {
+        fprintf(stderr, "pattern '%s' string '%s' icase %d: expected %d, got %d\n",
+            pattern, string, icase, expected, actual);
+    }
+    return expected == actual;
+}
+
+MatchType type_of(const char *pattern) {
+    Matcher *m = matcher_create(pattern, false);
+    assert(m);
+    MatchType type = m->type;
+    matcher_delete(m);
+    return type;
+}
+
+/* Tests */
+
+int test_00_matcher_create() {
+    // Test: literal fast paths
+    assert(type_of("Makefile")  == MATCH_EXACT);
+    assert(type_of("")          == MATCH_EXACT);
+    assert(type_of("\\*.c")     == MATCH_EXACT);
+    assert(type_of("list*")     == MATCH_PREFIX);
+    assert(type_of("*.c")       == MATCH_SUFFIX);
+    assert(type_of("**.c")      == MATCH_SUFFIX);
+    assert(type_of("*")         == MATCH_SUFFIX);
+    assert(type_of("*unit*")    == MATCH_SUBSTRING);
+
+    // Test: automaton
+    assert(type_of("*.[ch]")    == MATCH_GLOB);
+    assert(type_of("f?lter.c")  == MATCH_GLOB);
+    assert(type_of("a*b*c")     == MATCH_GLOB);
+
+    // Test: fallback
+    assert(type_of("[abc")      == MATCH_FNMATCH);
+    assert(type_of("[[=a=]]")   == MATCH_FNMATCH);
+    assert(type_of("abc\\")     == MATCH_FNMATCH);
+
+    char *longest = calloc(MATCH_MAX_STATES + 2, 1);
+    memset(longest, '?', MATCH_MAX_STATES + 1);
+    assert(type_of(longest)     == MATCH_FNMATCH);
+    longest[MATCH_MAX_STATES] = 0;
+    assert(type_of(longest)     == MATCH_GLOB);
+    free(longest);
+
+    // Test: matching does not need NUL-terminated names
+    Matcher *m = matcher_create("*.c", false);
+    assert(matcher_match(m, "filter.c/", 8));
+    assert(!matcher_match(m, "filter.c/", 9));
+    matcher_delete(m);
+    return EXIT_SUCCESS;
+}
+
+int test_01_matcher_match() {
+    const char *patterns[] = {
+        "Makefile", "*.c", "*.C", "list*", "*unit*", "*.[ch]", "*.[!ch]",
+        "f?lter.c", "*[[:digit:]]*", "[[:upper:]]*", "a*b*c", "*a*a*a",
+        "[]]*", "[!]]*", "[a-c]*", "[^a-c]*", "\\[*", "*\\?", "?", "",
+        "*", "*[-]", "[a\\]]", "*.unit.c", NULL,
+    };
+    const char *strings[] = {
+        "Makefile", "makefile", "filter.c", "FILTER.C", "findit.h", "list.o",
+        "list.unit.c", "a", "abc", "aXbYc", "aaa", "abca", "]x", "x]", "[x",
+        "x?", "x", "", "-", "9lives", "Upper", "a]", "b", NULL,
+    };
+
+    for (const char **p = patterns; *p; p++) {
+        for (const char **s = strings; *s; s++) {
+            assert(agrees(*p, *s, false));
+            assert(agrees(*p, *s, true));
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int test_02_matcher_random() {
+    const char pattern_bytes[] = "aAb*?[]!^-\\.";
+    const char string_bytes[]  = "aAb]-.!";
+    char pattern[16];
+    char string[16];
+
+    // Test: random patterns agree with fnmatch
+    srand(20289);
+    for (int i = 0; i < 200000; i++) {
+        int plen = rand() % 10;
+        int slen = rand() % 10;
+        for (int j = 0; j < plen; j++) {
+            pattern[j] = pattern_bytes[rand() % (sizeof(pattern_bytes) - 1)];
+        }
+        for (int j = 0; j < slen; j++) {
+            string[j] = string_bytes[rand() % (sizeof(string_bytes) - 1)];
+        }
+        pattern[plen] = 0;
+        string[slen]  = 0;
+        assert(agrees(pattern, string, i % 2));
+    }
+    return EXIT_SUCCESS;
+}
+
+int test_03_match_search() {
+    char haystack[256];
+    char needle[40];
+
+    // Test: edge cases
+    const char *abc = "abc";
+    assert(match_search(abc, 3, "", 0) == abc);
+    assert(match_search(abc, 3, "bc", 2) == abc + 1);
+    assert(!match_search(abc, 2, "abc", 3));
+    assert(!match_search("", 0, "a", 1));
+
+    // Test: random haystacks and needles agree with memmem, at every offset
+    // and length around the sixteen byte blocks
+    srand(20289);
+    for (int i = 0; i < 200000; i++) {
+        size_t hlen = rand() % sizeof(haystack);
+        size_t nlen = 1 + rand() % (i % 4 ? 3 : sizeof(needle));
+        for (size_t j = 0; j < hlen; j++) haystack[j] = "ab\0c"[rand() % 4];
+        for (size_t j = 0; j < nlen; j++) needle[j]   = "ab\0c"[rand() % 4];
+
+        const char *expected = memmem(haystack, hlen, needle, nlen);
+        assert(match_search(haystack, hlen, needle, nlen) == expected);
+    }
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test matcher_create\n");
+        fprintf(stderr, "    1  Test matcher_match\n");
+        fprintf(stderr, "    2  Test matcher_match with random patterns\n");
+        fprintf(stderr, "    3  Test match_search\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_matcher_create(); break;
+        case 1:  status = test_01_matcher_match(); break;
+        case 2:  status = test_02_matcher_random(); break;
+        case 3:  status = test_03_match_search(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
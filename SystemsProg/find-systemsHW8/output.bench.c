@@ -0,0 +1,122 @@
+/* output.bench.c: result output benchmark */
+
+#define _GNU_SOURCE     // fputs_unlocked
+
+#include "findit.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+/* Functions */
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Reader thread that drains a pipe, standing in for a downstream tool.
+ * @param   arg         Pointer to read end of pipe
+ * @return  NULL
+ **/
+void *drain(void *arg) {
+    char buffer[1 << 16];
+    while (read(*(int *)arg, buffer, sizeof(buffer)) > 0);
+    return NULL;
+}
+
+/**
+ * Emit count synthetic paths to fd with the given method.
+ * @param   method      0 fprintf, 1 fputs_unlocked, 2 Output
+ * @param   fd          File descriptor to write to
+ * @param   paths       Array of paths
+ * @param   lengths     Array of path lengths
+ * @param   count       Number of paths
+ **/
+void emit(int method, int fd, char **paths, size_t *lengths, size_t count) {
+    if (method < 2) {
+        FILE *stream = fdopen(dup(fd), "w");
+        for (size_t i = 0; i < count; i++) {
+            if (method == 0) {
+                fprintf(stream, "%s\n", paths[i]);
+            } else {
+                fputs_unlocked(paths[i], stream);
+                putc_unlocked('\n', stream);
+            }
+        }
+        fclose(stream);
+    } else {
+        Output o;
+        output_open(&o, fd, 0, '\n');
+        for (size_t i = 0; i < count; i++) {
+            output_write(&o, paths[i], lengths[i]);
+        }
+        output_close(&o);
+    }
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    size_t count   = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+    size_t distinct = 1 << 16;
+
+    // A repeating set of realistic paths keeps memory use small
+    char  **paths   = calloc(distinct, sizeof(char *));
+    size_t *lengths = calloc(distinct, sizeof(size_t));
+    for (size_t i = 0; i < distinct; i++) {
+        char path[BUFSIZ];
+        lengths[i] = snprintf(path, BUFSIZ, "/usr/lib/x86_64-linux-gnu/dir%03zu/sub%02zu/file%06zu.so", i % 997, i % 31, i);
+        paths[i]   = strdup(path);
+    }
+
+    static const char *Methods[] = {"fprintf", "fputs_unlocked", "output"};
+    printf("method\tsink\tpaths\tns/path\n");
+
+    for (int sink = 0; sink < 2; sink++) {
+        for (int method = 0; method < 3; method++) {
+            int       fd;
+            int       fds[2];
+            pthread_t reader;
+
+            if (sink == 0) {
+                fd = open("/dev/null", O_WRONLY);
+            } else {
+                if (pipe(fds) < 0) return EXIT_FAILURE;
+                pthread_create(&reader, NULL, drain, &fds[0]);
+                fd = fds[1];
+            }
+
+            double start = now();
+            for (size_t done = 0; done < count; done += distinct) {
+                size_t n = count - done < distinct ? count - done : distinct;
+                emit(method, fd, paths, lengths, n);
+            }
+            double elapsed = now() - start;
+            close(fd);
+
+            if (sink == 1) {
+                pthread_join(reader, NULL);
+                close(fds[0]);
+            }
+
+            printf("%s\t%s\t%zu\t%.1f\n", Methods[method], sink ? "pipe" : "null", count, elapsed * 1e9 / count);
+        }
+    }
+
+    for (size_t i = 0; i < distinct; i++) {
+        free(paths[i]);
+    }
+    free(paths);
+    free(lengths);
+    return EXIT_SUCCESS;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,129 @@
+/* output.c: Buffered result output functions */
+
+#include "findit.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* Functions */
+
+/**
+ * Write every byte described by iov, retrying short and interrupted writes.
+ * @param   fd          File descriptor to write to
+ * @param   iov         Array of buffers (modified)
+ * @param   n           Number of buffers
+ * @return  Whether or not everything was written.
+ **/
+static bool output_writev(int fd, struct iovec *iov, int n) {
+    while (n > 0) {
+        ssize_t written = writev(fd, iov, n);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        // Skip buffers written in full, then trim the partially written one
+        while (n > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base  = (char *)iov->iov_base + written;
+            iov->iov_len  -= written;
+        }
+    }
+    return true;
+}
+
+/* Output Functions */
+
+/**
+ * Initialize output stage on file descriptor.  Paths written to a terminal
+ * are flushed one by one, so they show up as they are found; pipes and files
+ * are written a full buffer at a time.
+ * @param   o           Pointer to Output structure
+ * @param   fd          File descriptor to write to (not owned)
+ * @param   size        Size of buffer (0 for OUTPUT_BUFSIZE)
+ * @param   delimiter   Byte written after each path ('\n' or 0 for -print0)
+ * @return  Whether or not the buffer could be allocated.
+ **/
+bool    output_open(Output *o, int fd, size_t size, char delimiter) {
+    memset(o, 0, sizeof(Output));
+    o->fd        = fd;
+    o->size      = size ? size : OUTPUT_BUFSIZE;
+    o->delimiter = delimiter;
+    o->line      = isatty(fd);
+    o->buffer    = malloc(o->size);
+    return o->buffer != NULL;
+}
+
+/**
+ * Append path and delimiter to output buffer.  When they do not fit, the
+ * buffer, path, and delimiter leave in a single writev, so long paths are
+ * never copied.
+ * @param   o           Pointer to Output structure
+ * @param   s           Path bytes
+ * @param   n           Number of bytes
+ * @return  Whether or not the output is still healthy.
+ **/
+bool    output_write(Output *o, const char *s, size_t n) {
+    if (o->failed) return false;
+
+    if (n < o->size - o->length) {
+        memcpy(o->buffer + o->length, s, n);
+        o->buffer[o->length + n] = o->delimiter;
+        o->length += n + 1;
+        return o->line ? output_flush(o) : true;
+    }
+
+    struct iovec iov[] = {
+        {o->buffer,             o->length},
+        {(void *)s,             n},
+        {&o->delimiter,         1},
+    };
+    o->length = 0;
+    o->failed = !output_writev(o->fd, iov, 3);
+    return !o->failed;
+}
+
+/**
+ * Write out everything buffered so far.
+ * @param   o           Pointer to Output structure
+ * @return  Whether or not everything written so far reached the descriptor.
+ **/
+bool    output_flush(Output *o) {
+    if (!o->failed && o->length) {
+        struct iovec iov = {o->buffer, o->length};
+        o->failed = !output_writev(o->fd, &iov, 1);
+    }
+    o->length = 0;
+    return !o->failed;
+}
+
+/**
+ * Flush and release output stage.
+ * @param   o           Pointer to Output structure
+ * @return  Whether or not all output was written.
+ **/
+bool    output_close(Output *o) {
+    bool flushed = output_flush(o);
+    free(o->buffer);
+    o->buffer = NULL;
+    return flushed;
+}
+
+/**
+ * Visitor that sends the entry's path to an output stage.
+ * @param   e           Pointer to Entry structure
+ * @param   arg         Pointer to Output structure
+ **/
+void    output_entry(Entry *e, void *arg) {
+    output_write((Output *)arg, e->path, e->length);
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
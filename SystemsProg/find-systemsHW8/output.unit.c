@@ -0,0 +1,175 @@
+/* output.unit.c: buffered output unit test */
+
+#define _GNU_SOURCE     // posix_openpt
+
+#include "findit.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+/* Functions */
+
+/**
+ * Read everything available from file descriptor.
+ * @param   fd          File descriptor to read from
+ * @param   buffer      Buffer to read into
+ * @param   size        Size of buffer
+ * @return  Number of bytes read.
+ **/
+size_t read_all(int fd, char *buffer, size_t size) {
+    size_t length = 0;
+    ssize_t n;
+    while (length < size && (n = read(fd, buffer + length, size - length)) > 0) {
+        length += n;
+    }
+    return length;
+}
+
+/* Tests */
+
+int test_00_output_write() {
+    int fds[2];
+    assert(pipe(fds) == 0);
+
+    // Test: paths are buffered until flushed
+    Output o;
+    assert(output_open(&o, fds[1], 64, '\n'));
+    assert(output_write(&o, "findit.c", 8));
+    assert(output_write(&o, "list.c/", 6));
+    assert(o.length == 9 + 7);
+    assert(output_close(&o));
+    close(fds[1]);
+
+    char buffer[BUFSIZ];
+    size_t n = read_all(fds[0], buffer, BUFSIZ);
+    assert(n == 16 && !memcmp(buffer, "findit.c\nlist.c\n", 16));
+    close(fds[0]);
+
+    // Test: NUL delimiter
+    assert(pipe(fds) == 0);
+    assert(output_open(&o, fds[1], 0, 0));
+    assert(output_write(&o, "a b", 3));
+    assert(output_write(&o, "c\nd", 3));
+    assert(output_close(&o));
+    close(fds[1]);
+
+    n = read_all(fds[0], buffer, BUFSIZ);
+    assert(n == 8 && !memcmp(buffer, "a b\0c\nd\0", 8));
+    close(fds[0]);
+    return EXIT_SUCCESS;
+}
+
+int test_01_output_long() {
+    FILE *stream = tmpfile();
+    assert(stream);
+
+    // Test: paths longer than the buffer keep their order
+    char *path = malloc(1000);
+    memset(path, 'x', 1000);
+
+    Output o;
+    assert(output_open(&o, fileno(stream), 16, '\n'));
+    for (size_t i = 0; i < 100; i++) {
+        size_t n = i % 3 ? i % 17 : 1000;
+        assert(output_write(&o, path, n));
+    }
+    assert(output_close(&o));
+
+    rewind(stream);
+    char line[BUFSIZ];
+    for (size_t i = 0; i < 100; i++) {
+        size_t n = i % 3 ? i % 17 : 1000;
+        assert(fgets(line, BUFSIZ, stream));
+        assert(strlen(line) == n + 1 && line[n] == '\n');
+        assert(!memcmp(line, path, n));
+    }
+    assert(!fgets(line, BUFSIZ, stream));
+
+    free(path);
+    fclose(stream);
+    return EXIT_SUCCESS;
+}
+
+int test_02_output_failed() {
+    int fds[2];
+    assert(pipe(fds) == 0);
+    close(fds[0]);
+    close(fds[1]);
+
+    // Test: write errors are remembered and reported
+    Output o;
+    assert(output_open(&o, fds[1], 16, '\n'));
+    assert(output_write(&o, "short", 5));
+    assert(!output_write(&o, "longer than the buffer", 22));
+    assert(!output_write(&o, "short", 5));
+    assert(!output_close(&o));
+    return EXIT_SUCCESS;
+}
+
+int test_03_output_terminal() {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    assert(master >= 0 && grantpt(master) == 0 && unlockpt(master) == 0);
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    assert(slave >= 0);
+
+    // Test: paths written to a terminal are not held back in the buffer
+    Output o;
+    assert(output_open(&o, slave, 0, '\n'));
+    assert(o.line);
+    assert(output_write(&o, "findit.c", 8));
+    assert(o.length == 0);
+
+    char buffer[BUFSIZ];
+    ssize_t n = read(master, buffer, BUFSIZ);
+    assert(n >= 8 && !memcmp(buffer, "findit.c", 8));
+    assert(output_close(&o));
+    close(slave);
+    close(master);
+
+    // Test: pipes keep the full buffer
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(output_open(&o, fds[1], 0, '\n'));
+    assert(!o.line);
+    assert(output_write(&o, "findit.c", 8));
+    assert(o.length == 9);
+    assert(output_close(&o));
+    close(fds[0]);
+    close(fds[1]);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test output_write\n");
+        fprintf(stderr, "    1  Test output_write with long paths\n");
+        fprintf(stderr, "    2  Test output_write failures\n");
+        fprintf(stderr, "    3  Test output_write to a terminal\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_output_write(); break;
+        case 1:  status = test_01_output_long(); break;
+        case 2:  status = test_02_output_failed(); break;
+        case 3:  status = test_03_output_terminal(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,59 @@
+/* path.c: Growable path buffer functions */
+
+#include "findit.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Path Functions */
+
+/**
+ * Initialize Path structure with a copy of string.
+ * @param   p           Pointer to Path structure
+ * @param   s           Initial path string
+ * @return  Whether or not the path could be allocated.
+ **/
+bool    path_init(Path *p, const char *s) {
+    p->length   = strlen(s);
+    p->capacity = p->length + 1 > PATH_CAPACITY ? p->length + 1 : PATH_CAPACITY;
+    p->data     = malloc(p->capacity);
+    if (!p->data) return false;
+    memcpy(p->data, s, p->length + 1);
+    return true;
+}
+
+/**
+ * Append "/name" to path, growing it as needed.
+ * @param   p           Pointer to Path structure
+ * @param   name        Component to append
+ * @return  Whether or not the component was appended.
+ **/
+bool    path_push(Path *p, const char *name) {
+    size_t n = strlen(name);
+    size_t needed = p->length + 1 + n + 1;
+
+    if (needed > p->capacity) {
+        size_t capacity = 2 * p->capacity > needed ? 2 * p->capacity : needed;
+        char  *data     = realloc(p->data, capacity);
+        if (!data) return false;
+        p->data     = data;
+        p->capacity = capacity;
+    }
+
+    p->data[p->length] = '/';
+    memcpy(p->data + p->length + 1, name, n + 1);
+    p->length += 1 + n;
+    return true;
+}
+
+/**
+ * Truncate path back to specified length.
+ * @param   p           Pointer to Path structure
+ * @param   length      Length to truncate to
+ **/
+void    path_pop(Path *p, size_t length) {
+    p->length = length;
+    p->data[length] = 0;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,214 @@
+/* ring.c: Batched statx through io_uring */
+
+#define _GNU_SOURCE     // struct statx
+
+#include "findit.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+/* Functions */
+
+/**
+ * Return pointer to field at offset within mapping.
+ * @param   map         Start of mapping
+ * @param   offset      Offset reported by io_uring_setup
+ * @return  Pointer to field.
+ **/
+static unsigned *ring_field(void *map, unsigned offset) {
+    return (unsigned *)((char *)map + offset);
+}
+
+/**
+ * Convert statx result into a stat structure.
+ * @param   x           Pointer to statx structure
+ * @param   s           Pointer to stat structure to fill in
+ **/
+static void ring_convert(const struct statx *x, struct stat *s) {
+    memset(s, 0, sizeof(struct stat));
+    s->st_dev          = makedev(x->stx_dev_major, x->stx_dev_minor);
+    s->st_ino          = x->stx_ino;
+    s->st_mode         = x->stx_mode;
+    s->st_nlink        = x->stx_nlink;
+    s->st_uid          = x->stx_uid;
+    s->st_gid          = x->stx_gid;
+    s->st_rdev         = makedev(x->stx_rdev_major, x->stx_rdev_minor);
+    s->st_size         = x->stx_size;
+    s->st_blksize      = x->stx_blksize;
+    s->st_blocks       = x->stx_blocks;
+    s->st_atim.tv_sec  = x->stx_atime.tv_sec;
+    s->st_atim.tv_nsec = x->stx_atime.tv_nsec;
+    s->st_mtim.tv_sec  = x->stx_mtime.tv_sec;
+    s->st_mtim.tv_nsec = x->stx_mtime.tv_nsec;
+    s->st_ctim.tv_sec  = x->stx_ctime.tv_sec;
+    s->st_ctim.tv_nsec = x->stx_ctime.tv_nsec;
+}
+
+/* Ring Functions */
+
+/**
+ * Set up io_uring instance with room for entries operations in flight.
+ * @param   r           Pointer to Ring structure
+ * @param   entries     Number of submission queue entries
+ * @return  Whether or not io_uring is available (r->fd is -1 if not).
+ **/
+bool    ring_open(Ring *r, unsigned entries) {
+    struct io_uring_params p;
+
+    memset(r, 0, sizeof(Ring));
+    memset(&p, 0, sizeof(p));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) {
+        r->fd = -1;
+        return false;
+    }
+
+    // Kernels with a single mapping for both rings report it in features
+    r->entries = p.sq_entries;
+    r->sqsize  = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqsize  = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->sqsize = r->cqsize = r->sqsize > r->cqsize ? r->sqsize : r->cqsize;
+    }
+    r->sqesize = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq = mmap(NULL, r->sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq == MAP_FAILED) {
+        r->sq = NULL;
+        goto failure;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq = r->sq;
+    } else {
+        r->cq = mmap(NULL, r->cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq == MAP_FAILED) {
+            r->cq = NULL;
+            goto failure;
+        }
+    }
+    r->sqes = mmap(NULL, r->sqesize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        goto failure;
+    }
+    r->buffers = calloc(r->entries, sizeof(struct statx));
+    if (!r->buffers) goto failure;
+
+    r->sqhead  = ring_field(r->sq, p.sq_off.head);
+    r->sqtail  = ring_field(r->sq, p.sq_off.tail);
+    r->sqmask  = ring_field(r->sq, p.sq_off.ring_mask);
+    r->sqarray = ring_field(r->sq, p.sq_off.array);
+    r->cqhead  = ring_field(r->cq, p.cq_off.head);
+    r->cqtail  = ring_field(r->cq, p.cq_off.tail);
+    r->cqmask  = ring_field(r->cq, p.cq_off.ring_mask);
+    r->cqes    = (struct io_uring_cqe *)((char *)r->cq + p.cq_off.cqes);
+    return true;
+
+failure:
+    ring_close(r);
+    return false;
+}
+
+/**
+ * Stat n names relative to dirfd with every request in flight at once,
+ * consuming completions in whatever order they arrive.  Batches larger than
+ * the ring are split.  Names whose statx fails (or that could not be
+ * submitted) are left for the caller to stat synchronously; if the ring itself
+ * fails, it is closed and every later call leaves everything to the caller.
+ * @param   r           Pointer to Ring structure
+ * @param   dirfd       Directory that names are relative to
+ * @param   names       Names to stat
+ * @param   n           Number of names
+ * @param   flags       statx flags (AT_SYMLINK_NOFOLLOW to lstat)
+ * @param   sts         Set to stat of each name that succeeded
+ * @param   ok          Set to whether or not each name succeeded
+ * @return  Number of names that succeeded.
+ **/
+size_t  ring_stat(Ring *r, int dirfd, const char **names, size_t n, int flags, struct stat *sts, bool *ok) {
+    size_t count = 0;
+
+    memset(ok, 0, n * sizeof(bool));
+    if (r->fd < 0) return 0;
+
+    for (size_t start = 0; start < n; start += r->entries) {
+        size_t   batch = n - start < r->entries ? n - start : r->entries;
+        unsigned tail  = *r->sqtail;
+
+        for (size_t i = 0; i < batch; i++) {
+            unsigned             index = (tail + i) & *r->sqmask;
+            struct io_uring_sqe *sqe   = &r->sqes[index];
+
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode      = IORING_OP_STATX;
+            sqe->fd          = dirfd;
+            sqe->addr        = (uintptr_t)names[start + i];
+            sqe->len         = STATX_BASIC_STATS;
+            sqe->statx_flags = flags;
+            sqe->off         = (uintptr_t)&r->buffers[i];
+            sqe->user_data   = i;
+            r->sqarray[index] = index;
+        }
+        __atomic_store_n(r->sqtail, tail + batch, __ATOMIC_RELEASE);
+
+        // Submit everything, then reap completions until all have arrived
+        size_t submit = batch;
+        size_t done   = 0;
+        while (done < batch) {
+            int result = syscall(__NR_io_uring_enter, r->fd, submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+            if (result < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY) continue;
+
+                // Ring is in an unknown state, so later batches go synchronous.
+                // Requests still in flight may yet write their buffers, which
+                // the kernel only stops doing some time after the ring is
+                // closed, so those buffers are left allocated
+                if (done < batch - submit) {
+                    r->buffers = NULL;
+                }
+                ring_close(r);
+                return count;
+            }
+            submit -= (size_t)result < submit ? (size_t)result : submit;
+
+            unsigned head = *r->cqhead;
+            unsigned last = __atomic_load_n(r->cqtail, __ATOMIC_ACQUIRE);
+            for (; head != last; head++, done++) {
+                struct io_uring_cqe *cqe = &r->cqes[head & *r->cqmask];
+                size_t               i   = cqe->user_data;
+                if (cqe->res == 0) {
+                    ring_convert(&r->buffers[i], &sts[start + i]);
+                    ok[start + i] = true;
+                    count++;
+                }
+            }
+            __atomic_store_n(r->cqhead, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Tear down io_uring instance: the ring goes first, and only then the
+ * buffers its requests write into.
+ * @param   r           Pointer to Ring structure
+ **/
+void    ring_close(Ring *r) {
+    if (r->fd >= 0) close(r->fd);
+    if (r->sqes) munmap(r->sqes, r->sqesize);
+    if (r->cq && r->cq != r->sq) munmap(r->cq, r->cqsize);
+    if (r->sq) munmap(r->sq, r->sqsize);
+    free(r->buffers);
+    memset(r, 0, sizeof(Ring));
+    r->fd = -1;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,137 @@
+/* ring.unit.c: batched statx unit test */
+
+#include "findit.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define nargs(a)    (sizeof(a) / sizeof((a)[0]))
+
+#define NAMES       200
+
+/* Functions */
+
+/**
+ * Determine if two stat structures describe the same file the same way.
+ * @param   a           Pointer to stat structure
+ * @param   b           Pointer to stat structure
+ * @return  Whether or not the fields findit uses agree.
+ **/
+bool same_stat(const struct stat *a, const struct stat *b) {
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino &&
+           a->st_mode == b->st_mode && a->st_nlink == b->st_nlink &&
+           a->st_uid == b->st_uid && a->st_gid == b->st_gid &&
+           a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+/* Tests */
+
+int test_00_ring_stat() {
+    char root[] = "/tmp/ring.unit.XXXXXX";
+    char path[BUFSIZ];
+    assert(mkdtemp(root));
+    int dirfd = open(root, O_RDONLY | O_DIRECTORY);
+    assert(dirfd >= 0);
+
+    // Fixture: files of different sizes, a directory, and two links
+    char        buffers[NAMES][16];
+    const char *names[NAMES + 3];
+    for (int i = 0; i < NAMES; i++) {
+        snprintf(buffers[i], sizeof(buffers[i]), "file%d", i);
+        int fd = openat(dirfd, buffers[i], O_CREAT | O_WRONLY, 0644);
+        assert(fd >= 0 && ftruncate(fd, i) == 0);
+        close(fd);
+        names[i] = buffers[i];
+    }
+    assert(mkdirat(dirfd, "dir", 0755) == 0);
+    assert(symlinkat("dir", dirfd, "link") == 0);
+    names[NAMES]     = "link";
+    names[NAMES + 1] = "missing";
+    names[NAMES + 2] = "dir";
+
+    Ring ring;
+    if (!ring_open(&ring, 8)) {
+        fprintf(stderr, "io_uring unavailable, only testing fallback\n");
+    }
+
+    // Test: batches larger than the ring agree with fstatat, with and
+    // without following links, and missing names are left to the caller
+    struct stat sts[nargs(names)];
+    bool        ok[nargs(names)];
+    for (int follow = 0; follow < 2 && ring.fd >= 0; follow++) {
+        int flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+        assert(ring_stat(&ring, dirfd, names, nargs(names), flags, sts, ok) == nargs(names) - 1);
+        for (size_t i = 0; i < nargs(names); i++) {
+            struct stat expected;
+            if (fstatat(dirfd, names[i], &expected, flags) < 0) {
+                assert(!ok[i]);
+                continue;
+            }
+            assert(ok[i] && same_stat(&sts[i], &expected));
+        }
+        assert(S_ISLNK(sts[NAMES].st_mode) == !follow);
+    }
+
+    // Test: empty batch
+    assert(ring_stat(&ring, dirfd, names, 0, 0, sts, ok) == 0);
+    ring_close(&ring);
+    assert(ring.fd < 0);
+
+    close(dirfd);
+    snprintf(path, BUFSIZ, "rm -fr %s", root);
+    assert(system(path) == 0);
+    return EXIT_SUCCESS;
+}
+
+int test_01_ring_fallback() {
+    const char *names[] = {".", "..", "/"};
+    struct stat sts[nargs(names)];
+    bool        ok[nargs(names)] = {true, true, true};
+
+    // Test: an unavailable ring stats nothing and can be closed again
+    Ring ring = {.fd = -1};
+    assert(ring_stat(&ring, AT_FDCWD, names, nargs(names), 0, sts, ok) == 0);
+    assert(!ok[0] && !ok[1] && !ok[2]);
+    ring_close(&ring);
+    ring_close(&ring);
+
+    // Test: invalid setup fails cleanly
+    assert(!ring_open(&ring, 0) && ring.fd < 0);
+    assert(ring_stat(&ring, AT_FDCWD, names, nargs(names), 0, sts, ok) == 0);
+    ring_close(&ring);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test ring_stat\n");
+        fprintf(stderr, "    1  Test ring fallback\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_ring_stat(); break;
+        case 1:  status = test_01_ring_fallback(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
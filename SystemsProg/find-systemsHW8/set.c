@@ -0,0 +1,135 @@
+/* set.c: Set of (device, inode) pairs */
+
+#include "findit.h"
+
+#include <stdlib.h>
+
+/* Functions */
+
+/**
+ * Hash (device, inode) pair.
+ * @param   dev         Device
+ * @param   ino         Inode number
+ * @return  Well mixed 64-bit hash.
+ **/
+static uint64_t set_hash(uint64_t dev, uint64_t ino) {
+    uint64_t h = ino ^ (dev * 0x9e3779b97f4a7c15ULL);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * Find slot holding key, or the empty slot where it belongs.
+ * @param   slots       Table of slots
+ * @param   capacity    Number of slots (power of two, never full)
+ * @param   dev         Device
+ * @param   ino         Inode number
+ * @return  Pointer to slot.
+ **/
+static SetKey *set_slot(SetKey *slots, size_t capacity, uint64_t dev, uint64_t ino) {
+    size_t i = set_hash(dev, ino) & (capacity - 1);
+    while (slots[i].ino && (slots[i].ino != ino || slots[i].dev != dev)) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &slots[i];
+}
+
+/**
+ * Double capacity of table, rehashing every key.
+ * @param   s           Pointer to Set structure (locked)
+ * @return  Whether or not the table grew.
+ **/
+static bool set_grow(Set *s) {
+    size_t  capacity = 2 * s->capacity;
+    SetKey *slots    = calloc(capacity, sizeof(SetKey));
+    if (!slots) return false;
+
+    for (size_t i = 0; i < s->capacity; i++) {
+        if (s->slots[i].ino) {
+            *set_slot(slots, capacity, s->slots[i].dev, s->slots[i].ino) = s->slots[i];
+        }
+    }
+
+    free(s->slots);
+    s->slots    = slots;
+    s->capacity = capacity;
+    return true;
+}
+
+/* Set Functions */
+
+/**
+ * Initialize empty Set structure.
+ * @param   s           Pointer to Set structure
+ * @return  Whether or not the table could be allocated.
+ **/
+bool    set_init(Set *s) {
+    s->slots    = calloc(SET_CAPACITY, sizeof(SetKey));
+    s->capacity = SET_CAPACITY;
+    s->count    = 0;
+    if (!s->slots) return false;
+    pthread_mutex_init(&s->lock, NULL);
+    return true;
+}
+
+/**
+ * Add (device, inode) pair to set, growing the table once it is half full.
+ * If the pair cannot be stored (inode 0, or no memory to grow a nearly full
+ * table), it is reported as already present, so callers that double check
+ * hits stay correct.
+ * @param   s           Pointer to Set structure
+ * @param   dev         Device
+ * @param   ino         Inode number
+ * @return  true if the pair was added, false if it was (or may be) present.
+ **/
+bool    set_insert(Set *s, dev_t dev, ino_t ino) {
+    if (!ino) return false;
+
+    pthread_mutex_lock(&s->lock);
+    if (2 * (s->count + 1) > s->capacity && !set_grow(s) && s->count + 1 == s->capacity) {
+        pthread_mutex_unlock(&s->lock);
+        return false;
+    }
+
+    SetKey *slot  = set_slot(s->slots, s->capacity, dev, ino);
+    bool    added = !slot->ino;
+    if (added) {
+        slot->dev = dev;
+        slot->ino = ino;
+        s->count++;
+    }
+    pthread_mutex_unlock(&s->lock);
+    return added;
+}
+
+/**
+ * Determine if (device, inode) pair is in set.
+ * @param   s           Pointer to Set structure
+ * @param   dev         Device
+ * @param   ino         Inode number
+ * @return  Whether or not the pair is present.
+ **/
+bool    set_contains(Set *s, dev_t dev, ino_t ino) {
+    if (!ino) return false;
+
+    pthread_mutex_lock(&s->lock);
+    bool found = set_slot(s->slots, s->capacity, dev, ino)->ino != 0;
+    pthread_mutex_unlock(&s->lock);
+    return found;
+}
+
+/**
+ * Release table and lock of Set structure.
+ * @param   s           Pointer to Set structure
+ **/
+void    set_destroy(Set *s) {
+    pthread_mutex_destroy(&s->lock);
+    free(s->slots);
+    s->slots    = NULL;
+    s->capacity = 0;
+    s->count    = 0;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
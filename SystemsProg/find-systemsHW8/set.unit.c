@@ -0,0 +1,124 @@
+/* set.unit.c: (device, inode) set unit test */
+
+#include "findit.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+/* Macros */
+
+#define THREADS     4
+#define KEYS        100000
+
+/* Globals */
+
+Set             Shared;
+size_t          Added[THREADS];
+
+/* Functions */
+
+/**
+ * Thread that inserts every key, counting the ones it added first.
+ * @param   arg         Index into Added
+ * @return  NULL
+ **/
+void *insert_keys(void *arg) {
+    size_t id = (size_t)arg;
+    for (size_t i = 1; i <= KEYS; i++) {
+        if (set_insert(&Shared, i % 7, i)) {
+            Added[id]++;
+        }
+    }
+    return NULL;
+}
+
+/* Tests */
+
+int test_00_set_insert() {
+    Set s;
+    assert(set_init(&s));
+    assert(s.capacity == SET_CAPACITY && s.count == 0);
+
+    // Test: first insert adds, second reports presence
+    assert(set_insert(&s, 1, 42));
+    assert(!set_insert(&s, 1, 42));
+    assert(set_contains(&s, 1, 42));
+
+    // Test: same inode on another device is a different key
+    assert(!set_contains(&s, 2, 42));
+    assert(set_insert(&s, 2, 42));
+    assert(s.count == 2);
+
+    // Test: inode 0 is never stored, but reported as present
+    assert(!set_insert(&s, 1, 0));
+    assert(!set_contains(&s, 1, 0));
+
+    // Test: table grows and keeps every key
+    size_t count = 1000000;
+    for (size_t i = 1; i <= count; i++) {
+        assert(set_insert(&s, 3, i));
+    }
+    assert(s.count == count + 2);
+    assert(s.capacity >= 2 * s.count);
+    for (size_t i = 1; i <= count; i++) {
+        assert(set_contains(&s, 3, i));
+        assert(!set_insert(&s, 3, i));
+    }
+    assert(!set_contains(&s, 3, count + 1));
+
+    set_destroy(&s);
+    assert(!s.slots && !s.count);
+    return EXIT_SUCCESS;
+}
+
+int test_01_set_threads() {
+    assert(set_init(&Shared));
+
+    // Test: concurrent inserts add each key exactly once
+    pthread_t threads[THREADS];
+    for (size_t i = 0; i < THREADS; i++) {
+        assert(pthread_create(&threads[i], NULL, insert_keys, (void *)i) == 0);
+    }
+
+    size_t added = 0;
+    for (size_t i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        added += Added[i];
+    }
+    assert(added == KEYS);
+    assert(Shared.count == KEYS);
+
+    set_destroy(&Shared);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test set_insert\n");
+        fprintf(stderr, "    1  Test set_insert from several threads\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_set_insert(); break;
+        case 1:  status = test_01_set_threads(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
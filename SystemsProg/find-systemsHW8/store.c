@@ -0,0 +1,288 @@
+/* store.c: Flat path store with batch filters */
+
+#include "findit.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Constants */
+
+#define STORE_BLOCK     16      // Candidate positions tested per iteration
+
+/* Functions */
+
+/**
+ * Grow byte blob to hold at least needed bytes.  Everything past the used
+ * bytes, padding included, is kept zeroed so vector loads never see
+ * uninitialized memory.
+ * @param   s           Pointer to Store structure
+ * @param   needed      Number of bytes required
+ * @return  Whether or not the blob is large enough.
+ **/
+static bool store_reserve(Store *s, size_t needed) {
+    if (needed <= s->capacity) return true;
+
+    size_t capacity = s->capacity ? s->capacity : STORE_CAPACITY;
+    while (capacity < needed) capacity *= 2;
+
+    char *bytes = realloc(s->bytes, capacity + STORE_PADDING);
+    if (!bytes) return false;
+    memset(bytes + s->size, 0, capacity + STORE_PADDING - s->size);
+    s->bytes    = bytes;
+    s->capacity = capacity;
+    return true;
+}
+
+/**
+ * Grow offset arrays to hold at least one more path.
+ * @param   s           Pointer to Store structure
+ * @return  Whether or not there is room for another path.
+ **/
+static bool store_grow(Store *s) {
+    if (s->count < s->slots) return true;
+
+    size_t slots = s->slots ? 2 * s->slots : STORE_SLOTS;
+    size_t   *offsets  = realloc(s->offsets, slots * sizeof(size_t));
+    if (offsets)  s->offsets = offsets;
+    uint32_t *bases    = realloc(s->bases, slots * sizeof(uint32_t));
+    if (bases)    s->bases = bases;
+    uint32_t *baselens = realloc(s->baselens, slots * sizeof(uint32_t));
+    if (baselens) s->baselens = baselens;
+    if (!offsets || !bases || !baselens) return false;
+
+    s->slots = slots;
+    return true;
+}
+
+/**
+ * Return length of path i (without its NUL).
+ * @param   s           Pointer to Store structure
+ * @param   i           Index of path
+ * @return  Length of path.
+ **/
+static size_t store_length(Store *s, size_t i) {
+    size_t end = i + 1 < s->count ? s->offsets[i + 1] : s->size;
+    return end - s->offsets[i] - 1;
+}
+
+/**
+ * Test which of STORE_BLOCK consecutive positions start with the first byte
+ * of literal and have its last byte length - 1 bytes later, one byte at a
+ * time.  Positions whose literal would run past the used bytes are never
+ * set, so nothing beyond them is read.
+ * @param   s           Pointer to Store structure
+ * @param   i           First position
+ * @param   length      Length of literal
+ * @param   first       First byte of literal
+ * @param   last        Last byte of literal
+ * @param   ffold       Bits or'ed into bytes compared with first
+ * @param   lfold       Bits or'ed into bytes compared with last
+ * @return  Bit mask of candidate positions.
+ **/
+static uint32_t store_block(Store *s, size_t i, size_t length, uint8_t first, uint8_t last, uint8_t ffold, uint8_t lfold) {
+    const uint8_t *bytes = (const uint8_t *)s->bytes;
+    uint32_t       mask  = 0;
+
+    for (size_t j = 0; j < STORE_BLOCK && i + j + length <= s->size; j++) {
+        if ((bytes[i + j] | ffold) == first && (bytes[i + j + length - 1] | lfold) == last) {
+            mask |= 1u << j;
+        }
+    }
+    return mask;
+}
+
+/**
+ * Determine if occurrence of literal at pos is where the match type needs
+ * it within basename [base, end).
+ * @param   type        Match type of literal
+ * @param   pos         Offset of occurrence in blob
+ * @param   length      Length of literal
+ * @param   base        Offset of basename in blob
+ * @param   end         Offset just past basename in blob
+ * @return  Whether or not occurrence satisfies match type.
+ **/
+static bool store_place(MatchType type, size_t pos, size_t length, size_t base, size_t end) {
+    if (pos < base || pos + length > end) return false;
+
+    switch (type) {
+        case MATCH_EXACT:       return pos == base && pos + length == end;
+        case MATCH_PREFIX:      return pos == base;
+        case MATCH_SUFFIX:      return pos + length == end;
+        default:                return true;
+    }
+}
+
+/**
+ * Mark paths whose basename matches a literal matcher (exact, prefix, suffix,
+ * or substring) by scanning the whole blob once: every block tests
+ * STORE_BLOCK positions for the literal's first and last byte at once
+ * (across as many basenames as the block spans), and only candidates that
+ * pass are placed against their path's basename and compared in full.
+ * @param   s           Pointer to Store structure
+ * @param   m           Literal matcher with non-empty literal
+ * @param   matches     Set to whether or not each path matches
+ * @return  Number of matching paths.
+ **/
+static size_t store_scan(Store *s, Matcher *m, bool *matches) {
+    const char *literal = m->literal;
+    size_t      length  = m->length;
+    uint8_t     first   = literal[0];
+    uint8_t     last    = literal[length - 1];
+    uint8_t     ffold   = m->icase && isalpha(first) ? 0x20 : 0;
+    uint8_t     lfold   = m->icase && isalpha(last)  ? 0x20 : 0;
+    size_t      k       = 0;
+    size_t      count   = 0;
+
+#ifdef __SSE2__
+    __m128i vfirst = _mm_set1_epi8(first);
+    __m128i vlast  = _mm_set1_epi8(last);
+    __m128i vffold = _mm_set1_epi8(ffold);
+    __m128i vlfold = _mm_set1_epi8(lfold);
+#endif
+
+    memset(matches, 0, s->count * sizeof(bool));
+    for (size_t i = 0; i + length <= s->size; i += STORE_BLOCK) {
+        uint32_t mask;
+#ifdef __SSE2__
+        // Both loads stay inside blob plus padding, which is zeroed
+        if (i + length - 1 + STORE_BLOCK <= s->capacity + STORE_PADDING) {
+            __m128i a = _mm_loadu_si128((const __m128i *)(s->bytes + i));
+            __m128i b = _mm_loadu_si128((const __m128i *)(s->bytes + i + length - 1));
+            a = _mm_cmpeq_epi8(_mm_or_si128(a, vffold), vfirst);
+            b = _mm_cmpeq_epi8(_mm_or_si128(b, vlfold), vlast);
+            mask = _mm_movemask_epi8(_mm_and_si128(a, b));
+        } else
+#endif
+        mask = store_block(s, i, length, first, last, ffold, lfold);
+
+        while (mask) {
+            size_t pos = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+            if (pos + length > s->size) break;
+
+            while (k + 1 < s->count && s->offsets[k + 1] <= pos) k++;
+            if (matches[k]) continue;
+
+            size_t base = s->offsets[k] + s->bases[k];
+            if (!store_place(m->type, pos, length, base, base + s->baselens[k])) continue;
+            if (!matcher_match(m, s->bytes + pos, length)) continue;
+
+            matches[k] = true;
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* Store Functions */
+
+/**
+ * Append copy of path to store.  A zeroed Store structure is empty.
+ * @param   s           Pointer to Store structure
+ * @param   path        Path string
+ * @param   n           Length of path string
+ * @return  Whether or not the path was appended.
+ **/
+bool    store_append(Store *s, const char *path, size_t n) {
+    if (!store_reserve(s, s->size + n + 1) || !store_grow(s)) return false;
+
+    char *copy = s->bytes + s->size;
+    memcpy(copy, path, n);
+    copy[n] = 0;
+
+    Entry e;
+    entry_init(&e, copy);
+    s->offsets[s->count]  = s->size;
+    s->bases[s->count]    = e.base;
+    s->baselens[s->count] = e.baselen;
+    s->count++;
+    s->size += n + 1;
+    return true;
+}
+
+/**
+ * Apply filter to every path in store at once.  Name filters with a literal
+ * pattern run as a single scan of the blob; other name patterns run the
+ * matcher over basenames directly; any other filter sees one Entry per path.
+ * @param   s           Pointer to Store structure
+ * @param   filter      Filter function
+ * @param   options     Options for filter function
+ * @param   matches     Set to whether or not each path matches (s->count)
+ * @return  Number of matching paths.
+ **/
+size_t  store_match(Store *s, Filter filter, Options *options, bool *matches) {
+    Matcher *m     = filter == filter_by_name ? options->matcher : NULL;
+    size_t   count = 0;
+
+    if (m && m->length && m->type != MATCH_GLOB && m->type != MATCH_FNMATCH) {
+        return store_scan(s, m, matches);
+    }
+
+    for (size_t i = 0; i < s->count; i++) {
+        if (m) {
+            matches[i] = matcher_match(m, s->bytes + s->offsets[i] + s->bases[i], s->baselens[i]);
+        } else {
+            Entry e;
+            entry_init(&e, s->bytes + s->offsets[i]);
+            matches[i] = filter(&e, options);
+        }
+        count += matches[i];
+    }
+    return count;
+}
+
+/**
+ * Keep only paths that satisfy filter, compacting the blob in place and
+ * preserving order.
+ * @param   s           Pointer to Store structure
+ * @param   filter      Filter function
+ * @param   options     Options for filter function
+ * @return  Whether or not the store could be filtered (unchanged if not).
+ **/
+bool    store_filter(Store *s, Filter filter, Options *options) {
+    if (!s->count) return true;
+
+    bool *matches = malloc(s->count * sizeof(bool));
+    if (!matches) return false;
+    store_match(s, filter, options, matches);
+
+    size_t size  = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < s->count; i++) {
+        if (!matches[i]) continue;
+
+        size_t n = store_length(s, i) + 1;
+        memmove(s->bytes + size, s->bytes + s->offsets[i], n);
+        s->offsets[count]  = size;
+        s->bases[count]    = s->bases[i];
+        s->baselens[count] = s->baselens[i];
+        size += n;
+        count++;
+    }
+
+    memset(s->bytes + size, 0, s->size - size);
+    s->size  = size;
+    s->count = count;
+    free(matches);
+    return true;
+}
+
+/**
+ * Release store, leaving it empty.
+ * @param   s           Pointer to Store structure
+ **/
+void    store_delete(Store *s) {
+    free(s->bytes);
+    free(s->offsets);
+    free(s->bases);
+    free(s->baselens);
+    memset(s, 0, sizeof(Store));
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
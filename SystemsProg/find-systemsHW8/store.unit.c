@@ -0,0 +1,215 @@
+/* store.unit.c: flat path store unit test */
+
+#include "findit.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+#define nargs(a)    (sizeof(a) / sizeof((a)[0]))
+
+#define PATHS       20000
+
+/* Functions */
+
+/**
+ * Fill store with pseudo-random paths of one to four components drawn from
+ * a small alphabet (upper and lower case), so that literals occur often, in
+ * directory components as well as basenames, and across path boundaries.
+ * @param   s           Pointer to Store structure
+ * @param   count       Number of paths to append
+ **/
+void make_paths(Store *s, size_t count) {
+    static const char alphabet[] = "abcAB.x";
+    unsigned int seed = 20289;
+
+    for (size_t i = 0; i < count; i++) {
+        char   path[BUFSIZ];
+        size_t n = 0;
+        int    components = 1 + rand_r(&seed) % 4;
+
+        if (rand_r(&seed) % 8 == 0) path[n++] = '/';
+        for (int c = 0; c < components; c++) {
+            if (c) path[n++] = '/';
+            int letters = rand_r(&seed) % 12;
+            for (int l = 0; l < letters; l++) {
+                path[n++] = alphabet[rand_r(&seed) % (sizeof(alphabet) - 1)];
+            }
+        }
+        if (rand_r(&seed) % 16 == 0) path[n++] = '/';
+        path[n] = 0;
+        assert(store_append(s, path, n));
+    }
+}
+
+/**
+ * Determine if store_match agrees with filter applied one Entry at a time.
+ * @param   s           Pointer to Store structure
+ * @param   pattern     Name pattern
+ * @param   icase       Whether or not to ignore case
+ * @return  Number of matching paths.
+ **/
+size_t agree(Store *s, const char *pattern, bool icase) {
+    Options options = {.name = (char *)pattern, .matcher = matcher_create(pattern, icase)};
+    bool   *matches = malloc(s->count * sizeof(bool));
+    assert(options.matcher && matches);
+
+    size_t count = store_match(s, filter_by_name, &options, matches);
+    size_t expected = 0;
+    for (size_t i = 0; i < s->count; i++) {
+        Entry e;
+        entry_init(&e, s->bytes + s->offsets[i]);
+        bool match = filter_by_name(&e, &options);
+        assert(matches[i] == match);
+        expected += match;
+    }
+    assert(count == expected);
+
+    free(matches);
+    matcher_delete(options.matcher);
+    return count;
+}
+
+/* Tests */
+
+int test_00_store_append() {
+    Store s = {0};
+
+    // Test: paths, basenames, and offsets agree with entry_init
+    char *paths[] = {"", "/", "a", "/a/bc", "a/bc/", "a//", "./x.txt"};
+    for (size_t i = 0; i < nargs(paths); i++) {
+        assert(store_append(&s, paths[i], strlen(paths[i])));
+    }
+    assert(s.count == nargs(paths));
+    for (size_t i = 0; i < s.count; i++) {
+        Entry e;
+        entry_init(&e, paths[i]);
+        assert(streq(s.bytes + s.offsets[i], paths[i]));
+        assert(s.bases[i] == e.base && s.baselens[i] == e.baselen);
+    }
+
+    // Test: growth past initial blob and slots keeps every path
+    size_t count = s.count;
+    make_paths(&s, 10 * STORE_SLOTS);
+    assert(s.count == count + 10 * STORE_SLOTS && s.size > STORE_CAPACITY);
+    for (size_t i = 0; i < nargs(paths); i++) {
+        assert(streq(s.bytes + s.offsets[i], paths[i]));
+    }
+    for (size_t i = 1; i < s.count; i++) {
+        assert(s.offsets[i] == s.offsets[i - 1] + strlen(s.bytes + s.offsets[i - 1]) + 1);
+    }
+
+    // Test: bytes past end are zeroed
+    for (size_t i = s.size; i < s.capacity + STORE_PADDING; i++) {
+        assert(!s.bytes[i]);
+    }
+
+    store_delete(&s);
+    assert(!s.bytes && !s.count);
+    return EXIT_SUCCESS;
+}
+
+int test_01_store_match() {
+    Store s = {0};
+    make_paths(&s, PATHS);
+
+    // Test: literal scans agree with matcher, with and without case
+    char *literals[] = {"ab", "ab*", "*ab", "*ab*", "a", "*.x", "*b.*", "cab*", "x", "*c*"};
+    for (size_t i = 0; i < nargs(literals); i++) {
+        assert(agree(&s, literals[i], false) > 0);
+        assert(agree(&s, literals[i], true) >= agree(&s, literals[i], false));
+    }
+
+    // Test: literal longer than padding uses scalar blocks at end of blob
+    char *longest = "*aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa*";
+    assert(store_append(&s, longest + 1, strlen(longest) - 2));
+    assert(agree(&s, longest, false) == 1);
+    assert(agree(&s, longest, true) == 1);
+
+    // Test: globs and empty patterns take the per-path path
+    assert(agree(&s, "a?b", false) > 0);
+    assert(agree(&s, "[ab]*c", true) > 0);
+    assert(agree(&s, "*", false) == s.count);
+    assert(agree(&s, "", false) > 0);
+
+    store_delete(&s);
+    return EXIT_SUCCESS;
+}
+
+int test_02_store_filter() {
+    Store s = {0};
+    make_paths(&s, PATHS);
+
+    // Test: filtering keeps matching paths in order
+    Options options  = {.matcher = matcher_create("*ab*", false)};
+    Store   expected = {0};
+    for (size_t i = 0; i < s.count; i++) {
+        Entry e;
+        entry_init(&e, s.bytes + s.offsets[i]);
+        if (filter_by_name(&e, &options)) {
+            assert(store_append(&expected, e.path, e.length));
+        }
+    }
+
+    assert(store_filter(&s, filter_by_name, &options));
+    assert(s.count == expected.count && s.size == expected.size);
+    assert(!memcmp(s.bytes, expected.bytes, s.size));
+    for (size_t i = 0; i < s.count; i++) {
+        assert(s.offsets[i] == expected.offsets[i]);
+        assert(s.bases[i] == expected.bases[i] && s.baselens[i] == expected.baselens[i]);
+    }
+    for (size_t i = s.size; i < s.capacity + STORE_PADDING; i++) {
+        assert(!s.bytes[i]);
+    }
+
+    // Test: filtering again narrows further, other filters see entries
+    matcher_delete(options.matcher);
+    options.matcher = matcher_create("*.*", true);
+    size_t count = s.count;
+    assert(store_filter(&s, filter_by_name, &options));
+    assert(0 < s.count && s.count < count);
+    assert(store_filter(&s, filter_by_prune, &options) && s.count > 0);
+
+    // Test: nothing matches
+    matcher_delete(options.matcher);
+    options.matcher = matcher_create("zzz", false);
+    assert(store_filter(&s, filter_by_name, &options));
+    assert(s.count == 0 && s.size == 0);
+    assert(store_filter(&s, filter_by_name, &options));
+
+    matcher_delete(options.matcher);
+    store_delete(&expected);
+    store_delete(&s);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test store_append\n");
+        fprintf(stderr, "    1  Test store_match\n");
+        fprintf(stderr, "    2  Test store_filter\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_store_append(); break;
+        case 1:  status = test_01_store_match(); break;
+        case 2:  status = test_02_store_filter(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,1194 @@
+/* walk.c: Directory traversal functions */
+
+#include "findit.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define	streq(a, b) (strcmp(a, b) == 0)
+
+#define DEQUE_CAPACITY  64
+#define STACK_CAPACITY  64
+#define STACK_OPEN      64  // Directories a serial walk keeps open at once
+
+/* Batch Structure */
+
+typedef struct {
+    char            names[RING_ENTRIES * (NAME_MAX + 1)];   // Names read ahead
+    size_t          offsets[RING_ENTRIES];  // Offset of each name in names
+    unsigned char   types[RING_ENTRIES];    // d_type of each name
+    int             slots[RING_ENTRIES];    // Index of each name's stat (-1 if none)
+    struct stat     sts[RING_ENTRIES];      // Stats fetched together
+    bool            ok[RING_ENTRIES];       // Whether or not each stat was fetched
+    size_t          count;                  // Number of names read ahead
+    size_t          next;                   // Index of next name to hand out
+} Batch;
+
+/* Frame Structure */
+
+typedef struct {
+    Dir         dir;        // Directory being read (while open)
+    bool        open;       // Whether or not entries still come from dir
+    int         fd;         // Directory file descriptor (-1 while closed)
+    size_t      length;     // Length of path to directory
+    char       *saved;      // Unread entries (type byte, name, NUL) once closed
+    size_t      offset;     // Offset of next saved entry
+    size_t      size;       // Number of bytes of saved entries
+    size_t      capacity;   // Allocated size of saved
+    dev_t       dev;        // Device of directory (once closed, or with -L)
+    ino_t       ino;        // Inode of directory (once closed, or with -L)
+    Batch      *batch;      // Entries read ahead with their stats (-uring)
+} Frame;
+
+/* Stack Structure */
+
+typedef struct {
+    Frame      *frames;     // Directories from the walk's root down
+    size_t      count;      // Number of frames
+    size_t      capacity;   // Allocated number of frames
+    size_t      low;        // Index of first frame with an open descriptor
+} Stack;
+
+/* Task Structure */
+
+typedef struct Task Task;
+struct Task {
+    char   *path;       // Directory to walk
+    size_t  depth;      // Depth of directory (root is 0)
+    Node   *anchor;     // Node in parent's list to splice after (NULL for head)
+    List    files;      // Entries found directly in directory
+    Task   *children;   // First subdirectory task
+    Task   *sibling;    // Next subdirectory task of same parent
+    Task   *parent;     // Task whose files this one is spliced into
+    dev_t   dev;        // Device of directory, as listed by its parent
+    ino_t   ino;        // Inode of directory, as listed by its parent
+};
+
+/* Deque Structure */
+
+typedef struct {
+    pthread_mutex_t lock;       // Protects everything below
+    Task          **tasks;      // Array of pending tasks
+    size_t          top;        // Index of oldest task (stolen first)
+    size_t          bottom;     // Index past newest task (popped first)
+    size_t          capacity;   // Allocated size of tasks array
+} Deque;
+
+/* Pool Structures */
+
+typedef struct Pool Pool;
+
+typedef struct {
+    Pool       *pool;       // Pool this worker belongs to
+    size_t      id;         // Index into pool workers
+    Deque       deque;      // Tasks owned by this worker
+    Arena      *arena;      // Arena for task lists this worker fills
+    Ring        ring;       // Batched stats of this worker (-uring)
+    pthread_t   thread;     // Thread running this worker
+} Worker;
+
+struct Pool {
+    Worker         *workers;    // Array of workers
+    size_t          nworkers;   // Number of workers
+    atomic_size_t   pending;    // Tasks pushed but not yet completed
+    atomic_size_t   idle;       // Workers waiting for work
+    pthread_mutex_t lock;       // Protects wakeup condition
+    pthread_cond_t  wakeup;     // Signalled when work appears or walk ends
+    pthread_mutex_t emit;       // Serializes visits in unordered mode
+    Walk           *walk;       // Walk settings
+};
+
+/* Stack Functions */
+
+/**
+ * Save entry at end of frame's saved entries.
+ * @param   f           Pointer to Frame structure
+ * @param   name        Name of entry
+ * @param   type        d_type of entry
+ * @return  Whether or not the entry was saved.
+ **/
+static bool stack_save(Frame *f, const char *name, unsigned char type) {
+    size_t n = strlen(name) + 2;
+    if (f->size + n > f->capacity) {
+        size_t capacity = f->capacity ? 2 * f->capacity : PATH_CAPACITY;
+        while (capacity < f->size + n) capacity *= 2;
+
+        char *saved = realloc(f->saved, capacity);
+        if (!saved) return false;
+        f->saved    = saved;
+        f->capacity = capacity;
+    }
+    f->saved[f->size] = type;
+    memcpy(f->saved + f->size + 1, name, n - 1);
+    f->size += n;
+    return true;
+}
+
+/**
+ * Return entries read ahead (-uring) but not yet handed out to the front of
+ * frame's saved entries, dropping their stats, so a closed frame keeps only
+ * names no matter how it was read.
+ * @param   f           Pointer to Frame structure
+ **/
+static void stack_unread(Frame *f) {
+    Batch *b    = f->batch;
+    Frame  rest = *f;
+
+    f->saved    = NULL;
+    f->offset   = f->size = f->capacity = 0;
+    for (size_t i = b->next; i < b->count; i++) {
+        stack_save(f, b->names + b->offsets[i], b->types[i]);
+    }
+    for (size_t offset = rest.offset; offset < rest.size; offset += strlen(rest.saved + offset + 1) + 2) {
+        stack_save(f, rest.saved + offset + 1, rest.saved[offset]);
+    }
+
+    free(rest.saved);
+    free(b);
+    f->batch = NULL;
+}
+
+/**
+ * Close the oldest directory that is still open, saving its unread entries
+ * (and its identity, so it can be verified when reopened) in its frame.
+ * @param   s           Pointer to Stack structure
+ **/
+static void stack_close(Stack *s) {
+    Frame        *f = &s->frames[s->low++];
+    struct stat   st;
+    const char   *name;
+    unsigned char type;
+
+    if (f->batch) {
+        stack_unread(f);
+    }
+
+    if (f->open) {
+        if (!f->ino && fstat(f->fd, &st) == 0) {
+            f->dev = st.st_dev;
+            f->ino = st.st_ino;
+        }
+
+        while (dir_read(&f->dir, &name, &type)) {
+            if (!stack_save(f, name, type)) break;
+        }
+        dir_close(&f->dir);
+        f->open = false;
+    } else if (f->fd >= 0) {
+        close(f->fd);
+    }
+    f->fd = -1;
+}
+
+/**
+ * Push frame for open directory, closing the oldest open directory if the
+ * stack already holds STACK_OPEN of them.
+ * @param   s           Pointer to Stack structure
+ * @param   fd          Directory file descriptor (owned by stack on success)
+ * @param   length      Length of path to directory
+ * @param   walk        Pointer to Walk structure
+ * @return  Whether or not the frame was pushed.
+ **/
+static bool stack_push(Stack *s, int fd, size_t length, Walk *walk) {
+    if (s->count == s->capacity) {
+        size_t capacity = s->capacity ? 2 * s->capacity : STACK_CAPACITY;
+        Frame *frames   = realloc(s->frames, capacity * sizeof(Frame));
+        if (!frames) {
+            close(fd);
+            return false;
+        }
+        s->frames   = frames;
+        s->capacity = capacity;
+    }
+
+    Frame *f = &s->frames[s->count];
+    memset(f, 0, sizeof(Frame));
+    if (!dir_open(&f->dir, fd, walk->dirbuf, walk->readdir)) return false;
+    f->open   = true;
+    f->fd     = dir_fd(&f->dir);
+    f->length = length;
+    s->count++;
+
+    // Identity of every directory being walked is needed to spot loops
+    struct stat st;
+    if (walk->follow && fstat(f->fd, &st) == 0) {
+        f->dev = st.st_dev;
+        f->ino = st.st_ino;
+    }
+
+    if (s->count - s->low > STACK_OPEN) {
+        stack_close(s);
+    }
+    return true;
+}
+
+/**
+ * Open directory at the first length bytes of path, resolving it in pieces
+ * shorter than PATH_MAX so that a directory at any depth can be reopened.
+ * @param   path        Pointer to Path structure (unchanged on return)
+ * @param   length      Length of directory's path
+ * @return  File descriptor or -1 on failure.
+ **/
+static int stack_open(Path *path, size_t length) {
+    int    fd    = AT_FDCWD;
+    size_t start = 0;
+
+    while (true) {
+        // Split at the last slash that keeps the piece short enough
+        size_t end = length;
+        if (end - start >= PATH_MAX) {
+            for (end = start + PATH_MAX - 1; end > start && path->data[end] != '/'; end--);
+        }
+
+        char saved = path->data[end];
+        int  next  = -1;
+        if (end > start) {
+            path->data[end] = 0;
+            next = openat(fd, path->data + start, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            path->data[end] = saved;
+        }
+        if (fd != AT_FDCWD) close(fd);
+        if (next < 0 || end == length) return next;
+
+        fd    = next;
+        start = end + 1;
+    }
+}
+
+/**
+ * Pop finished frame, reopening its parent if the parent was closed: through
+ * ".." normally, or by path when following links, since ".." of a directory
+ * reached through a link is not the directory the walk came from.  Otherwise
+ * the path is tried when ".." fails.  If the parent cannot be reopened as the
+ * same directory, it is reported and its remaining entries are skipped.
+ * @param   s           Pointer to Stack structure
+ * @param   path        Path to an entry of the finished frame
+ * @param   walk        Pointer to Walk structure
+ **/
+static void stack_pop(Stack *s, Path *path, Walk *walk) {
+    Frame *f = &s->frames[--s->count];
+
+    if (s->count && s->low == s->count) {
+        Frame      *parent  = &s->frames[--s->low];
+        bool        changed = false;
+        struct stat st;
+
+        // Through ".." first when not following links, then by path
+        for (int attempt = walk->follow; attempt < 2; attempt++) {
+            changed = false;
+            if (attempt) {
+                parent->fd = stack_open(path, parent->length);
+            } else {
+                parent->fd = f->fd >= 0 ? openat(f->fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+            }
+            if (parent->fd >= 0 && (fstat(parent->fd, &st) < 0 || st.st_dev != parent->dev || st.st_ino != parent->ino)) {
+                close(parent->fd);
+                parent->fd = -1;
+                changed    = true;
+            }
+            if (parent->fd >= 0) break;
+        }
+        if (parent->fd < 0) {
+            const char *reason = changed ? "directory changed during walk" : strerror(errno);
+            fprintf(stderr, "findit: %.*s: %s\n", (int)parent->length, path->data, reason);
+            parent->offset = parent->size;
+        }
+    }
+
+    if (f->open) {
+        dir_close(&f->dir);
+    } else if (f->fd >= 0) {
+        close(f->fd);
+    }
+    free(f->saved);
+    free(f->batch);
+}
+
+/**
+ * Read next entry of frame, from its directory while open and from its saved
+ * entries once closed.
+ * @param   f           Pointer to Frame structure
+ * @param   name        Set to name of entry
+ * @param   type        Set to d_type of entry
+ * @return  Whether or not an entry was read.
+ **/
+static bool stack_read(Frame *f, const char **name, unsigned char *type) {
+    if (f->open) return dir_read(&f->dir, name, type);
+    if (f->offset >= f->size) return false;
+
+    *type = f->saved[f->offset];
+    *name = f->saved + f->offset + 1;
+    f->offset += strlen(*name) + 2;
+    return true;
+}
+
+/**
+ * Determine if entry of given d_type will be stat'd anyway, by the expression
+ * or by the walk itself, and so is worth stat'ing ahead of time.
+ * @param   type        d_type of entry
+ * @param   walk        Pointer to Walk structure
+ * @return  Whether or not to stat entry ahead of time.
+ **/
+static bool stack_wants(unsigned char type, Walk *walk) {
+    if (type == DT_UNKNOWN || (walk->expr && walk->expr->stat)) return true;
+    if (walk->follow) return type == DT_LNK || type == DT_DIR;
+    return walk->xdev && type == DT_DIR;
+}
+
+/**
+ * Read up to RING_ENTRIES entries of frame ahead and stat the ones that need
+ * it all at once through ring.
+ * @param   f           Pointer to Frame structure
+ * @param   ring        Pointer to Ring structure
+ * @param   walk        Pointer to Walk structure
+ * @return  Whether or not the batch could be allocated.
+ **/
+static bool stack_fetch(Frame *f, Ring *ring, Walk *walk) {
+    Batch        *b = f->batch;
+    const char   *names[RING_ENTRIES];
+    const char   *name;
+    unsigned char type;
+    size_t        size = 0;
+    size_t        n    = 0;
+
+    if (!b && !(b = f->batch = malloc(sizeof(Batch)))) return false;
+
+    b->count = b->next = 0;
+    while (b->count < RING_ENTRIES && stack_read(f, &name, &type)) {
+        if (streq(name, ".") || streq(name, "..")) continue;
+
+        size_t i = b->count++;
+        b->offsets[i] = size;
+        b->types[i]   = type;
+        b->slots[i]   = -1;
+        strcpy(b->names + size, name);
+        size += strlen(name) + 1;
+
+        if (stack_wants(type, walk)) {
+            b->slots[i] = n;
+            names[n++]  = b->names + b->offsets[i];
+        }
+    }
+
+    ring_stat(ring, f->fd, names, n, walk->follow ? 0 : AT_SYMLINK_NOFOLLOW, b->sts, b->ok);
+    return true;
+}
+
+/**
+ * Read next entry of frame, together with its stat if ring fetched it.
+ * Without a usable ring, this is just stack_read.
+ * @param   f           Pointer to Frame structure
+ * @param   ring        Pointer to Ring structure
+ * @param   walk        Pointer to Walk structure
+ * @param   name        Set to name of entry
+ * @param   type        Set to d_type of entry
+ * @param   st          Set to stat of entry (NULL if not fetched)
+ * @return  Whether or not an entry was read.
+ **/
+static bool stack_next(Frame *f, Ring *ring, Walk *walk, const char **name, unsigned char *type, const struct stat **st) {
+    Batch *b = f->batch;
+
+    *st = NULL;
+    if (ring->fd < 0 && (!b || b->next == b->count)) return stack_read(f, name, type);
+    if (!b || b->next == b->count) {
+        if (!stack_fetch(f, ring, walk)) return stack_read(f, name, type);
+        b = f->batch;
+        if (!b->count) return false;
+    }
+
+    size_t i = b->next++;
+    *name = b->names + b->offsets[i];
+    *type = b->types[i];
+    if (b->slots[i] >= 0 && b->ok[b->slots[i]]) {
+        *st = &b->sts[b->slots[i]];
+    }
+    return true;
+}
+
+/* Walk Functions */
+
+/**
+ * Determine if entry lies within the depth limits and matches the walk's
+ * filter expression.  Entries above -mindepth are not evaluated at all, so
+ * -prune has no effect on them.
+ * @param   e           Pointer to Entry structure
+ * @param   depth       Depth of entry (root is 0)
+ * @param   walk        Pointer to Walk structure
+ * @return  Whether or not entry matches.
+ **/
+static bool walk_match(Entry *e, size_t depth, Walk *walk) {
+    if (depth < walk->mindepth) return false;
+    return !walk->expr || expr_evaluate(walk->expr, e);
+}
+
+/**
+ * Determine if walk should descend into entry.  This is decided before the
+ * directory is opened, so pruned subtrees, subtrees below -maxdepth and other
+ * file systems (-xdev) cost no system calls beyond a stat of the directory.
+ * @param   e           Pointer to Entry structure (already matched)
+ * @param   depth       Depth of entry (root is 0)
+ * @param   walk        Pointer to Walk structure
+ * @return  Whether or not entry is a directory to walk.
+ **/
+static bool walk_descend(Entry *e, size_t depth, Walk *walk) {
+    if (e->prune || entry_type(e) != S_IFDIR) return false;
+    if (walk->maxdepth && depth + 1 >= walk->maxdepth) return false;
+    if (walk->xdev) {
+        struct stat *s = entry_stat(e);
+        return s && s->st_dev == walk->dev;
+    }
+    return true;
+}
+
+/**
+ * Determine if entry is a directory that is already being walked above it
+ * (-L), in which case it is skipped altogether as find does.  Every directory
+ * is recorded in the walk's set, so only those seen before (in a loop, or
+ * reached again through another link) are checked exactly against the frames
+ * and tasks above entry.
+ * @param   e           Pointer to Entry structure
+ * @param   s           Stack of directories above entry (NULL if none)
+ * @param   t           Innermost task above entry (NULL if none)
+ * @param   walk        Pointer to Walk structure
+ * @return  Whether or not entry closes a loop.
+ **/
+static bool walk_loop(Entry *e, const Stack *s, const Task *t, Walk *walk) {
+    if (!walk->follow || entry_type(e) != S_IFDIR) return false;
+
+    struct stat *st = entry_stat(e);
+    if (!st) return false;
+    if (walk->seen && set_insert(walk->seen, st->st_dev, st->st_ino)) return false;
+
+    for (size_t i = s ? s->count : 0; i > 0; i--) {
+        const Frame *f = &s->frames[i - 1];
+        if (f->dev == st->st_dev && f->ino == st->st_ino) return true;
+    }
+    for (; t; t = t->parent) {
+        if (t->dev == st->st_dev && t->ino == st->st_ino) return true;
+    }
+    return false;
+}
+
+/**
+ * Visitor that appends a copy of the entry's path to a List.
+ * @param   e           Pointer to Entry structure
+ * @param   arg         Pointer to List structure
+ **/
+void	walk_collect(Entry *e, void *arg) {
+    list_append_string((List *)arg, e->path, e->length);
+}
+
+/**
+ * Visit root path if it matches the filter expression, and record its device
+ * for -xdev and its identity for -L.
+ * @param   root        Root path
+ * @param   walk        Pointer to Walk structure
+ * @param   visit       Visitor to call on match
+ * @param   arg         Argument passed to visitor
+ * @return  Whether or not to walk beneath root.
+ **/
+static bool walk_root(const char *root, Walk *walk, Visitor visit, void *arg) {
+    Entry e;
+    entry_init(&e, root);
+    e.follow = walk->follow;
+    if (walk_match(&e, 0, walk)) {
+        visit(&e, arg);
+    }
+
+    // Root itself is followed if it is a symbolic link, so use stat
+    struct stat s;
+    if (walk->xdev || walk->seen) {
+        if (stat(root, &s) < 0) return false;
+        walk->dev = s.st_dev;
+        if (walk->seen) {
+            set_insert(walk->seen, s.st_dev, s.st_ino);
+        }
+    }
+    return !e.prune && (!walk->maxdepth || walk->maxdepth > 1);
+}
+
+/**
+ * Open subdirectory relative to its parent directory.
+ * @param   dirfd       Parent directory file descriptor
+ * @param   name        Name of subdirectory
+ * @param   walk        Pointer to Walk structure
+ * @return  File descriptor or -1 on failure.
+ **/
+static int walk_open(int dirfd, const char *name, Walk *walk) {
+    return openat(dirfd, name, O_RDONLY | O_DIRECTORY | (walk->follow ? 0 : O_NOFOLLOW) | O_CLOEXEC);
+}
+
+/**
+ * Walk open directory depth-first, visiting each file system entity that
+ * matches the filter expression as soon as it is read.  Each entry is
+ * examined relative to its parent's file descriptor, so path is only built
+ * for output.
+ *
+ * Directories being walked are kept on an explicit stack rather than the call
+ * stack, so depth is limited only by memory.  At most STACK_OPEN of them stay
+ * open (with their read buffers); older ones are closed with their unread
+ * entries saved and are reopened through ".." on the way back up, so each
+ * level costs only its frame and those entries.
+ *
+ * With -uring, entries are read RING_ENTRIES at a time and those that will be
+ * stat'd are stat'd together through io_uring, so a slow file system sees
+ * many requests in flight instead of one; if io_uring is unavailable, each
+ * entry is stat'd when first needed as usual.
+ *
+ * @param   fd          Directory file descriptor (closed on return)
+ * @param   path        Path to directory (restored on return)
+ * @param   depth       Depth of directory (root is 0)
+ * @param   walk        Pointer to Walk structure
+ * @param   visit       Visitor to call on each match
+ * @param   arg         Argument passed to visitor
+ **/
+static void walk_dir(int fd, Path *path, size_t depth, Walk *walk, Visitor visit, void *arg) {
+    Stack              s      = {0};
+    Ring               ring   = {.fd = -1};
+    size_t             length = path->length;
+    const char        *name;
+    unsigned char      type;
+    const struct stat *fetched;
+
+    if (!stack_push(&s, fd, length, walk)) goto cleanup;
+    if (walk->uring) {
+        ring_open(&ring, RING_ENTRIES);
+    }
+
+    while (s.count) {
+        Frame *f = &s.frames[s.count - 1];
+        if (!stack_next(f, &ring, walk, &name, &type, &fetched)) {
+            stack_pop(&s, path, walk);
+            continue;
+        }
+
+        if (streq(name, ".") || streq(name, "..")) {
+            continue;
+        }
+
+        path_pop(path, f->length);
+        if (!path_push(path, name)) continue;
+
+        size_t level = depth + s.count;
+        Entry  entry = {
+            .path    = path->data,
+            .length  = path->length,
+            .base    = f->length + 1,
+            .baselen = path->length - f->length - 1,
+            .name    = name,
+            .dirfd   = f->fd,
+            .type    = type,
+            .follow  = walk->follow,
+        };
+        if (fetched) {
+            entry.st     = *fetched;
+            entry.status = 1;
+        }
+        if (walk_loop(&entry, &s, NULL, walk)) {
+            continue;
+        }
+
+        if (walk_match(&entry, level, walk)) {
+            visit(&entry, arg);
+        }
+
+        if (walk_descend(&entry, level, walk)) {
+            int sub = walk_open(f->fd, name, walk);
+            if (sub >= 0) {
+                stack_push(&s, sub, path->length, walk);
+            }
+        }
+    }
+
+cleanup:
+    path_pop(path, length);
+    free(s.frames);
+    ring_close(&ring);
+}
+
+/**
+ * Walk specified directory on the calling thread, visiting each file system
+ * entity that matches the filter expression.
+ * @param   root        Directory to walk
+ * @param   walk        Pointer to Walk structure
+ * @param   visit       Visitor to call on each match
+ * @param   arg         Argument passed to visitor
+ **/
+static void walk_serial(const char *root, Walk *walk, Visitor visit, void *arg) {
+    if (!walk_root(root, walk, visit, arg)) return;
+
+    int fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    Path path;
+    if (!path_init(&path, root)) {
+        close(fd);
+        return;
+    }
+
+    walk_dir(fd, &path, 0, walk, visit, arg);
+    free(path.data);
+}
+
+/* Deque Functions */
+
+/**
+ * Push task onto the bottom (owner end) of deque.
+ * @param   q           Pointer to Deque structure
+ * @param   t           Task to push
+ * @return  Whether or not the task was pushed.
+ **/
+static bool deque_push(Deque *q, Task *t) {
+    bool pushed = true;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->bottom == q->capacity) {
+        // Reclaim space left behind by thieves before growing
+        if (q->top > 0) {
+            memmove(q->tasks, q->tasks + q->top, (q->bottom - q->top) * sizeof(Task *));
+            q->bottom -= q->top;
+            q->top     = 0;
+        } else {
+            size_t capacity = q->capacity ? 2 * q->capacity : DEQUE_CAPACITY;
+            Task **tasks    = realloc(q->tasks, capacity * sizeof(Task *));
+            if (tasks) {
+                q->tasks    = tasks;
+                q->capacity = capacity;
+            } else {
+                pushed = false;
+            }
+        }
+    }
+    if (pushed) {
+        q->tasks[q->bottom++] = t;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return pushed;
+}
+
+/**
+ * Pop newest task from the bottom (owner end) of deque.
+ * @param   q           Pointer to Deque structure
+ * @return  Task or NULL if deque is empty.
+ **/
+static Task *deque_pop(Deque *q) {
+    Task *t = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->bottom > q->top) {
+        t = q->tasks[--q->bottom];
+        if (q->bottom == q->top) {
+            q->top = q->bottom = 0;
+        }
+    }
+    pthread_mutex_unlock(&q->lock);
+    return t;
+}
+
+/**
+ * Steal oldest task from the top (thief end) of deque.
+ * @param   q           Pointer to Deque structure
+ * @return  Task or NULL if deque is empty.
+ **/
+static Task *deque_steal(Deque *q) {
+    Task *t = NULL;
+
+    if (pthread_mutex_trylock(&q->lock) != 0) return NULL;
+    if (q->bottom > q->top) {
+        t = q->tasks[q->top++];
+        if (q->bottom == q->top) {
+            q->top = q->bottom = 0;
+        }
+    }
+    pthread_mutex_unlock(&q->lock);
+    return t;
+}
+
+/* Task Functions */
+
+/**
+ * Allocate a new Task structure for directory at path.
+ * @param   path        Directory path (copied)
+ * @param   depth       Depth of directory (root is 0)
+ * @param   anchor      Node in parent list to splice after (NULL for head)
+ * @return  Pointer to new Task structure (must be stitched).
+ **/
+static Task *task_create(const char *path, size_t depth, Node *anchor) {
+    Task *t = calloc(1, sizeof(Task));
+    if (t) {
+        t->path   = strdup(path);
+        t->depth  = depth;
+        t->anchor = anchor;
+        if (!t->path) {
+            free(t);
+            t = NULL;
+        }
+    }
+    return t;
+}
+
+/**
+ * Splice the files of each finished subdirectory task into its parent's list
+ * right after the anchor node, reproducing the serial pre-order, and then
+ * deallocate the tasks.
+ *
+ * Children are kept newest first, so siblings that share an anchor (because
+ * the entries between them were filtered out) end up in discovery order.
+ * Tasks are kept on an explicit stack, so deep trees cannot overflow the call
+ * stack.
+ *
+ * @param   root        Pointer to root Task structure
+ * @param   files       List containing the root task's anchor
+ **/
+static void task_stitch(Task *root, List *files) {
+    // Tasks waiting to be stitched, linked through sibling once pushed; each
+    // task stays below its children so they are stitched into it first
+    Task *stack = root;
+
+    while (stack) {
+        Task *t = stack;
+
+        if (t->children) {
+            Task *reversed = NULL;
+            for (Task *c = t->children, *next; c; c = next) {
+                next        = c->sibling;
+                c->sibling  = reversed;
+                reversed    = c;
+            }
+            t->children = NULL;
+
+            // Push oldest first, so the newest child is stitched first
+            for (Task *c = reversed, *next; c; c = next) {
+                next        = c->sibling;
+                c->parent   = t;
+                c->sibling  = stack;
+                stack       = c;
+            }
+            continue;
+        }
+
+        stack = t->sibling;
+
+        List *list = t->parent ? &t->parent->files : files;
+        if (t->files.head) {
+            if (t->anchor) {
+                t->files.tail->next = t->anchor->next;
+                t->anchor->next     = t->files.head;
+            } else {
+                t->files.tail->next = list->head;
+                list->head          = t->files.head;
+            }
+            if (list->tail == t->anchor) {
+                list->tail = t->files.tail;
+            }
+        }
+
+        free(t->path);
+        free(t);
+    }
+}
+
+/* Pool Functions */
+
+/**
+ * Schedule task on worker, counting it as pending until it is walked.
+ * @param   w           Pointer to Worker structure
+ * @param   t           Task to schedule
+ * @return  Whether or not the task was scheduled.
+ **/
+static bool pool_submit(Worker *w, Task *t) {
+    Pool *p = w->pool;
+
+    atomic_fetch_add(&p->pending, 1);
+    if (!deque_push(&w->deque, t)) {
+        atomic_fetch_sub(&p->pending, 1);
+        return false;
+    }
+
+    if (atomic_load(&p->idle) > 0) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_signal(&p->wakeup);
+        pthread_mutex_unlock(&p->lock);
+    }
+    return true;
+}
+
+/**
+ * Find work for worker: first its own deque, then the other workers' deques
+ * in round-robin order starting after its own.
+ * @param   w           Pointer to Worker structure
+ * @return  Task or NULL if no work could be found.
+ **/
+static Task *pool_acquire(Worker *w) {
+    Pool *p = w->pool;
+    Task *t = deque_pop(&w->deque);
+
+    for (size_t i = 1; !t && i < p->nworkers; i++) {
+        t = deque_steal(&p->workers[(w->id + i) % p->nworkers].deque);
+    }
+    return t;
+}
+
+/**
+ * Visitor that hands an entry to the walk's visitor while holding the pool's
+ * emit lock, so visitors never run concurrently.
+ * @param   e           Pointer to Entry structure
+ * @param   arg         Pointer to Pool structure
+ **/
+static void pool_emit(Entry *e, void *arg) {
+    Pool *p = arg;
+
+    pthread_mutex_lock(&p->emit);
+    p->walk->visit(e, p->walk->arg);
+    pthread_mutex_unlock(&p->emit);
+}
+
+/**
+ * Walk the directory of a single task.  Entries are examined relative to the
+ * directory's file descriptor; subdirectories become new tasks on the
+ * worker's deque.  In ordered mode, matches are kept on the task's list and
+ * subdirectories are anchored at its current end so their contents can later
+ * be spliced in place; in unordered mode, matches are visited immediately.
+ * @param   w           Pointer to Worker structure
+ * @param   t           Task to walk
+ **/
+static void pool_walk(Worker *w, Task *t) {
+    Pool   *p     = w->pool;
+    Visitor visit = p->walk->unordered ? pool_emit : walk_collect;
+    void   *arg   = p->walk->unordered ? (void *)p : (void *)&t->files;
+
+    // Task lists share their worker's arena, so no locking is needed
+    if (!p->walk->unordered) {
+        if (!w->arena && !(w->arena = arena_create())) return;
+        t->files.arena = w->arena;
+    }
+
+    Path path;
+    if (!path_init(&path, t->path)) return;
+
+    // Reopen by path in pieces, then make sure the directory is still the
+    // one listed by the parent task, so one swapped for a link is skipped
+    struct stat st;
+    int fd = stack_open(&path, path.length);
+    if (fd >= 0 && fstat(fd, &st) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd >= 0 && t->ino && (st.st_dev != t->dev || st.st_ino != t->ino)) {
+        fprintf(stderr, "findit: %s: directory changed during walk\n", t->path);
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0) {
+        free(path.data);
+        return;
+    }
+
+    // Set for root before any subdirectory task can look up its parents
+    if (!t->ino) {
+        t->dev = st.st_dev;
+        t->ino = st.st_ino;
+    }
+
+    // Read through a frame so -uring batches work as in a serial walk
+    Frame f = {0};
+    if (!dir_open(&f.dir, fd, p->walk->dirbuf, p->walk->readdir)) {
+        free(path.data);
+        return;
+    }
+    f.open = true;
+    f.fd   = dir_fd(&f.dir);
+
+    int                dfd    = f.fd;
+    size_t             length = path.length;
+    const char        *name;
+    unsigned char      type;
+    const struct stat *fetched;
+
+    while (stack_next(&f, &w->ring, p->walk, &name, &type, &fetched)) {
+        if (streq(name, ".") || streq(name, "..")) {
+            continue;
+        }
+
+        if (!path_push(&path, name)) continue;
+
+        Entry entry = {
+            .path    = path.data,
+            .length  = path.length,
+            .base    = length + 1,
+            .baselen = path.length - length - 1,
+            .name    = name,
+            .dirfd   = dfd,
+            .type    = type,
+            .follow  = p->walk->follow,
+        };
+        if (fetched) {
+            entry.st     = *fetched;
+            entry.status = 1;
+        }
+        if (walk_loop(&entry, NULL, t, p->walk)) {
+            path_pop(&path, length);
+            continue;
+        }
+
+        if (walk_match(&entry, t->depth + 1, p->walk)) {
+            visit(&entry, arg);
+        }
+
+        if (walk_descend(&entry, t->depth + 1, p->walk)) {
+            struct stat *cst = entry_stat(&entry);
+            Task        *c   = cst ? task_create(path.data, t->depth + 1, t->files.tail) : NULL;
+            if (c) {
+                c->dev      = cst->st_dev;
+                c->ino      = cst->st_ino;
+                c->parent   = t;
+                c->sibling  = t->children;
+                t->children = c;
+
+                // Fall back to walking inline if the deque cannot grow
+                if (!pool_submit(w, c)) {
+                    pool_walk(w, c);
+                }
+            }
+        }
+
+        path_pop(&path, length);
+    }
+
+    free(path.data);
+    free(f.batch);
+    dir_close(&f.dir);
+}
+
+/**
+ * Worker thread: walk tasks until no task is pending anywhere in the pool.
+ * @param   arg         Pointer to Worker structure
+ * @return  NULL
+ **/
+static void *pool_thread(void *arg) {
+    Worker *w = arg;
+    Pool   *p = w->pool;
+
+    if (p->walk->uring) {
+        ring_open(&w->ring, RING_ENTRIES);
+    }
+
+    while (true) {
+        Task *t = pool_acquire(w);
+        if (t) {
+            pool_walk(w, t);
+            if (atomic_fetch_sub(&p->pending, 1) == 1) {
+                pthread_mutex_lock(&p->lock);
+                pthread_cond_broadcast(&p->wakeup);
+                pthread_mutex_unlock(&p->lock);
+            }
+            continue;
+        }
+
+        if (atomic_load(&p->pending) == 0) break;
+
+        // Sleep briefly; the timeout covers a wakeup racing with the check
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec  += 1;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        pthread_mutex_lock(&p->lock);
+        atomic_fetch_add(&p->idle, 1);
+        if (atomic_load(&p->pending) > 0) {
+            pthread_cond_timedwait(&p->wakeup, &p->lock, &deadline);
+        }
+        atomic_fetch_sub(&p->idle, 1);
+        pthread_mutex_unlock(&p->lock);
+    }
+
+    ring_close(&w->ring);
+    return NULL;
+}
+
+/**
+ * Walk specified directory with a pool of work-stealing threads.  In ordered
+ * mode, matches are stitched onto files in the same order as a serial walk;
+ * in unordered mode, they are passed to the walk's visitor as they are found
+ * and files is left untouched.
+ * @param   root        Directory to walk
+ * @param   walk        Pointer to Walk structure
+ * @param   files       List of files found (ordered mode)
+ **/
+static void walk_parallel(const char *root, Walk *walk, List *files) {
+    Pool p = {0};
+    p.walk     = walk;
+    p.nworkers = walk->jobs;
+    p.workers  = calloc(p.nworkers, sizeof(Worker));
+    if (!p.workers) return;
+
+    pthread_mutex_init(&p.lock, NULL);
+    pthread_mutex_init(&p.emit, NULL);
+    pthread_cond_init(&p.wakeup, NULL);
+
+    bool descend;
+    if (walk->unordered) {
+        descend = walk_root(root, walk, walk->visit, walk->arg);
+    } else {
+        descend = walk_root(root, walk, walk_collect, files);
+    }
+
+    Task *t = descend ? task_create(root, 0, files ? files->tail : NULL) : NULL;
+    if (!t) goto cleanup;
+
+    for (size_t i = 0; i < p.nworkers; i++) {
+        p.workers[i].pool    = &p;
+        p.workers[i].id      = i;
+        p.workers[i].ring.fd = -1;
+        pthread_mutex_init(&p.workers[i].deque.lock, NULL);
+    }
+
+    // Seed first worker with root, then start every worker
+    if (!pool_submit(&p.workers[0], t)) {
+        pool_walk(&p.workers[0], t);
+    }
+
+    size_t started = 0;
+    for (; started < p.nworkers; started++) {
+        if (pthread_create(&p.workers[started].thread, NULL, pool_thread, &p.workers[started]) != 0) {
+            break;
+        }
+    }
+
+    // Without any thread, drain the pool on the calling thread
+    if (!started) {
+        pool_thread(&p.workers[0]);
+    }
+
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(p.workers[i].thread, NULL);
+    }
+
+    if (walk->unordered) {
+        List empty = {0};
+        task_stitch(t, &empty);
+    } else {
+        task_stitch(t, files);
+    }
+
+    for (size_t i = 0; i < p.nworkers; i++) {
+        // Hand the stitched nodes' memory over to files
+        if (p.workers[i].arena) {
+            if (files->arena) {
+                arena_merge(files->arena, p.workers[i].arena);
+            } else {
+                files->arena = p.workers[i].arena;
+            }
+        }
+        pthread_mutex_destroy(&p.workers[i].deque.lock);
+        free(p.workers[i].deque.tasks);
+    }
+
+cleanup:
+    pthread_cond_destroy(&p.wakeup);
+    pthread_mutex_destroy(&p.emit);
+    pthread_mutex_destroy(&p.lock);
+    free(p.workers);
+}
+
+/* Public Functions */
+
+/**
+ * Walk specified directory, calling the walk's visitor with each file system
+ * entity that matches its filter expression.
+ *
+ *  - With one job, entries are visited as soon as they are read.
+ *  - With several jobs in ordered mode, matches are collected and then
+ *    visited in the same order as a serial walk.
+ *  - With several jobs in unordered mode, matches are visited as soon as any
+ *    worker reads them, one visit at a time, in no particular order.
+ *
+ * @param   root        Directory to walk
+ * @param   walk        Pointer to Walk structure
+ **/
+void	walk_files(const char *root, Walk *walk) {
+    // Without a set, every directory is checked against those above it
+    Set seen;
+    if (walk->follow && set_init(&seen)) {
+        walk->seen = &seen;
+    }
+
+    if (walk->jobs < 2) {
+        walk_serial(root, walk, walk->visit, walk->arg);
+    } else if (walk->unordered) {
+        walk_parallel(root, walk, NULL);
+    } else {
+        List files = {0};
+        walk_parallel(root, walk, &files);
+
+        for (Node *n = files.head; n; n = n->next) {
+            Entry e;
+            entry_init(&e, n->data.string);
+            walk->visit(&e, walk->arg);
+        }
+        list_delete(&files, true);
+    }
+
+    if (walk->seen) {
+        set_destroy(walk->seen);
+        walk->seen = NULL;
+    }
+}
+
+/**
+ * Walk specified directory, adding all file system entities that match
+ * expression to specified files list.
+ * @param   root        Directory to walk
+ * @param   files       List of files found
+ * @param   expr        Filter expression (NULL keeps everything)
+ **/
+void	find_files(const char *root, List *files, Expr *expr) {
+    Walk walk = {
+        .expr    = expr,
+        .jobs    = 1,
+        .visit   = walk_collect,
+        .arg     = files,
+    };
+    walk_serial(root, &walk, walk.visit, walk.arg);
+}
+
+/**
+ * Walk specified directory with a pool of work-stealing threads, adding all
+ * file system entities that match expression to specified files list in the
+ * same order as find_files.
+ * @param   root        Directory to walk
+ * @param   files       List of files found
+ * @param   expr        Filter expression (NULL keeps everything)
+ * @param   jobs        Number of worker threads
+ **/
+void	find_files_parallel(const char *root, List *files, Expr *expr, size_t jobs) {
+    Walk walk = {
+        .expr    = expr,
+        .jobs    = jobs,
+        .visit   = walk_collect,
+        .arg     = files,
+    };
+
+    if (jobs < 2) {
+        walk_serial(root, &walk, walk.visit, walk.arg);
+    } else {
+        walk_parallel(root, &walk, files);
+    }
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
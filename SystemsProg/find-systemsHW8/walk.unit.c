@@ -0,0 +1,679 @@
+/* walk.unit.c: directory traversal unit test */
+
+#include "findit.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+#define nargs(a)    (sizeof(a) / sizeof((a)[0]))
+
+/* Functions */
+
+/**
+ * Create a tree of directories under root with fanout subdirectories and
+ * fanout files per directory, depth levels deep.
+ * @param   root        Directory to populate
+ * @param   fanout      Number of subdirectories and files per directory
+ * @param   depth       Number of levels to create
+ * @return  Number of entries created.
+ **/
+size_t make_tree(const char *root, int fanout, int depth) {
+    size_t count = 0;
+
+    for (int i = 0; i < fanout; i++) {
+        char path[BUFSIZ];
+        snprintf(path, BUFSIZ, "%s/file%d.txt", root, i);
+        int fd = open(path, O_CREAT | O_WRONLY, 0644);
+        assert(fd >= 0);
+        close(fd);
+        count++;
+
+        if (depth > 0) {
+            snprintf(path, BUFSIZ, "%s/dir%d", root, i);
+            assert(mkdir(path, 0755) == 0);
+            count += 1 + make_tree(path, fanout, depth - 1);
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Create a temporary tree for testing.
+ * @param   root        Buffer to store temporary directory path in
+ * @param   count       Number of entries created beneath root
+ **/
+void make_root(char *root, size_t *count) {
+    strcpy(root, "/tmp/walk.unit.XXXXXX");
+    assert(mkdtemp(root));
+    *count = make_tree(root, 4, 3);
+}
+
+/**
+ * Remove temporary tree.
+ * @param   root        Temporary directory path
+ **/
+void remove_root(const char *root) {
+    char command[BUFSIZ];
+    snprintf(command, BUFSIZ, "rm -fr %s", root);
+    assert(system(command) == 0);
+}
+
+/**
+ * Count nodes in List.
+ * @param   l           Pointer to List structure
+ * @return  Number of nodes.
+ **/
+size_t list_count(List *l) {
+    size_t count = 0;
+    for (Node *n = l->head; n; n = n->next) {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * Visitor that counts entries.
+ * @param   e           Pointer to Entry structure
+ * @param   arg         Pointer to count
+ **/
+void count_entry(Entry *e, void *arg) {
+    size_t *count = arg;
+    (*count)++;
+}
+
+/**
+ * Visitor that appends a copy of the entry's path to a List.
+ * @param   e           Pointer to Entry structure
+ * @param   arg         Pointer to List structure
+ **/
+void collect_entry(Entry *e, void *arg) {
+    list_append_string((List *)arg, e->path, e->length);
+}
+
+/**
+ * Count entries visited by walk of root with the given arguments.
+ * @param   root        Directory to walk
+ * @param   jobs        Number of walker threads
+ * @param   unordered   Whether or not to visit matches as found
+ * @param   argc        Number of arguments
+ * @param   argv        Arguments (global options and expression)
+ * @return  Number of entries visited.
+ **/
+size_t walk_count(const char *root, size_t jobs, bool unordered, int argc, char *argv[]) {
+    size_t visited = 0;
+    Walk walk = {
+        .jobs      = jobs,
+        .unordered = unordered,
+        .visit     = count_entry,
+        .arg       = &visited,
+    };
+    walk.expr = expr_parse(argc, argv, &walk);
+    assert(walk.expr);
+    walk_files(root, &walk);
+    expr_delete(walk.expr);
+    return visited;
+}
+
+/* Tests */
+
+int test_00_find_files() {
+    char root[BUFSIZ];
+    size_t count;
+    make_root(root, &count);
+
+    // Test: root plus every entry, root first, tail is last node
+    List l = {0};
+    find_files(root, &l, NULL);
+    assert(list_count(&l) == count + 1);
+    assert(streq(l.head->data.string, root));
+    assert(l.tail && !l.tail->next);
+
+    // Test: pre-order, so each entry's parent is the previous entry or one
+    // of its ancestors
+    for (Node *p = l.head, *n = p->next; n; p = n, n = n->next) {
+        size_t length = strrchr(n->data.string, '/') - n->data.string;
+        assert(strncmp(p->data.string, n->data.string, length) == 0);
+        assert(p->data.string[length] == 0 || p->data.string[length] == '/');
+    }
+
+    node_delete(l.head, true, true);
+    remove_root(root);
+    return EXIT_SUCCESS;
+}
+
+int test_01_find_files_parallel() {
+    char root[BUFSIZ];
+    size_t count;
+    make_root(root, &count);
+
+    List serial = {0};
+    find_files(root, &serial, NULL);
+
+    // Test: same entries in same order for several pool sizes
+    for (size_t jobs = 1; jobs <= 8; jobs *= 2) {
+        List parallel = {0};
+        find_files_parallel(root, &parallel, NULL, jobs);
+        assert(list_count(&parallel) == count + 1);
+
+        Node *s = serial.head;
+        Node *p = parallel.head;
+        while (s && p) {
+            assert(streq(s->data.string, p->data.string));
+            s = s->next;
+            p = p->next;
+        }
+        assert(!s && !p);
+        assert(parallel.tail && !parallel.tail->next);
+        node_delete(parallel.head, true, true);
+    }
+
+    // Test: filtered walks agree, even when directories are filtered out
+    char *args[] = {"-type", "f"};
+    Expr *expr = expr_parse(2, args, NULL);
+    assert(expr);
+
+    List sfiltered = {0};
+    List pfiltered = {0};
+    find_files(root, &sfiltered, expr);
+    find_files_parallel(root, &pfiltered, expr, 4);
+    Node *s = sfiltered.head;
+    Node *p = pfiltered.head;
+    while (s && p) {
+        assert(streq(s->data.string, p->data.string));
+        s = s->next;
+        p = p->next;
+    }
+    assert(!s && !p);
+    assert(pfiltered.tail && !pfiltered.tail->next);
+    node_delete(sfiltered.head, true, true);
+    node_delete(pfiltered.head, true, true);
+    expr_delete(expr);
+
+    // Test: non-directory root
+    List single = {0};
+    find_files_parallel("Makefile", &single, NULL, 4);
+    assert(single.head && single.head == single.tail);
+    assert(streq(single.head->data.string, "Makefile"));
+    node_delete(single.head, true, true);
+
+    node_delete(serial.head, true, true);
+    remove_root(root);
+    return EXIT_SUCCESS;
+}
+
+int test_02_find_files_long() {
+    char root[BUFSIZ];
+    strcpy(root, "/tmp/walk.unit.XXXXXX");
+    assert(mkdtemp(root));
+
+    // Create a chain of directories whose full path is longer than BUFSIZ
+    char name[201];
+    memset(name, 'd', 200);
+    name[200] = 0;
+
+    int dirfd = open(root, O_RDONLY | O_DIRECTORY);
+    int levels = BUFSIZ / 200 + 2;
+    for (int i = 0; i < levels; i++) {
+        assert(mkdirat(dirfd, name, 0755) == 0);
+        int sub = openat(dirfd, name, O_RDONLY | O_DIRECTORY);
+        assert(sub >= 0);
+        close(dirfd);
+        dirfd = sub;
+    }
+    close(dirfd);
+
+    // Test: deepest path is complete for serial and parallel walks
+    size_t expected = strlen(root) + levels * 201;
+    for (size_t jobs = 1; jobs <= 4; jobs *= 4) {
+        List l = {0};
+        find_files_parallel(root, &l, NULL, jobs);
+        assert(list_count(&l) == levels + 1);
+        assert(strlen(l.tail->data.string) == expected);
+        assert(strncmp(l.tail->data.string, root, strlen(root)) == 0);
+        node_delete(l.head, true, true);
+    }
+
+    remove_root(root);
+    return EXIT_SUCCESS;
+}
+
+int test_03_walk_files() {
+    char root[BUFSIZ];
+    size_t count;
+    make_root(root, &count);
+
+    // Test: every mode visits root plus every entry exactly once
+    for (size_t jobs = 1; jobs <= 4; jobs++) {
+        for (int unordered = 0; unordered < 2; unordered++) {
+            size_t visited = 0;
+            Walk walk = {
+                .jobs      = jobs,
+                .unordered = unordered,
+                .visit     = count_entry,
+                .arg       = &visited,
+            };
+            walk_files(root, &walk);
+            assert(visited == count + 1);
+        }
+    }
+
+    // Test: readdir and getdents64 (with a tiny buffer) agree
+    for (int libc = 0; libc < 2; libc++) {
+        size_t visited = 0;
+        Walk walk = {
+            .jobs    = 1,
+            .dirbuf  = DIR_MINIMUM,
+            .readdir = libc,
+            .visit   = count_entry,
+            .arg     = &visited,
+        };
+        walk_files(root, &walk);
+        assert(visited == count + 1);
+    }
+
+    // Test: filters apply before visiting
+    char *args[] = {"-type", "d"};
+    Expr *expr = expr_parse(2, args, NULL);
+    assert(expr);
+
+    size_t directories = 0;
+    Walk walk = {
+        .expr      = expr,
+        .jobs      = 3,
+        .unordered = true,
+        .visit     = count_entry,
+        .arg       = &directories,
+    };
+    walk_files(root, &walk);
+    assert(directories == 1 + 4 + 16 + 64);
+
+    expr_delete(expr);
+    remove_root(root);
+    return EXIT_SUCCESS;
+}
+
+int test_04_walk_limits() {
+    char root[BUFSIZ];
+    size_t count;
+    make_root(root, &count);
+
+    char *depth0[]  = {"-maxdepth", "0"};
+    char *depth2[]  = {"-maxdepth", "2"};
+    char *deepest[] = {"-mindepth", "4"};
+    char *level1[]  = {"-mindepth", "1", "-maxdepth", "1"};
+    char *pruned[]  = {"-name", "dir0", "-prune"};
+    char *outside[] = {"-name", "dir0", "-prune", "-o", "-type", "f"};
+    char *shallow[] = {"-maxdepth", "1", "-prune"};
+    char *xdev[]    = {"-xdev"};
+
+    for (size_t jobs = 1; jobs <= 4; jobs++) {
+        for (int unordered = 0; unordered < 2; unordered++) {
+            // Test: depth limits (4 + 4 entries per directory, 4 levels)
+            assert(walk_count(root, jobs, unordered, nargs(depth0), depth0) == 1);
+            assert(walk_count(root, jobs, unordered, nargs(depth2), depth2) == 1 + 8 + 32);
+            assert(walk_count(root, jobs, unordered, nargs(deepest), deepest) == 256);
+            assert(walk_count(root, jobs, unordered, nargs(level1), level1) == 8);
+
+            // Test: pruned directories are visited but not walked
+            assert(walk_count(root, jobs, unordered, nargs(pruned), pruned) == 1 + 3 + 9);
+            assert(walk_count(root, jobs, unordered, nargs(outside), outside) == 13 + 4 + 12 + 36 + 108);
+            assert(walk_count(root, jobs, unordered, nargs(shallow), shallow) == 1);
+
+            // Test: a single file system is walked in full
+            assert(walk_count(root, jobs, unordered, nargs(xdev), xdev) == count + 1);
+        }
+    }
+
+    remove_root(root);
+    return EXIT_SUCCESS;
+}
+
+int test_05_walk_deep() {
+    char root[BUFSIZ];
+    strcpy(root, "/tmp/walk.unit.XXXXXX");
+    assert(mkdtemp(root));
+
+    // Create a chain of 10000 directories, each also holding a file
+    int dirfd  = open(root, O_RDONLY | O_DIRECTORY);
+    int levels = 10000;
+    for (int i = 0; i < levels; i++) {
+        int fd = openat(dirfd, "f", O_CREAT | O_WRONLY, 0644);
+        assert(fd >= 0);
+        close(fd);
+        assert(mkdirat(dirfd, "d", 0755) == 0);
+        int sub = openat(dirfd, "d", O_RDONLY | O_DIRECTORY);
+        assert(sub >= 0);
+        close(dirfd);
+        dirfd = sub;
+    }
+    close(dirfd);
+
+    // Test: every level is walked with far fewer descriptors than levels
+    struct rlimit limit;
+    assert(getrlimit(RLIMIT_NOFILE, &limit) == 0);
+    struct rlimit lowered = {512, limit.rlim_max};
+    assert(setrlimit(RLIMIT_NOFILE, &lowered) == 0);
+
+    for (size_t jobs = 1; jobs <= 4; jobs *= 4) {
+        for (int unordered = 0; unordered < 2; unordered++) {
+            size_t visited = 0;
+            Walk walk = {
+                .jobs      = jobs,
+                .unordered = unordered,
+                .visit     = count_entry,
+                .arg       = &visited,
+            };
+            walk_files(root, &walk);
+            assert(visited == 2 * levels + 1);
+        }
+    }
+
+    // Test: depth limits still apply deep down
+    char *deepest[] = {"-mindepth", "9999", "-type", "d"};
+    assert(walk_count(root, 1, false, nargs(deepest), deepest) == 2);
+
+    // Test: following links, closed directories are reopened by path
+    char *follow[] = {"-L"};
+    assert(walk_count(root, 1, false, nargs(follow), follow) == 2 * levels + 1);
+
+    // Test: entries read ahead survive their directory being closed
+    char *batched[] = {"-uring", "-mtime", "-1"};
+    char *linked[]  = {"-uring", "-L", "-type", "f"};
+    assert(walk_count(root, 1, false, nargs(batched), batched) == 2 * levels + 1);
+    assert(walk_count(root, 1, false, nargs(linked), linked) == levels);
+
+    assert(setrlimit(RLIMIT_NOFILE, &limit) == 0);
+    remove_root(root);
+    return EXIT_SUCCESS;
+}
+
+int test_06_walk_follow() {
+    char root[] = "/tmp/walk.unit.XXXXXX";
+    char path[BUFSIZ];
+    assert(mkdtemp(root));
+
+    // Fixture: loops back to root and to itself, two more routes into a/b,
+    // and a broken link
+    const char *dirs[]  = {"a", "a/b", "a/b/c", "x"};
+    const char *files[] = {"a/b/c/f", "x/g"};
+    const char *links[][2] = {
+        {"../..", "a/b/up"}, {"b", "a/link"}, {"../a", "x/toa"},
+        {"missing", "dangling"}, {".", "self"},
+    };
+    for (size_t i = 0; i < nargs(dirs); i++) {
+        snprintf(path, BUFSIZ, "%s/%s", root, dirs[i]);
+        assert(mkdir(path, 0755) == 0);
+    }
+    for (size_t i = 0; i < nargs(files); i++) {
+        snprintf(path, BUFSIZ, "%s/%s", root, files[i]);
+        int fd = open(path, O_CREAT | O_WRONLY, 0644);
+        assert(fd >= 0);
+        close(fd);
+    }
+    for (size_t i = 0; i < nargs(links); i++) {
+        snprintf(path, BUFSIZ, "%s/%s", root, links[i][1]);
+        assert(symlink(links[i][0], path) == 0);
+    }
+
+    // Test: links are not followed by default
+    assert(walk_count(root, 1, false, 0, NULL) == 12);
+
+    // Test: loops are left out, every other route is walked, and ordered
+    // parallel walks agree with the serial walk
+    char *follow[] = {"-L"};
+    char *types[]  = {"-L", "-type", "d"};
+    char *broken[] = {"-L", "-type", "l"};
+    char *batched[] = {"-L", "-uring", "-mtime", "-1"};
+    List  serial   = {0};
+    Walk  walk     = {.jobs = 1, .follow = true, .visit = collect_entry, .arg = &serial};
+    walk_files(root, &walk);
+    assert(list_count(&serial) == 18);
+    assert(!walk.seen);
+
+    for (size_t jobs = 1; jobs <= 4; jobs++) {
+        for (int unordered = 0; unordered < 2; unordered++) {
+            assert(walk_count(root, jobs, unordered, nargs(follow), follow) == 18);
+            assert(walk_count(root, jobs, unordered, nargs(types), types) == 12);
+            assert(walk_count(root, jobs, unordered, nargs(broken), broken) == 1);
+            assert(walk_count(root, jobs, unordered, nargs(batched), batched) == 18);
+        }
+
+        List parallel = {0};
+        walk.jobs = jobs;
+        walk.arg  = &parallel;
+        walk_files(root, &walk);
+        Node *n = serial.head;
+        Node *m = parallel.head;
+        for (; n && m; n = n->next, m = m->next) {
+            assert(streq(n->data.string, m->data.string));
+        }
+        assert(!n && !m);
+        list_delete(&parallel, true);
+    }
+    list_delete(&serial, true);
+
+    remove_root(root);
+    return EXIT_SUCCESS;
+}
+
+int test_07_walk_uring() {
+    char root[sizeof("/tmp/walk.unit.XXXXXX")];
+    char path[BUFSIZ];
+    size_t count;
+    make_root(root, &count);
+
+    // Fixture: one directory with several batches of entries, and a link
+    for (int i = 0; i < 3 * RING_ENTRIES; i++) {
+        snprintf(path, BUFSIZ, "%s/dir1/many%d", root, i);
+        int fd = open(path, O_CREAT | O_WRONLY, 0644);
+        assert(fd >= 0 && ftruncate(fd, i) == 0);
+        close(fd);
+    }
+    snprintf(path, BUFSIZ, "%s/dir2/link", root);
+    assert(symlink("../dir1", path) == 0);
+    count += 3 * RING_ENTRIES + 1;
+
+    // Test: batched stats give the same walk, in the same order
+    char *expressions[][4] = {
+        {"-uring"},
+        {"-uring", "-size", "-100c"},
+        {"-uring", "-type", "f"},
+        {"-uring", "-empty"},
+        {"-uring", "-L", "-type", "d"},
+        {"-uring", "-xdev", "-newer", root},
+    };
+    for (size_t i = 0; i < nargs(expressions); i++) {
+        int argc = 0;
+        while (argc < 4 && expressions[i][argc]) argc++;
+
+        for (size_t jobs = 1; jobs <= 3; jobs += 2) {
+            List expected = {0};
+            List actual   = {0};
+            Walk walk     = {.jobs = jobs, .visit = collect_entry, .arg = &expected};
+
+            walk.expr = expr_parse(argc - 1, expressions[i] + 1, &walk);
+            assert(walk.expr && !walk.uring);
+            walk_files(root, &walk);
+            expr_delete(walk.expr);
+
+            walk.arg  = &actual;
+            walk.expr = expr_parse(argc, expressions[i], &walk);
+            assert(walk.expr && walk.uring);
+            walk_files(root, &walk);
+            expr_delete(walk.expr);
+
+            Node *n = expected.head;
+            Node *m = actual.head;
+            for (; n && m; n = n->next, m = m->next) {
+                assert(streq(n->data.string, m->data.string));
+            }
+            assert(!n && !m);
+            list_delete(&expected, true);
+            list_delete(&actual, true);
+        }
+    }
+    char *every[] = {"-uring"};
+    assert(walk_count(root, 1, false, nargs(every), every) == count + 1);
+
+    remove_root(root);
+    return EXIT_SUCCESS;
+}
+
+/* Directory outside the tree that swap_entry links to */
+char Outside[] = "/tmp/walk.unit.XXXXXX";
+
+/**
+ * Visitor that collects entries like collect_entry, and swaps each directory
+ * named "a" for a link to Outside as its entry is visited.
+ * @param   e           Pointer to Entry structure
+ * @param   arg         Pointer to List structure
+ **/
+void swap_entry(Entry *e, void *arg) {
+    char moved[BUFSIZ];
+    collect_entry(e, arg);
+    if (!streq(e->name, "a")) return;
+    snprintf(moved, BUFSIZ, "%s.moved", e->path);
+    assert(rename(e->path, moved) == 0);
+    assert(symlink(Outside, e->path) == 0);
+}
+
+int test_08_walk_swapped() {
+    char root[] = "/tmp/walk.unit.XXXXXX";
+    char path[BUFSIZ];
+    assert(mkdtemp(root) && mkdtemp(Outside));
+
+    // Fixture: a directory to swap out, and a file outside the tree
+    snprintf(path, BUFSIZ, "%s/a", root);
+    assert(mkdir(path, 0755) == 0);
+    snprintf(path, BUFSIZ, "%s/secret", Outside);
+    int fd = open(path, O_CREAT | O_WRONLY, 0644);
+    assert(fd >= 0);
+    close(fd);
+
+    // Test: a directory swapped for a link after it was listed is skipped
+    // by the task that reopens it, so the walk stays inside root
+    List l    = {0};
+    Walk walk = {.jobs = 2, .unordered = true, .visit = swap_entry, .arg = &l};
+    walk_files(root, &walk);
+    assert(list_count(&l) == 2);
+    for (Node *n = l.head; n; n = n->next) {
+        assert(!strstr(n->data.string, "secret"));
+    }
+    list_delete(&l, true);
+
+    remove_root(Outside);
+    remove_root(root);
+    return EXIT_SUCCESS;
+}
+
+/* Directory that move_entry moves out of the way, and where to */
+char Moving[BUFSIZ];
+char Moved[BUFSIZ];
+
+/**
+ * Visitor that counts entries like count_entry, and moves Moving to Moved
+ * once the walk is inside it.
+ * @param   e           Pointer to Entry structure
+ * @param   arg         Pointer to count
+ **/
+void move_entry(Entry *e, void *arg) {
+    size_t length = strlen(Moving);
+    count_entry(e, arg);
+    if (strncmp(e->path, Moving, length) == 0 && e->path[length] == '/' && access(Moving, F_OK) == 0) {
+        assert(rename(Moving, Moved) == 0);
+    }
+}
+
+int test_09_walk_moved() {
+    char root[] = "/tmp/walk.unit.XXXXXX";
+    assert(mkdtemp(root));
+
+    // Create a chain of directories, each also holding several files, so
+    // that some files come after the directory when it is read
+    int dirfd  = open(root, O_RDONLY | O_DIRECTORY);
+    int levels = 200;
+    int files  = 8;
+    for (int i = 0; i < levels; i++) {
+        for (int j = 0; j < files; j++) {
+            char name[] = "f0";
+            name[1] += j;
+            int fd = openat(dirfd, name, O_CREAT | O_WRONLY, 0644);
+            assert(fd >= 0);
+            close(fd);
+        }
+        assert(mkdirat(dirfd, "d", 0755) == 0);
+        int sub = openat(dirfd, "d", O_RDONLY | O_DIRECTORY);
+        assert(sub >= 0);
+        close(dirfd);
+        dirfd = sub;
+    }
+    close(dirfd);
+
+    // Test: when a closed directory's child is moved away, ".." of the child
+    // no longer leads back to it, so it is reopened by path and the rest of
+    // it and of its ancestors is still walked (the chain is deep enough that
+    // Moving's parent is closed before the walk returns to it)
+    snprintf(Moving, BUFSIZ, "%s/d/d/d/d/d/d/d/d/d/d", root);
+    snprintf(Moved, BUFSIZ, "%s/moved", root);
+    size_t visited = 0;
+    Walk   walk    = {.jobs = 1, .visit = move_entry, .arg = &visited};
+    walk_files(root, &walk);
+    assert(access(Moved, F_OK) == 0);
+    assert(visited == (size_t)levels * (files + 1) + 1);
+
+    remove_root(root);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test find_files\n");
+        fprintf(stderr, "    1  Test find_files_parallel\n");
+        fprintf(stderr, "    2  Test find_files with long paths\n");
+        fprintf(stderr, "    3  Test walk_files\n");
+        fprintf(stderr, "    4  Test walk_files depth limits and pruning\n");
+        fprintf(stderr, "    5  Test walk_files on a very deep tree\n");
+        fprintf(stderr, "    6  Test walk_files following symbolic links\n");
+        fprintf(stderr, "    7  Test walk_files with batched stats\n");
+        fprintf(stderr, "    8  Test walk_files on a directory swapped for a link\n");
+        fprintf(stderr, "    9  Test walk_files on a directory moved during the walk\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_find_files(); break;
+        case 1:  status = test_01_find_files_parallel(); break;
+        case 2:  status = test_02_find_files_long(); break;
+        case 3:  status = test_03_walk_files(); break;
+        case 4:  status = test_04_walk_limits(); break;
+        case 5:  status = test_05_walk_deep(); break;
+        case 6:  status = test_06_walk_follow(); break;
+        case 7:  status = test_07_walk_uring(); break;
+        case 8:  status = test_08_walk_swapped(); break;
+        case 9:  status = test_09_walk_moved(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,444 @@
+/* watch.c: Follow changes beneath a walked directory through inotify */
+
+#include "findit.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+
+/* Constants */
+
+#define WATCH_MASK  (IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | \
+                     IN_ONLYDIR | IN_EXCL_UNLINK)
+
+/* Table Functions */
+
+static size_t watch_hash(int wd, size_t capacity) {
+    return ((uint32_t)wd * 2654435761u) & (capacity - 1);
+}
+
+/**
+ * Look up directory by watch descriptor.
+ * @param   w           Pointer to Watch structure
+ * @param   wd          Watch descriptor
+ * @return  Pointer to slot (NULL if not watched).
+ **/
+static WatchSlot *watch_find(Watch *w, int wd) {
+    for (size_t i = watch_hash(wd, w->capacity); w->slots[i].wd; i = (i + 1) & (w->capacity - 1)) {
+        if (w->slots[i].wd == wd) return &w->slots[i];
+    }
+    return NULL;
+}
+
+/**
+ * Return slot for watch descriptor, claiming an empty one (and growing the
+ * table past half full) if it is not watched yet.
+ * @param   w           Pointer to Watch structure
+ * @param   wd          Watch descriptor
+ * @return  Pointer to slot (NULL if the table could not grow).
+ **/
+static WatchSlot *watch_insert(Watch *w, int wd) {
+    WatchSlot *s = watch_find(w, wd);
+    if (s) return s;
+
+    if (2 * (w->count + 1) > w->capacity) {
+        size_t     capacity = 2 * w->capacity;
+        WatchSlot *slots    = calloc(capacity, sizeof(WatchSlot));
+        if (!slots) return NULL;
+
+        for (size_t i = 0; i < w->capacity; i++) {
+            if (!w->slots[i].wd) continue;
+            size_t j = watch_hash(w->slots[i].wd, capacity);
+            while (slots[j].wd) j = (j + 1) & (capacity - 1);
+            slots[j] = w->slots[i];
+        }
+        free(w->slots);
+        w->slots    = slots;
+        w->capacity = capacity;
+    }
+
+    size_t i = watch_hash(wd, w->capacity);
+    while (w->slots[i].wd) i = (i + 1) & (w->capacity - 1);
+    w->slots[i] = (WatchSlot){.wd = wd, .parent = -1};
+    w->count++;
+    return &w->slots[i];
+}
+
+/**
+ * Forget directory, shifting later slots of its probe run back so lookups
+ * never need tombstones.
+ * @param   w           Pointer to Watch structure
+ * @param   wd          Watch descriptor
+ **/
+static void watch_erase(Watch *w, int wd) {
+    WatchSlot *s = watch_find(w, wd);
+    if (!s) return;
+
+    size_t mask = w->capacity - 1;
+    size_t i    = s - w->slots;
+    free(s->name);
+    for (size_t j = (i + 1) & mask; w->slots[j].wd; j = (j + 1) & mask) {
+        size_t home = watch_hash(w->slots[j].wd, w->capacity);
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            w->slots[i] = w->slots[j];
+            i = j;
+        }
+    }
+    w->slots[i] = (WatchSlot){0};
+    w->count--;
+}
+
+/* Watch Functions */
+
+/**
+ * Rebuild path of directory into w->path from its chain of parents.
+ * @param   w           Pointer to Watch structure
+ * @param   wd          Watch descriptor of directory
+ * @return  Whether or not every directory up to root is still watched.
+ **/
+static bool watch_path(Watch *w, int wd) {
+    WatchSlot *s = watch_find(w, wd);
+    if (!s) return false;
+    if (s->parent < 0) {
+        path_pop(&w->path, w->rootlen);
+        return true;
+    }
+    return watch_path(w, s->parent) && path_push(&w->path, s->name);
+}
+
+/**
+ * Write path to output preceded by sign ('+' for a new match, '-' for a
+ * removed one) and a space.
+ * @param   w           Pointer to Watch structure
+ * @param   sign        Kind of change
+ * @param   path        Path that changed
+ * @param   n           Length of path
+ **/
+static void watch_emit(Watch *w, char sign, const char *path, size_t n) {
+    if (n + 2 > w->recordsize) {
+        size_t size   = 2 * w->recordsize > n + 2 ? 2 * w->recordsize : n + 2;
+        char  *record = realloc(w->record, size);
+        if (!record) return;
+        w->record     = record;
+        w->recordsize = size;
+    }
+    w->record[0] = sign;
+    w->record[1] = ' ';
+    memcpy(w->record + 2, path, n);
+    output_write(w->output, w->record, n + 2);
+}
+
+/**
+ * Visitor that reports matches in a directory created (or moved in) while
+ * watching.
+ * @param   e           Pointer to Entry structure
+ * @param   arg         Pointer to Watch structure
+ **/
+static void watch_visit(Entry *e, void *arg) {
+    watch_emit(arg, '+', e->path, e->length);
+}
+
+/**
+ * Determine whether the walk would prune directory at path.
+ * @param   w           Pointer to Watch structure
+ * @param   path        Path to directory
+ * @param   depth       Depth of directory below root
+ * @return  Whether or not directory is pruned.
+ **/
+static bool watch_pruned(Watch *w, const char *path, size_t depth) {
+    Walk *walk = w->walk;
+    if (!walk->expr || !walk->expr->effect || depth < walk->mindepth) return false;
+
+    Entry e;
+    entry_init(&e, path);
+    expr_evaluate(walk->expr, &e);
+    return e.prune;
+}
+
+/**
+ * Watch directory at path and every directory beneath it that the walk would
+ * read.  Symbolic links are never followed (except at root).
+ * @param   w           Pointer to Watch structure
+ * @param   path        Path to directory (restored on return)
+ * @param   parent      Watch descriptor of parent (-1 for root)
+ * @param   depth       Depth of directory below root
+ * @param   name        Name of directory within parent (root path for root)
+ * @return  Watch descriptor of directory (or -1 if not watched).
+ **/
+static int watch_tree(Watch *w, Path *path, int parent, size_t depth, const char *name) {
+    Walk *walk = w->walk;
+
+    // Directories whose entries would not be visited are never read
+    if (walk->maxdepth && depth + 1 >= walk->maxdepth) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    // Watch before reading, so entries added meanwhile are not missed
+    int wd = inotify_add_watch(w->fd, path->data, WATCH_MASK | (parent < 0 ? 0 : IN_DONT_FOLLOW));
+    if (wd < 0) {
+        if (errno == ENOSPC && !w->full) {
+            fprintf(stderr, "findit: %s: inotify watch limit reached, not watching further directories\n", path->data);
+            w->full = true;
+        }
+        return -1;
+    }
+
+    char      *copy = strdup(name);
+    WatchSlot *s    = copy ? watch_insert(w, wd) : NULL;
+    if (!s) {
+        free(copy);
+        inotify_rm_watch(w->fd, wd);
+        return -1;
+    }
+    free(s->name);
+    s->parent = parent;
+    s->depth  = depth;
+    s->name   = copy;
+
+    int fd = open(path->data, O_RDONLY | O_DIRECTORY | O_CLOEXEC | (parent < 0 ? 0 : O_NOFOLLOW));
+    Dir d;
+    if (fd < 0 || !dir_open(&d, fd, walk->dirbuf, walk->readdir)) return wd;
+
+    int           dfd    = dir_fd(&d);
+    size_t        length = path->length;
+    const char   *child;
+    unsigned char type;
+    struct stat   st;
+
+    while (dir_read(&d, &child, &type)) {
+        if (streq(child, ".") || streq(child, "..")) continue;
+        if (type != DT_DIR && type != DT_UNKNOWN) continue;
+
+        if (type == DT_UNKNOWN || walk->xdev) {
+            if (fstatat(dfd, child, &st, AT_SYMLINK_NOFOLLOW) < 0 || !S_ISDIR(st.st_mode)) continue;
+            if (walk->xdev && st.st_dev != w->dev) continue;
+        }
+
+        if (!path_push(path, child)) continue;
+        if (!watch_pruned(w, path->data, depth + 1)) {
+            watch_tree(w, path, wd, depth + 1, child);
+        }
+        path_pop(path, length);
+    }
+
+    dir_close(&d);
+    return wd;
+}
+
+/**
+ * Stop watching subdirectory name of parent and everything beneath it (as
+ * when it is moved away).  Finding descendants scans the whole table, which
+ * only happens for directories moved out from under a watched one.
+ * @param   w           Pointer to Watch structure
+ * @param   parent      Watch descriptor of parent
+ * @param   name        Name of subdirectory
+ **/
+static void watch_forget(Watch *w, int parent, const char *name) {
+    int top = -1;
+    for (size_t i = 0; i < w->capacity && top < 0; i++) {
+        if (w->slots[i].wd && w->slots[i].parent == parent && streq(w->slots[i].name, name)) {
+            top = w->slots[i].wd;
+        }
+    }
+    if (top < 0) return;
+
+    int   *doomed = malloc(w->count * sizeof(int));
+    size_t n      = 0;
+    if (!doomed) return;
+
+    for (size_t i = 0; i < w->capacity; i++) {
+        WatchSlot *s = &w->slots[i];
+        while (s && s->wd != top) {
+            s = s->parent < 0 ? NULL : watch_find(w, s->parent);
+        }
+        if (s) doomed[n++] = w->slots[i].wd;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        inotify_rm_watch(w->fd, doomed[i]);
+        watch_erase(w, doomed[i]);
+    }
+    free(doomed);
+}
+
+/**
+ * Report what an inotify event changed about the set of matches.
+ *
+ *  - Created, moved in, or rewritten entries are reported if they match now.
+ *    Regular files just created are left until they are closed, so they are
+ *    tested with their contents in place.
+ *
+ *  - New directories are watched, and everything in them that matches is
+ *    reported, as the walk would have.
+ *
+ *  - Removed or moved away entries can no longer be stat'd, so they are
+ *    tested as an empty regular file (or directory) of the same name.
+ *
+ * @param   w           Pointer to Watch structure
+ * @param   e           Pointer to inotify_event structure
+ **/
+static void watch_event(Watch *w, const struct inotify_event *e) {
+    Walk *walk = w->walk;
+
+    if (e->mask & IN_Q_OVERFLOW) {
+        path_pop(&w->path, w->rootlen);
+        fprintf(stderr, "findit: %s: inotify queue overflowed, changes were lost\n", w->path.data);
+        return;
+    }
+
+    WatchSlot *dir = watch_find(w, e->wd);
+    if (!dir) return;
+
+    if (e->mask & IN_IGNORED) {
+        if (e->wd == w->root) w->root = -1;
+        watch_erase(w, e->wd);
+        return;
+    }
+    if (!e->len) return;
+
+    size_t depth = dir->depth + 1;
+    if (!watch_path(w, e->wd) || !path_push(&w->path, e->name)) return;
+
+    Entry entry;
+    entry_init(&entry, w->path.data);
+    entry.follow = walk->follow;
+
+    if (e->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        // Deleted directories leave the table through their own IN_IGNORED
+        if ((e->mask & IN_ISDIR) && (e->mask & IN_MOVED_FROM)) {
+            watch_forget(w, e->wd, e->name);
+        }
+
+        memset(&entry.st, 0, sizeof(struct stat));
+        entry.st.st_mode = e->mask & IN_ISDIR ? S_IFDIR : S_IFREG;
+        entry.type       = e->mask & IN_ISDIR ? DT_DIR : DT_REG;
+        entry.status     = 1;
+        if (depth >= walk->mindepth && expr_evaluate(walk->expr, &entry)) {
+            watch_emit(w, '-', w->path.data, w->path.length);
+        }
+        return;
+    }
+
+    if (e->mask & IN_ISDIR) {
+        if (!(e->mask & (IN_CREATE | IN_MOVED_TO))) return;
+
+        // Walk new directory as a subtree of root (so depths still count from root)
+        if (!watch_pruned(w, w->path.data, depth)) {
+            watch_tree(w, &w->path, e->wd, depth, e->name);
+        }
+
+        Walk sub      = *walk;
+        sub.mindepth  = walk->mindepth > depth ? walk->mindepth - depth : 0;
+        sub.maxdepth  = walk->maxdepth ? walk->maxdepth - depth : 0;
+        sub.seen      = NULL;
+        sub.visit     = watch_visit;
+        sub.arg       = w;
+        walk_files(w->path.data, &sub);
+        return;
+    }
+
+    struct stat *st = entry_stat(&entry);
+    if ((e->mask & IN_CREATE) && st && S_ISREG(st->st_mode) && st->st_nlink == 1) {
+        return;
+    }
+    if (depth >= walk->mindepth && expr_evaluate(walk->expr, &entry)) {
+        watch_emit(w, '+', w->path.data, w->path.length);
+    }
+}
+
+/**
+ * Start watching root and every directory beneath it that walk would read,
+ * for changes to be reported to output.  The table keeps only each
+ * directory's name and parent, so memory grows with the number of
+ * directories and not the length of their paths; directories past the
+ * inotify watch limit are skipped with a warning.
+ * @param   w           Pointer to Watch structure
+ * @param   root        Directory to watch
+ * @param   walk        Pointer to Walk structure (expression and options)
+ * @param   output      Pointer to Output structure
+ * @return  Whether or not root is being watched.
+ **/
+bool    watch_open(Watch *w, const char *root, Walk *walk, Output *output) {
+    memset(w, 0, sizeof(Watch));
+    w->fd       = -1;
+    w->walk     = walk;
+    w->output   = output;
+    w->capacity = WATCH_CAPACITY;
+    w->root     = -1;
+
+    struct stat st;
+    if (stat(root, &st) < 0) goto failure;
+    w->dev = st.st_dev;
+
+    w->slots  = calloc(w->capacity, sizeof(WatchSlot));
+    w->buffer = malloc(WATCH_BUFSIZE);
+    if (!w->slots || !w->buffer || !path_init(&w->path, root)) goto failure;
+    w->rootlen = w->path.length;
+
+    if ((w->fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK)) < 0) goto failure;
+    if ((w->root = watch_tree(w, &w->path, -1, 0, root)) < 0) goto failure;
+    return true;
+
+failure:
+    {
+        int error = errno;
+        watch_close(w);
+        errno = error;
+    }
+    return false;
+}
+
+/**
+ * Wait up to timeout milliseconds (forever if negative) for changes, and
+ * report those that arrived.
+ * @param   w           Pointer to Watch structure
+ * @param   timeout     Milliseconds to wait
+ * @return  Whether or not to keep watching (false once root is gone or
+ *          output fails).
+ **/
+bool    watch_poll(Watch *w, int timeout) {
+    struct pollfd p = {.fd = w->fd, .events = POLLIN};
+
+    if (poll(&p, 1, timeout) < 0) return errno == EINTR;
+
+    ssize_t n = read(w->fd, w->buffer, WATCH_BUFSIZE);
+    if (n < 0 && errno != EAGAIN && errno != EINTR) return false;
+
+    for (ssize_t offset = 0; offset < n; ) {
+        const struct inotify_event *e = (const struct inotify_event *)(w->buffer + offset);
+        watch_event(w, e);
+        offset += sizeof(struct inotify_event) + e->len;
+    }
+
+    return output_flush(w->output) && w->root >= 0;
+}
+
+/**
+ * Stop watching and release table.
+ * @param   w           Pointer to Watch structure
+ **/
+void    watch_close(Watch *w) {
+    for (size_t i = 0; w->slots && i < w->capacity; i++) {
+        free(w->slots[i].name);
+    }
+    if (w->fd >= 0) close(w->fd);
+    free(w->slots);
+    free(w->buffer);
+    free(w->path.data);
+    free(w->record);
+    memset(w, 0, sizeof(Watch));
+    w->fd   = -1;
+    w->root = -1;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,266 @@
+/* watch.unit.c: inotify watch unit test */
+
+#include "findit.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+
+#define DIRECTORIES 1000
+
+/* Structures */
+
+typedef struct {
+    char    root[sizeof("/tmp/watch.unit.XXXXXX")]; // Directory watched
+    char    log[sizeof("/tmp/watch.log.XXXXXX")];   // File output is written to
+    int     fd;             // Descriptor of log
+    off_t   offset;         // Bytes of log already checked
+    Output  output;         // Output written to log
+    Walk    walk;           // Expression and options
+    Watch   watch;          // Watch on root
+} Fixture;
+
+/* Functions */
+
+/**
+ * Create empty root and log, and watch root with expression.
+ * @param   f           Pointer to Fixture structure
+ * @param   argv        Expression arguments (NULL-terminated)
+ **/
+void fixture_open(Fixture *f, char *argv[]) {
+    memset(f, 0, sizeof(Fixture));
+    strcpy(f->root, "/tmp/watch.unit.XXXXXX");
+    strcpy(f->log, "/tmp/watch.log.XXXXXX");
+    assert(mkdtemp(f->root));
+    assert((f->fd = mkstemp(f->log)) >= 0);
+    assert(chdir(f->root) == 0);
+
+    int argc = 0;
+    while (argv[argc]) argc++;
+    f->walk.jobs = 1;
+    assert((f->walk.expr = expr_parse(argc, argv, &f->walk)));
+    assert(output_open(&f->output, f->fd, 0, '\n'));
+    assert(watch_open(&f->watch, ".", &f->walk, &f->output));
+}
+
+/**
+ * Compare strings through pointers, for qsort.
+ **/
+int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/**
+ * Sort lines of text in place.
+ * @param   text        Newline-terminated lines
+ **/
+void sort_lines(char *text) {
+    char   copy[BUFSIZ];
+    char  *lines[BUFSIZ];
+    size_t n = 0;
+
+    strcpy(copy, text);
+    for (char *line = strtok(copy, "\n"); line; line = strtok(NULL, "\n")) {
+        lines[n++] = line;
+    }
+    qsort(lines, n, sizeof(char *), compare_strings);
+
+    text[0] = 0;
+    for (size_t i = 0; i < n; i++) {
+        strcat(strcat(text, lines[i]), "\n");
+    }
+}
+
+/**
+ * Let watch report pending changes, then check that exactly expected was
+ * reported since the last check (in any order, as directories are read in
+ * no particular order).
+ * @param   f           Pointer to Fixture structure
+ * @param   expected    Lines expected
+ * @return  Whether or not root is still watched.
+ **/
+bool reported(Fixture *f, const char *expected) {
+    bool watching = true;
+    for (int i = 0; i < 3 && watching; i++) {
+        watching = watch_poll(&f->watch, 20);
+    }
+
+    char    buffer[BUFSIZ];
+    char    wanted[BUFSIZ];
+    ssize_t n = pread(f->fd, buffer, sizeof(buffer) - 1, f->offset);
+    assert(n >= 0);
+    buffer[n] = 0;
+    f->offset += n;
+
+    strcpy(wanted, expected);
+    sort_lines(wanted);
+    sort_lines(buffer);
+    if (!streq(buffer, wanted)) {
+        fprintf(stderr, "expected:\n%sreported:\n%s", wanted, buffer);
+        assert(false);
+    }
+    return watching;
+}
+
+/**
+ * Create file with contents.
+ * @param   path        Path of file
+ * @param   contents    Contents
+ **/
+void write_file(const char *path, const char *contents) {
+    FILE *stream = fopen(path, "w");
+    assert(stream);
+    fputs(contents, stream);
+    fclose(stream);
+}
+
+/**
+ * Stop watching, remove root and log.
+ * @param   f           Pointer to Fixture structure
+ **/
+void fixture_close(Fixture *f) {
+    char command[BUFSIZ];
+
+    watch_close(&f->watch);
+    assert(f->watch.fd < 0 && !f->watch.slots);
+    expr_delete(f->walk.expr);
+    output_close(&f->output);
+    unlink(f->log);
+
+    assert(chdir("/") == 0);
+    snprintf(command, BUFSIZ, "rm -fr %s", f->root);
+    assert(system(command) == 0);
+}
+
+/* Tests */
+
+int test_00_watch_events() {
+    Fixture f;
+    char   *argv[] = {"-name", "*.txt", NULL};
+    fixture_open(&f, argv);
+
+    // Test: new files are reported once written, others not at all
+    write_file("a.txt", "a");
+    write_file("b.dat", "b");
+    assert(reported(&f, "+ ./a.txt\n"));
+
+    // Test: rewritten files are reported again, links as they appear
+    write_file("a.txt", "again");
+    assert(link("a.txt", "hard.txt") == 0);
+    assert(symlink("a.txt", "soft.txt") == 0);
+    assert(reported(&f, "+ ./a.txt\n+ ./hard.txt\n+ ./soft.txt\n"));
+
+    // Test: new directories are watched, and what is in them reported
+    assert(mkdir("d.txt", 0755) == 0);
+    assert(reported(&f, "+ ./d.txt\n"));
+    write_file("d.txt/in.txt", "in");
+    assert(mkdir("d.txt/e", 0755) == 0);
+    write_file("d.txt/e/deep.txt", "deep");
+    assert(reported(&f, "+ ./d.txt/in.txt\n+ ./d.txt/e/deep.txt\n"));
+    assert(f.watch.count == 3);
+
+    // Test: removals are reported, moves as a removal and an addition
+    assert(unlink("hard.txt") == 0 && unlink("b.dat") == 0);
+    assert(rename("a.txt", "c.txt") == 0);
+    assert(reported(&f, "- ./hard.txt\n- ./a.txt\n+ ./c.txt\n"));
+
+    // Test: moved directories are watched at their new path
+    assert(rename("d.txt", "m") == 0);
+    assert(reported(&f, "- ./d.txt\n+ ./m/in.txt\n+ ./m/e/deep.txt\n"));
+    write_file("m/e/new.txt", "new");
+    assert(reported(&f, "+ ./m/e/new.txt\n"));
+    assert(f.watch.count == 3);
+
+    // Test: directories moved away are no longer watched
+    char away[BUFSIZ];
+    snprintf(away, BUFSIZ, "%s.away", f.root);
+    assert(rename("m", away) == 0);
+    assert(reported(&f, ""));
+    assert(f.watch.count == 1);
+    snprintf(away, BUFSIZ, "rm -fr %s.away", f.root);
+    assert(system(away) == 0);
+
+    // Test: watch ends once root is removed (and no longer anyone's cwd)
+    assert(chdir("/") == 0);
+    snprintf(away, BUFSIZ, "rm -fr %s", f.root);
+    assert(system(away) == 0);
+    assert(!reported(&f, "- ./c.txt\n- ./soft.txt\n"));
+    assert(f.watch.count == 0);
+
+    fixture_close(&f);
+    return EXIT_SUCCESS;
+}
+
+int test_01_watch_options() {
+    Fixture f;
+    char   *argv[] = {"-maxdepth", "2", "-mindepth", "1", "(", "-name", "skip", "-prune", "-o", "-type", "f", ")", NULL};
+    char    path[BUFSIZ];
+
+    // Fixture: many directories, one of them pruned
+    fixture_open(&f, argv);
+    for (int i = 0; i < DIRECTORIES; i++) {
+        snprintf(path, BUFSIZ, "d%03d", i);
+        assert(mkdir(path, 0755) == 0);
+    }
+    assert(mkdir("skip", 0755) == 0);
+    assert(reported(&f, "+ ./skip\n"));
+
+    // Test: table grows past its initial size, and only to the depth read
+    assert(f.watch.count == DIRECTORIES + 1);
+    assert(mkdir("d000/below", 0755) == 0);
+    assert(reported(&f, ""));
+    assert(f.watch.count == DIRECTORIES + 1);
+
+    // Test: depth limits and pruning apply to changes
+    write_file("top", "");
+    write_file("d007/one", "");
+    write_file("d007/below", "");
+    write_file("skip/hidden", "");
+    assert(reported(&f, "+ ./top\n+ ./d007/one\n+ ./d007/below\n"));
+
+    // Test: removed directories leave the table
+    assert(system("rm -fr d1*") == 0);
+    assert(reported(&f, ""));
+    assert(f.watch.count == DIRECTORIES + 1 - 100);
+    for (size_t i = 0, n = 0; i < f.watch.capacity; i++) {
+        n += f.watch.slots[i].wd != 0;
+        assert(i + 1 < f.watch.capacity || n == f.watch.count);
+    }
+
+    fixture_close(&f);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test watch events\n");
+        fprintf(stderr, "    1  Test watch options\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_watch_events(); break;
+        case 1:  status = test_01_watch_options(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,108 @@
+/* journal.bench.c: Rename journal benchmark */
+
+#define _GNU_SOURCE     // asprintf
+
+#include "moveit.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <unistd.h>
+
+/* Macros */
+
+#define TEMPLATE    "/tmp/journal.bench.XXXXXX"
+#define ROUNDS      7
+
+/* Functions */
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int compare_times(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Rename every source to its target, as moveit does, timing the journal
+ * and the renames apart.
+ * @param   sources     Array of current names
+ * @param   targets     Array of new names
+ * @param   count       Number of names
+ * @param   journal     Whether or not to journal the renames first
+ * @param   written     Set to seconds spent writing the journal
+ * @return  Seconds spent in all.
+ **/
+double run(char **sources, char **targets, size_t count, bool journal, double *written) {
+    Plan   p;
+    double start = now();
+
+    if (!plan_build(&p, sources, targets, count)) exit(EXIT_FAILURE);
+    *written = now();
+    if (journal && !journal_write(&p, JOURNAL_PATH, false)) exit(EXIT_FAILURE);
+    *written = now() - *written;
+    if (!plan_execute(&p, 1, false)) exit(EXIT_FAILURE);
+    if (journal) unlink(JOURNAL_PATH);
+    plan_delete(&p);
+    return now() - start;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+    char   root[] = TEMPLATE;
+    char   command[BUFSIZ];
+
+    if (!mkdtemp(root) || chdir(root) < 0) return EXIT_FAILURE;
+
+    char **names[2];
+    names[0] = calloc(count, sizeof(char *));
+    names[1] = calloc(count, sizeof(char *));
+    for (size_t i = 0; i < count; i++) {
+        if (asprintf(&names[0][i], "f%06zu", i) < 0) return EXIT_FAILURE;
+        if (asprintf(&names[1][i], "g%06zu", i) < 0) return EXIT_FAILURE;
+        int fd = open(names[0][i], O_CREAT | O_WRONLY, 0644);
+        if (fd < 0) return EXIT_FAILURE;
+        close(fd);
+    }
+
+    // Runs alternate with and without a journal, renaming back and forth,
+    // and swap order each round so neither always renames the same way
+    double totals[2][ROUNDS];
+    double journals[ROUNDS];
+    size_t side = 0;
+    for (size_t round = 0; round < ROUNDS; round++) {
+        for (int turn = 0; turn < 2; turn++, side = !side) {
+            int    journal = turn ^ (round & 1);
+            double written;
+            totals[journal][round] = run(names[side], names[!side], count, journal, &written);
+            if (journal) journals[round] = written;
+        }
+    }
+
+    qsort(totals[0], ROUNDS, sizeof(double), compare_times);
+    qsort(totals[1], ROUNDS, sizeof(double), compare_times);
+    qsort(journals, ROUNDS, sizeof(double), compare_times);
+    printf("files\tplain s\tjournaled s\tjournal s\n");
+    printf("%zu\t%.3f\t%.3f\t\t%.3f\n", count, totals[0][ROUNDS / 2], totals[1][ROUNDS / 2], journals[ROUNDS / 2]);
+
+    for (size_t i = 0; i < count; i++) {
+        free(names[0][i]);
+        free(names[1][i]);
+    }
+    free(names[0]);
+    free(names[1]);
+    snprintf(command, BUFSIZ, "rm -fr %s", root);
+    return system(command) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,685 @@
+/* journal.c: Write-ahead journal of planned renames */
+
+#define _GNU_SOURCE     // asprintf, fwrite_unlocked, memrchr
+
+#include "moveit.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Journal layout (native byte order; strings are a uint32_t length followed
+ * by the bytes and a NUL, so they can be used in place once read):
+ *
+ *      magic, directory, uint8_t nested, uint64_t ntasks, uint64_t count
+ *      each task: uint8_t cycle, uint64_t count, temp,
+ *                 then for each rename in the order run: uint64_t device,
+ *                 uint64_t inode (both 0 if there was no such file), source,
+ *                 and target
+ *
+ * The whole plan is written and synced once, before the first rename.
+ * Progress is never logged: recovery looks for each file by its identity.
+ */
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+
+#define JOURNAL_BUFSIZ  (1 << 20)
+#define JOURNAL_LISTMIN 32          // Fewest sources in a directory worth listing it for
+#define JOURNAL_LISTMAX 256         // Most bytes of directory per source worth listing it for
+
+/* Slot Structure */
+
+typedef struct {
+    uint64_t    hash;       // Hash of name
+    size_t      index;      // Index of rename plus one (0 for an empty slot)
+    const char *name;       // Name of source in its directory
+} Slot;
+
+/* Reader Structure */
+
+typedef struct {
+    char       *data;       // Contents of journal
+    size_t      length;     // Size of journal
+    size_t      offset;     // Bytes read so far
+    bool        ok;         // Whether or not everything read was there
+} Reader;
+
+/* Entry Structure */
+
+typedef struct {
+    const char *path;       // Path renamed from or to
+    size_t      index;      // Index of rename
+} Entry;
+
+/* Lookup Functions */
+
+static int journal_compare(const void *a, const void *b) {
+    return strcmp(((const Entry *)a)->path, ((const Entry *)b)->path);
+}
+
+/**
+ * Sort renames by path, for journal_find.
+ * @param   paths       Path of each rename
+ * @param   n           Number of renames
+ * @return  Newly allocated array of entries (NULL on failure).
+ **/
+static Entry *journal_index(char **paths, size_t n) {
+    Entry *entries = malloc((n + 1) * sizeof(Entry));
+    if (!entries) return NULL;
+    for (size_t i = 0; i < n; i++) {
+        entries[i] = (Entry){paths[i], i};
+    }
+    qsort(entries, n, sizeof(Entry), journal_compare);
+    return entries;
+}
+
+/**
+ * Find rename with the first length bytes of path in sorted entries.
+ * @param   entries     Entries sorted by journal_index
+ * @param   n           Number of entries
+ * @param   path        Path to look for
+ * @param   length      Length of path to look for
+ * @return  Index of rename (or -1 if there is none).
+ **/
+static ssize_t journal_find(const Entry *entries, size_t n, const char *path, size_t length) {
+    size_t low  = 0;
+    size_t high = n;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int    order  = strncmp(entries[middle].path, path, length);
+        if (order == 0) order = entries[middle].path[length] != 0;
+        if (order == 0) return entries[middle].index;
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return -1;
+}
+
+/* Writing Functions */
+
+static void journal_put_string(FILE *stream, const char *s) {
+    uint32_t n = strlen(s);
+    fwrite_unlocked(&n, sizeof(n), 1, stream);
+    fwrite_unlocked(s, 1, n + 1, stream);
+}
+
+/**
+ * Sync directory holding path, so a file just renamed into it stays there.
+ * @param   path        Path of file
+ * @return  Whether or not the directory was synced.
+ **/
+static bool journal_sync_directory(const char *path) {
+    char *directory = strdup(path);
+    if (!directory) return false;
+
+    char *slash = strrchr(directory, '/');
+    if (slash) {
+        slash[slash == directory] = 0;
+    }
+
+    int  fd = open(slash ? directory : ".", O_RDONLY | O_DIRECTORY);
+    bool ok = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0) close(fd);
+    free(directory);
+    return ok;
+}
+
+/**
+ * Stat the file a rename will move.  In a nested plan its source may lie
+ * inside a directory another rename moves into place first, so the file is
+ * then looked up under that rename's source instead.
+ * @param   p           Pointer to Plan structure
+ * @param   bytarget    Pointer to renames sorted by target (built when needed)
+ * @param   source      Source of rename
+ * @param   s           Pointer to stat structure to fill in
+ * @return  Whether or not the file was found.
+ **/
+static bool journal_identify(const Plan *p, Entry **bytarget, const char *source, struct stat *s) {
+    char *path  = NULL;
+    bool  found = lstat(source, s) == 0;
+
+    if (found || !p->nested) return found;
+    if (!*bytarget) {
+        char **targets = malloc((p->count + 1) * sizeof(char *));
+        if (!targets) return false;
+        for (size_t i = 0; i < p->count; i++) {
+            targets[i] = (char *)p->renames[i].target;
+        }
+        *bytarget = journal_index(targets, p->count);
+        free(targets);
+        if (!*bytarget) return false;
+    }
+
+    // Each step takes off one rename, so there are at most count of them
+    for (size_t step = 0; step < p->count && !found; step++) {
+        const char *current = path ? path : source;
+        const char *slash   = strrchr(current, '/');
+        ssize_t     i       = -1;
+        while (slash && slash > current && i < 0) {
+            i = journal_find(*bytarget, p->count, current, slash - current);
+            if (i < 0) slash = memrchr(current, '/', slash - current);
+        }
+        if (i < 0) break;
+
+        char *parent = NULL;
+        if (asprintf(&parent, "%s%s", p->renames[i].source, slash) < 0) break;
+        free(path);
+        path  = parent;
+        found = lstat(path, s) == 0;
+    }
+    free(path);
+    return found;
+}
+
+static uint64_t journal_hash(const char *s) {
+    uint64_t h = 14695981039346656037ULL;
+    for (; *s; s++) {
+        h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * Take the identities of sources in one directory from a listing of it: a
+ * getdents call returns hundreds of entries, where each lstat is a call (and
+ * name lookup) of its own.  Directories are left to lstat, as a listing shows
+ * what a mount point covers; and the listing is checked against lstat of one
+ * file, as some file systems (overlayfs, say) list other inode numbers.
+ * @param   p           Pointer to Plan structure
+ * @param   d           Directory to list
+ * @param   members     Indices of renames whose source is in directory
+ * @param   n           Number of such renames
+ * @param   identities  Device and inode of each rename's source (filled in)
+ **/
+static void journal_list(const Plan *p, const Directory *d, const size_t *members, size_t n, uint64_t (*identities)[2]) {
+    char       *path  = d->length ? strndup(d->path, d->length) : strdup(".");
+    DIR        *dir   = path ? opendir(path) : NULL;
+    Slot       *slots = NULL;
+    size_t      capacity;
+    struct stat s;
+
+    if (!dir || fstat(dirfd(dir), &s) < 0 || (size_t)s.st_size / JOURNAL_LISTMAX > n) goto cleanup;
+    for (capacity = 16; capacity < 2 * n; capacity *= 2);
+    if (!(slots = calloc(capacity, sizeof(Slot)))) goto cleanup;
+
+    // Slots are keyed by the name of each source, and compared by hash first
+    for (size_t m = 0; m < n; m++) {
+        const char *source = p->renames[members[m]].source;
+        const char *name   = strrchr(source, '/') ? strrchr(source, '/') + 1 : source;
+        if (!*name || streq(name, ".") || streq(name, "..")) continue;
+
+        uint64_t hash = journal_hash(name);
+        size_t   i    = hash & (capacity - 1);
+        while (slots[i].index) i = (i + 1) & (capacity - 1);
+        slots[i] = (Slot){hash, members[m] + 1, name};
+    }
+
+    struct dirent *e;
+    size_t         sample = 0;
+    while ((e = readdir(dir))) {
+        if (e->d_type == DT_DIR || e->d_type == DT_UNKNOWN) continue;
+
+        uint64_t hash = journal_hash(e->d_name);
+        for (size_t i = hash & (capacity - 1); slots[i].index; i = (i + 1) & (capacity - 1)) {
+            if (slots[i].hash == hash && streq(slots[i].name, e->d_name)) {
+                identities[slots[i].index - 1][0] = s.st_dev;
+                identities[slots[i].index - 1][1] = e->d_ino;
+                if (!sample) sample = slots[i].index;
+                break;
+            }
+        }
+    }
+
+    struct stat t;
+    if (sample && (lstat(p->renames[sample - 1].source, &t) < 0 || (uint64_t)t.st_dev != identities[sample - 1][0] || (uint64_t)t.st_ino != identities[sample - 1][1])) {
+        for (size_t m = 0; m < n; m++) {
+            identities[members[m]][0] = identities[members[m]][1] = 0;
+        }
+    }
+
+cleanup:
+    if (dir) closedir(dir);
+    free(path);
+    free(slots);
+}
+
+/**
+ * Find the identity of each rename's source, listing directories that hold
+ * many of them and looking up the rest one at a time.
+ * @param   p           Pointer to Plan structure
+ * @param   identities  Device and inode of each rename's source (0 if none)
+ * @return  Whether or not there was memory to do so.
+ **/
+static bool journal_identities(const Plan *p, uint64_t (*identities)[2]) {
+    size_t *starts   = calloc(p->ndirectories + 1, sizeof(size_t));
+    size_t *members  = malloc((p->count + 1) * sizeof(size_t));
+    Entry  *bytarget = NULL;
+    bool    ok       = false;
+
+    if (!starts || !members) goto cleanup;
+
+    // Group renames by directory of source: count, sum, place, then shift
+    // the ends of each group back into starts
+    for (size_t i = 0; i < p->count; i++) {
+        starts[p->renames[i].from + 1]++;
+    }
+    for (size_t d = 0; d < p->ndirectories; d++) {
+        starts[d + 1] += starts[d];
+    }
+    for (size_t i = 0; i < p->count; i++) {
+        members[starts[p->renames[i].from]++] = i;
+    }
+    for (size_t d = p->ndirectories; d > 0; d--) {
+        starts[d] = starts[d - 1];
+    }
+    starts[0] = 0;
+
+    for (size_t d = 0; d < p->ndirectories; d++) {
+        size_t n = starts[d + 1] - starts[d];
+        if (n >= JOURNAL_LISTMIN) journal_list(p, &p->directories[d], members + starts[d], n, identities);
+    }
+    for (size_t i = 0; i < p->count; i++) {
+        struct stat s;
+        if (identities[i][1] || !journal_identify(p, &bytarget, p->renames[i].source, &s)) continue;
+        identities[i][0] = s.st_dev;
+        identities[i][1] = s.st_ino;
+    }
+    ok = true;
+
+cleanup:
+    free(starts);
+    free(members);
+    free(bytarget);
+    return ok;
+}
+
+/**
+ * Write plan to journal at path, synced to disk, before any of it is carried
+ * out.  The journal is written beside path and renamed over it, so path
+ * always holds a complete journal (or none).  If the journal cannot be
+ * created because its directory is read-only, renaming goes ahead without
+ * one; any other failure (a full disk, say) keeps renaming from starting.
+ * @param   p           Pointer to Plan structure
+ * @param   path        Path of journal
+ * @param   replace     Whether or not an existing journal may be replaced
+ * @return  Whether or not renaming may go ahead.
+ **/
+bool    journal_write(const Plan *p, const char *path, bool replace) {
+    char   *temp      = NULL;
+    char   *directory = NULL;
+    FILE   *stream    = NULL;
+    bool    ok        = false;
+    uint64_t (*identities)[2] = NULL;
+
+    if (!replace && access(path, F_OK) == 0) {
+        fprintf(stderr, "moveit: %s: unfinished run, use --recover or --rollback\n", path);
+        return false;
+    }
+    if (asprintf(&temp, "%s.new", path) < 0) {
+        temp = NULL;
+        goto failure;
+    }
+    if (!(directory = getcwd(NULL, 0))) goto failure;
+
+    // Recovery only moves files it can tell are the ones planned
+    if (!(identities = calloc(p->count + 1, sizeof(*identities))) || !journal_identities(p, identities)) goto failure;
+
+    int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0 && (errno == EACCES || errno == EROFS)) {
+        fprintf(stderr, "moveit: %s: %s, renaming without a journal\n", path, strerror(errno));
+        ok = true;
+        goto cleanup;
+    }
+    if (fd < 0 || !(stream = fdopen(fd, "w"))) {
+        if (fd >= 0) close(fd);
+        goto failure;
+    }
+    setvbuf(stream, NULL, _IOFBF, JOURNAL_BUFSIZ);
+
+    uint8_t  nested = p->nested;
+    uint64_t ntasks = p->ntasks;
+    uint64_t count  = p->count;
+    fwrite(JOURNAL_MAGIC, 1, strlen(JOURNAL_MAGIC), stream);
+    journal_put_string(stream, directory);
+    fwrite(&nested, sizeof(nested), 1, stream);
+    fwrite(&ntasks, sizeof(ntasks), 1, stream);
+    fwrite(&count, sizeof(count), 1, stream);
+
+    for (size_t t = 0; t < p->ntasks; t++) {
+        const Task *task  = &p->tasks[t];
+        uint8_t     cycle = task->cycle;
+        uint64_t    n     = task->count;
+
+        fwrite_unlocked(&cycle, sizeof(cycle), 1, stream);
+        fwrite_unlocked(&n, sizeof(n), 1, stream);
+        journal_put_string(stream, task->temp ? task->temp : "");
+        for (size_t m = 0; m < task->count; m++) {
+            const Rename *r = &p->renames[p->order[task->start + m]];
+            fwrite_unlocked(identities[p->order[task->start + m]], sizeof(*identities), 1, stream);
+            journal_put_string(stream, r->source);
+            journal_put_string(stream, r->target);
+        }
+    }
+
+    if (fflush(stream) != 0 || ferror(stream) || fsync(fileno(stream)) < 0) goto failure;
+    if (fclose(stream) != 0) {
+        stream = NULL;
+        goto failure;
+    }
+    stream = NULL;
+    if (rename(temp, path) < 0) goto failure;
+    if (!journal_sync_directory(path)) {
+        // A journal that replaced another is still the one to recover from
+        int error = errno;
+        if (!replace) unlink(path);
+        errno = error;
+        goto failure;
+    }
+    ok = true;
+    goto cleanup;
+
+failure:
+    fprintf(stderr, "moveit: %s: %s\n", path, strerror(errno));
+    if (stream) fclose(stream);
+    if (temp) unlink(temp);
+
+cleanup:
+    free(temp);
+    free(directory);
+    free(identities);
+    return ok;
+}
+
+/* Reading Functions */
+
+static void *journal_get(Reader *r, size_t n) {
+    if (!r->ok || r->length - r->offset < n) {
+        r->ok = false;
+        return NULL;
+    }
+    void *data = r->data + r->offset;
+    r->offset += n;
+    return data;
+}
+
+static uint64_t journal_get_number(Reader *r, size_t size) {
+    uint64_t n    = 0;
+    void    *data = journal_get(r, size);
+    if (data && size == sizeof(uint8_t))  n = *(uint8_t *)data;
+    if (data && size == sizeof(uint64_t)) memcpy(&n, data, sizeof(n));
+    return n;
+}
+
+static char *journal_get_string(Reader *r) {
+    uint32_t n    = 0;
+    void    *data = journal_get(r, sizeof(n));
+    if (data) memcpy(&n, data, sizeof(n));
+
+    char *s = journal_get(r, (size_t)n + 1);
+    if (s && s[n]) r->ok = false;
+    return r->ok ? s : NULL;
+}
+
+/**
+ * Read whole journal into memory.
+ * @param   r           Pointer to Reader structure
+ * @param   path        Path of journal
+ * @return  Whether or not the journal could be read.
+ **/
+static bool journal_read(Reader *r, const char *path) {
+    struct stat s;
+    int         fd = open(path, O_RDONLY);
+
+    memset(r, 0, sizeof(Reader));
+    if (fd < 0) return false;
+    if (fstat(fd, &s) < 0 || !(r->data = malloc(s.st_size ? s.st_size : 1))) {
+        close(fd);
+        return false;
+    }
+    while (r->length < (size_t)s.st_size) {
+        ssize_t n = read(fd, r->data + r->length, s.st_size - r->length);
+        if (n <= 0) break;
+        r->length += n;
+    }
+    close(fd);
+
+    r->ok = r->length == (size_t)s.st_size;
+    char *magic = journal_get(r, strlen(JOURNAL_MAGIC));
+    if (!magic || memcmp(magic, JOURNAL_MAGIC, strlen(JOURNAL_MAGIC))) {
+        errno = EINVAL;
+        r->ok = false;
+    }
+    return r->ok;
+}
+
+/**
+ * Determine if path currently exists.
+ **/
+static bool journal_exists(const char *path) {
+    struct stat s;
+    return lstat(path, &s) == 0;
+}
+
+/**
+ * Determine if path currently names the file with identity.
+ **/
+static bool journal_holds(const char *path, const uint64_t *identity) {
+    struct stat s;
+    return lstat(path, &s) == 0 && (uint64_t)s.st_dev == identity[0] && (uint64_t)s.st_ino == identity[1];
+}
+
+/**
+ * Give up moves back that would clobber a file the run did not move.  A file
+ * only goes back to a free path, or to one that another file going back
+ * leaves; each move given up keeps its file where it is, which may block
+ * another move in turn.
+ * @param   current     Where each file is
+ * @param   wanted      Where each file goes back to
+ * @param   moving      Whether or not each file still goes back
+ * @param   n           Number of files
+ * @return  Whether or not every move was kept.
+ **/
+static bool journal_guard(char **current, char **wanted, bool *moving, size_t n) {
+    Entry  *bycurrent = journal_index(current, n);
+    Entry  *bywanted  = journal_index(wanted, n);
+    size_t *stack     = malloc((2 * n + 1) * sizeof(size_t));
+    size_t  top       = 0;
+    bool    ok        = true;
+
+    if (!bycurrent || !bywanted || !stack) {
+        fprintf(stderr, "moveit: %s\n", strerror(errno));
+        memset(moving, 0, n * sizeof(bool));
+        ok = false;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        stack[top++] = n - 1 - i;
+    }
+    while (top) {
+        size_t i = stack[--top];
+        if (!moving[i]) continue;
+
+        ssize_t j = journal_find(bycurrent, n, wanted[i], strlen(wanted[i]));
+        if (j >= 0 ? moving[j] : !journal_exists(wanted[i])) continue;
+
+        fprintf(stderr, "moveit: %s: in the way, %s left alone\n", wanted[i], current[i]);
+        moving[i] = false;
+        ok        = false;
+
+        ssize_t k = journal_find(bywanted, n, current[i], strlen(current[i]));
+        if (k >= 0 && moving[k]) stack[top++] = k;
+    }
+
+cleanup:
+    free(bycurrent);
+    free(bywanted);
+    free(stack);
+    return ok;
+}
+
+/**
+ * Finish (or undo) the run recorded in journal at path, then remove it (it
+ * is kept if renames fail, so recovery can be tried again).
+ * Each file is looked for by its identity where it was, where it was going,
+ * and (for the first of a cycle) where it was parked; one not found is left
+ * alone, as is one that never existed.  The renames still needed are planned
+ * afresh, so they too are journaled and ordered to keep from clobbering each
+ * other, and an undo never moves a file back over one it did not move.
+ * @param   path        Path of journal
+ * @param   forward     Whether to finish the run (or else undo it)
+ * @param   jobs        Number of rename threads
+ * @param   sync        Whether or not to sync directories renamed in
+ * @return  Whether or not the journal was carried out in full.
+ **/
+bool    journal_recover(const char *path, bool forward, size_t jobs, bool sync) {
+    Reader  r        = {0};
+    char  **sources  = NULL;
+    char  **targets  = NULL;
+    char  **current  = NULL;
+    char  **wanted   = NULL;
+    bool   *moving   = NULL;
+    char   *absolute = NULL;
+    size_t  n        = 0;
+    bool    ok       = false;
+    Plan    plan     = {0};
+
+    if (!journal_read(&r, path)) {
+        if (!r.data && errno == ENOENT) {
+            fprintf(stderr, "moveit: %s: no unfinished run\n", path);
+            free(r.data);
+            return true;
+        }
+        fprintf(stderr, "moveit: %s: %s\n", path, r.data ? "not a complete journal" : strerror(errno));
+        goto cleanup;
+    }
+
+    // Renames are relative to where the run started
+    char    *directory = journal_get_string(&r);
+    bool     nested    = journal_get_number(&r, sizeof(uint8_t));
+    uint64_t ntasks    = journal_get_number(&r, sizeof(uint64_t));
+    uint64_t count     = journal_get_number(&r, sizeof(uint64_t));
+    if (!r.ok || count > r.length) {
+        fprintf(stderr, "moveit: %s: not a complete journal\n", path);
+        goto cleanup;
+    }
+    if (!(absolute = realpath(path, NULL)) || chdir(directory) < 0) {
+        fprintf(stderr, "moveit: %s: %s\n", absolute ? directory : path, strerror(errno));
+        goto cleanup;
+    }
+
+    sources = malloc((count + 1) * sizeof(char *));
+    targets = malloc((count + 1) * sizeof(char *));
+    current = malloc((count + 1) * sizeof(char *));
+    wanted  = malloc((count + 1) * sizeof(char *));
+    moving  = malloc((count + 1) * sizeof(bool));
+    if (!sources || !targets || !current || !wanted || !moving) goto cleanup;
+
+    // Renames that never had a file to move are dropped, and a file that
+    // cannot be found is marked with a NULL current path
+    size_t moved = 0;
+    ok = true;
+    for (uint64_t t = 0; t < ntasks && r.ok; t++) {
+        bool     cycle  = journal_get_number(&r, sizeof(uint8_t));
+        uint64_t length = journal_get_number(&r, sizeof(uint64_t));
+        char    *temp   = journal_get_string(&r);
+        if (!r.ok || length > count - n) {
+            r.ok = false;
+            break;
+        }
+        for (uint64_t m = 0; m < length && r.ok; m++) {
+            uint64_t *identity = journal_get(&r, 2 * sizeof(uint64_t));
+            char     *source   = journal_get_string(&r);
+            char     *target   = journal_get_string(&r);
+            uint64_t  found[2] = {0, 0};
+            if (!r.ok) break;
+            memcpy(found, identity, sizeof(found));
+            if (!found[0] && !found[1]) continue;
+
+            sources[n] = source;
+            targets[n] = target;
+            if (journal_holds(target, found)) {
+                current[n] = target;
+            } else if (journal_holds(source, found)) {
+                current[n] = source;
+            } else if (cycle && m == 0 && *temp && journal_holds(temp, found)) {
+                current[n] = temp;
+            } else {
+                current[n] = NULL;
+            }
+            if (current[n] && current[n] != source) moved = n + 1;
+            n++;
+        }
+    }
+    if (!r.ok) {
+        fprintf(stderr, "moveit: %s: not a complete journal\n", path);
+        ok = false;
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        // Nested runs go one rename at a time, so a file not found before the
+        // last one moved was itself moved, then carried along with its parent
+        if (!current[i] && nested && i < moved) current[i] = targets[i];
+        if (!current[i]) {
+            fprintf(stderr, "moveit: %s: cannot tell whether it was renamed, left alone\n", sources[i]);
+            current[i] = wanted[i] = sources[i];
+            moving[i]  = ok = false;
+            continue;
+        }
+        wanted[i] = forward ? targets[i] : sources[i];
+        moving[i] = strcmp(current[i], wanted[i]) != 0;
+    }
+    if (!forward && !journal_guard(current, wanted, moving, n)) ok = false;
+
+    size_t needed = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (moving[i]) {
+            current[needed] = current[i];
+            wanted[needed]  = wanted[i];
+            needed++;
+        }
+    }
+
+    if (!plan_build(&plan, current, wanted, needed)) {
+        ok = false;
+        goto cleanup;
+    }
+    if (plan.count && !journal_write(&plan, absolute, true)) {
+        ok = false;
+        goto cleanup;
+    }
+
+    // A journal is kept after renames fail, so recovery can be tried again
+    if (plan_execute(&plan, jobs, sync)) {
+        unlink(absolute);
+    } else {
+        fprintf(stderr, "moveit: %s: unfinished run, use --recover or --rollback\n", path);
+        ok = false;
+    }
+
+cleanup:
+    plan_delete(&plan);
+    free(sources);
+    free(targets);
+    free(current);
+    free(wanted);
+    free(moving);
+    free(absolute);
+    free(r.data);
+    return ok;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,275 @@
+/* journal.unit.c: Rename journal unit test */
+
+#define _GNU_SOURCE     // asprintf
+
+#include "moveit.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+#define nargs(a)    (sizeof(a) / sizeof((a)[0]))
+
+#define TEMPLATE    "/tmp/journal.unit.XXXXXX"
+#define MANY        64
+
+/* Functions */
+
+/**
+ * Create a temporary directory and make it the current directory.
+ * @param   root        Buffer of sizeof(TEMPLATE) bytes for its path
+ **/
+void enter_root(char *root) {
+    strcpy(root, TEMPLATE);
+    assert(mkdtemp(root));
+    assert(chdir(root) == 0);
+}
+
+/**
+ * Leave and remove temporary directory.
+ * @param   root        Path of temporary directory
+ **/
+void leave_root(const char *root) {
+    char command[BUFSIZ];
+    assert(chdir("/") == 0);
+    snprintf(command, BUFSIZ, "rm -fr %s", root);
+    assert(system(command) == 0);
+}
+
+/**
+ * Create file holding its own name as contents.
+ * @param   path        Path of file
+ **/
+void make_file(const char *path) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    assert(fd >= 0);
+    assert(write(fd, path, strlen(path)) == (ssize_t)strlen(path));
+    close(fd);
+}
+
+/**
+ * Determine if file at path holds the contents it was created with.
+ * @param   path        Path of file
+ * @param   name        Name file was created with
+ * @return  Whether or not file holds name.
+ **/
+bool holds(const char *path, const char *name) {
+    char buffer[BUFSIZ] = {0};
+    int  fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    return n == (ssize_t)strlen(name) && streq(buffer, name);
+}
+
+/**
+ * Plan and journal a swap, a cycle, and a chain, then stop part way through
+ * each as if the run were killed: the swap is not started, the cycle has its
+ * first file parked and one more renamed, and the chain has one rename done.
+ * @param   p           Pointer to Plan structure
+ **/
+void interrupt(Plan *p) {
+    char *sources[] = {"a", "b", "c1", "c2", "c3", "x", "y"};
+    char *targets[] = {"b", "a", "c2", "c3", "c1", "y", "z"};
+    for (size_t i = 0; i < nargs(sources); i++) {
+        make_file(sources[i]);
+    }
+    assert(plan_build(p, sources, targets, nargs(sources)));
+    assert(journal_write(p, JOURNAL_PATH, false));
+    assert(access(JOURNAL_PATH, F_OK) == 0);
+
+    for (size_t t = 0; t < p->ntasks; t++) {
+        Task   *task  = &p->tasks[t];
+        Rename *first = &p->renames[p->order[task->start]];
+        Rename *next  = &p->renames[p->order[task->start + 1]];
+        if (task->cycle && task->count == 3) {
+            assert(rename(first->source, task->temp) == 0);
+            assert(rename(next->source, next->target) == 0);
+        } else if (!task->cycle) {
+            assert(rename(first->source, first->target) == 0);
+        }
+    }
+}
+
+/* Tests */
+
+int test_00_journal_write() {
+    char root[sizeof(TEMPLATE)];
+    Plan p;
+    enter_root(root);
+
+    // Test: an unfinished journal is not replaced unless asked to be
+    char *sources[] = {"a"};
+    char *targets[] = {"b"};
+    make_file("a");
+    assert(plan_build(&p, sources, targets, nargs(sources)));
+    assert(journal_write(&p, JOURNAL_PATH, false));
+    assert(!journal_write(&p, JOURNAL_PATH, false));
+    assert(journal_write(&p, JOURNAL_PATH, true));
+    assert(unlink(JOURNAL_PATH) == 0);
+
+    // Test: renaming does not start when the journal cannot be written
+    assert(!journal_write(&p, "missing/" JOURNAL_PATH, false));
+    assert(access("missing", F_OK) < 0);
+
+    // Test: renaming goes ahead when the journal's directory is read-only
+    // (root writes there anyway, so this only runs as anybody else)
+    if (geteuid() != 0) {
+        assert(mkdir("locked", 0555) == 0);
+        assert(journal_write(&p, "locked/" JOURNAL_PATH, false));
+        assert(access("locked/" JOURNAL_PATH, F_OK) < 0);
+        assert(chmod("locked", 0755) == 0);
+    }
+    assert(plan_execute(&p, 1, false));
+    assert(holds("b", "a") && access("a", F_OK) < 0);
+    plan_delete(&p);
+
+    leave_root(root);
+    return EXIT_SUCCESS;
+}
+
+int test_01_journal_recover() {
+    char root[sizeof(TEMPLATE)];
+    Plan p;
+    enter_root(root);
+
+    // Test: nothing to do without a journal
+    assert(journal_recover(JOURNAL_PATH, true, 1, false));
+
+    // Test: an interrupted run is finished, and its journal removed
+    interrupt(&p);
+    plan_delete(&p);
+    assert(journal_recover(JOURNAL_PATH, true, 2, false));
+    assert(access(JOURNAL_PATH, F_OK) < 0);
+    assert(holds("a", "b") && holds("b", "a"));
+    assert(holds("c2", "c1") && holds("c3", "c2") && holds("c1", "c3"));
+    assert(holds("y", "x") && holds("z", "y") && access("x", F_OK) < 0);
+
+    // Test: files moved into place by a nested run are found under their
+    // new parent
+    char *sources[] = {"m", "n/f"};
+    char *targets[] = {"n", "g"};
+    assert(mkdir("m", 0755) == 0);
+    make_file("m/f");
+    assert(plan_build(&p, sources, targets, nargs(sources)));
+    assert(p.nested && journal_write(&p, JOURNAL_PATH, false));
+    plan_delete(&p);
+    assert(rename("m", "n") == 0);
+    assert(journal_recover(JOURNAL_PATH, true, 1, false));
+    assert(holds("g", "m/f") && access("n", F_OK) == 0 && access("m", F_OK) < 0);
+
+    // Test: files in a directory with many sources, whose identities come
+    // from listing it, are found too
+    char *many[MANY];
+    char *more[MANY];
+    assert(mkdir("many", 0755) == 0);
+    for (size_t i = 0; i < MANY; i++) {
+        assert(asprintf(&many[i], "many/f%02zu", i) > 0);
+        assert(asprintf(&more[i], "many/g%02zu", i) > 0);
+        make_file(many[i]);
+    }
+    assert(plan_build(&p, many, more, MANY));
+    assert(journal_write(&p, JOURNAL_PATH, false));
+    plan_delete(&p);
+    for (size_t i = 0; i < MANY; i += 2) {
+        assert(rename(many[i], more[i]) == 0);
+    }
+    assert(journal_recover(JOURNAL_PATH, false, 1, false));
+    for (size_t i = 0; i < MANY; i++) {
+        assert(holds(many[i], many[i]) && access(more[i], F_OK) < 0);
+        free(many[i]);
+        free(more[i]);
+    }
+
+    // Test: the journal is kept while renames still fail, so recovery can
+    // be tried again
+    char *lost[] = {"p"};
+    char *away[] = {"later/q"};
+    make_file("p");
+    assert(plan_build(&p, lost, away, nargs(lost)));
+    assert(journal_write(&p, JOURNAL_PATH, false));
+    assert(!plan_execute(&p, 1, false));
+    plan_delete(&p);
+    assert(!journal_recover(JOURNAL_PATH, true, 1, false));
+    assert(access(JOURNAL_PATH, F_OK) == 0 && holds("p", "p"));
+    assert(mkdir("later", 0755) == 0);
+    assert(journal_recover(JOURNAL_PATH, true, 1, false));
+    assert(access(JOURNAL_PATH, F_OK) < 0 && holds("later/q", "p"));
+
+    leave_root(root);
+    return EXIT_SUCCESS;
+}
+
+int test_02_journal_rollback() {
+    char root[sizeof(TEMPLATE)];
+    Plan p;
+    enter_root(root);
+
+    // Test: an interrupted run is undone, and its journal removed
+    interrupt(&p);
+    plan_delete(&p);
+    assert(journal_recover(JOURNAL_PATH, false, 2, false));
+    assert(access(JOURNAL_PATH, F_OK) < 0);
+    assert(holds("a", "a") && holds("b", "b"));
+    assert(holds("c1", "c1") && holds("c2", "c2") && holds("c3", "c3"));
+    assert(holds("x", "x") && holds("y", "y") && access("z", F_OK) < 0);
+
+    // Test: files the run never moved are never moved back, and nothing is
+    // moved back over a file that took its place
+    char *sources[] = {"gone", "d", "e", "k"};
+    char *targets[] = {"u", "f", "h", "l"};
+    make_file("u");
+    make_file("d");
+    make_file("e");
+    make_file("k");
+    make_file("w");
+    assert(plan_build(&p, sources, targets, nargs(sources)));
+    assert(journal_write(&p, JOURNAL_PATH, false));
+    assert(!plan_execute(&p, 1, false));
+    plan_delete(&p);
+    assert(rename("w", "f") == 0);
+    make_file("e");
+    assert(!journal_recover(JOURNAL_PATH, false, 1, false));
+    assert(access(JOURNAL_PATH, F_OK) < 0);
+    assert(holds("u", "u") && access("gone", F_OK) < 0);
+    assert(holds("f", "w") && access("d", F_OK) < 0);
+    assert(holds("e", "e") && holds("h", "e"));
+    assert(holds("k", "k") && access("l", F_OK) < 0);
+
+    leave_root(root);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test journal write\n");
+        fprintf(stderr, "    1  Test journal recover\n");
+        fprintf(stderr, "    2  Test journal rollback\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_journal_write(); break;
+        case 1:  status = test_01_journal_recover(); break;
+        case 2:  status = test_02_journal_rollback(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
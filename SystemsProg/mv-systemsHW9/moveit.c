@@ -1,5 +1,7 @@
 /* moveit.c: Interactive Move Command */
 
+#include "moveit.h"
+
 #include <errno.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -13,7 +15,16 @@
 /* Macros */
 
 #define streq(a, b) (strcmp(a, b) == 0)
-#define strchomp(s) (s)[strlen(s) - 1] = 0
+
+/* Globals */
+
+size_t   Jobs = 0;          // Number of rename threads (0 for one per CPU)
+int      Recover = 0;       // Finish (1) or undo (-1) an interrupted run instead
+Pattern *Patterns = NULL;   // Substitutions to rename files by instead of editing
+size_t   NPatterns = 0;     // Number of substitutions
+char    *Map = NULL;        // File of renames to make instead of editing
+char     Delimiter = '\n';  // Ends each name read from stdin or a map (0 for -0)
+bool     Sync = false;      // Sync each directory renamed in once done
 
 /* Functions */
 
@@ -22,12 +33,25 @@
  * @param   status      Exit status.
  **/
 void    usage(int status) {
-    fprintf(stderr, "Usage: moveit files...\n");
+    fprintf(stderr, "Usage: moveit [options] files...\n");
+    fprintf(stderr, "       moveit [options] -0 < files\n");
+    fprintf(stderr, "       moveit [options] --from-file MAP\n");
+    fprintf(stderr, "       moveit [options] --recover | --rollback\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "    -j N            Rename with N threads (default is one per CPU)\n");
+    fprintf(stderr, "    -0              Read NUL-terminated names (files from stdin, or MAP entries)\n");
+    fprintf(stderr, "    -s              Sync each directory renamed into or out of once done\n");
+    fprintf(stderr, "    -e s/RE/REPL/   Rename files by substitution instead of editing (repeatable)\n");
+    fprintf(stderr, "    --from-file MAP Rename as listed in MAP, one SOURCE<tab>TARGET per line (- for stdin)\n");
+    fprintf(stderr, "                    (with -0, SOURCE and TARGET each end with NUL instead)\n");
+    fprintf(stderr, "    --recover       Finish renames of an interrupted run\n");
+    fprintf(stderr, "    --rollback      Undo renames of an interrupted run\n");
+    fprintf(stderr, "    --              End options, so files may start with -\n");
     exit(status);
 }
 
 /**
- * Save list of file paths to temporary file.
+ * Save list of file paths to temporary file, one per line.
  * @param   files       Array of path strings.
  * @param   n           Number of path strings.
  * @return  Newly allocated path to temporary file (must be freed).
@@ -36,14 +60,23 @@ char *  save_files(char **files, size_t n) {
     // Create temporary file
     char tpath[] = "moveit.XXXXXX";
     int tfd = mkstemp(tpath);
-    // Open temporary file for writing
-    FILE* f = fdopen(tfd, "w");
-    // Write paths to temporary file
-    for (int i = 0; i<n; i++){
-        fprintf(f, "%s\n", files[i]);
+    if (tfd < 0) {
+        fprintf(stderr, "moveit: %s: %s\n", tpath, strerror(errno));
+        return NULL;
     }
 
-    fclose(f);
+    // Write paths to temporary file a buffer at a time
+    bool ok = names_write(tfd, files, n, '\n');
+    if (!ok && errno == EINVAL) {
+        fprintf(stderr, "moveit: names with newlines cannot be edited, use -e or --from-file\n");
+    } else if (!ok) {
+        fprintf(stderr, "moveit: %s: %s\n", tpath, strerror(errno));
+    }
+    close(tfd);
+    if (!ok) {
+        unlink(tpath);
+        return NULL;
+    }
 
     return strdup(tpath);
 }
@@ -70,6 +103,11 @@ bool    edit_files(const char *path) {
         return EXIT_FAILURE;
 
     }else if (rc == 0){ // child
+        // Names may have come in on stdin, but the editor wants the terminal
+        if (!isatty(STDIN_FILENO)) {
+            int tty = open("/dev/tty", O_RDONLY);
+            if (tty >= 0) dup2(tty, STDIN_FILENO);
+        }
         if (execlp(editor, editor, path, (char *)NULL) < 0) {
             exit(EXIT_FAILURE);
         }
@@ -82,6 +120,34 @@ bool    edit_files(const char *path) {
     return (WEXITSTATUS(status) == 0);
 }
 
+/**
+ * Rename each of sources to the corresponding target.  Renames are planned
+ * as a whole first, so swaps and cycles of names do not clobber each other,
+ * and journaled (where the journal can be written) before any is made, so an
+ * interrupted run can be recovered.
+ * @param   sources     Array of old path names.
+ * @param   targets     Array of new path names (NULL leaves a file alone).
+ * @param   n           Number of path names.
+ * @return  Whether or not all rename operations were successful.
+ **/
+bool    rename_files(char **sources, char **targets, size_t n) {
+    Plan plan;
+    bool status = false;
+
+    if (plan_build(&plan, sources, targets, n) && (!plan.count || journal_write(&plan, JOURNAL_PATH, false))) {
+        status = plan_execute(&plan, Jobs, Sync);
+
+        // A journal is kept after renames fail, for --recover or --rollback
+        if (plan.count && status) {
+            unlink(JOURNAL_PATH);
+        } else if (plan.count && access(JOURNAL_PATH, F_OK) == 0) {
+            fprintf(stderr, "moveit: %s: unfinished run, use --recover or --rollback\n", JOURNAL_PATH);
+        }
+    }
+    plan_delete(&plan);
+    return status;
+}
+
 /**
  * Rename files as specified in contents of path.
  * @param   files       Array of old path names.
@@ -91,25 +157,104 @@ bool    edit_files(const char *path) {
  **/
 bool    move_files(char **files, size_t n, const char *path) {
     //Open temporary file at path for reading
-    FILE* tf = fopen(path, "r");
-    if(!tf) return false;
-    bool status = true;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
 
-    // Rename each file in array according to new name in temporary file
-    char buffer[BUFSIZ];
-    int i = 0;
-    while(fgets(buffer, BUFSIZ, tf) && (i < n)){
-        strchomp(buffer);
-        if(!streq(buffer, files[i])){
-            if (rename(files[i], buffer)< 0){
-                status = false;
-            }
-        } 
-        i++;
+    // Read new name of each file in array (missing lines leave it alone)
+    Names  lines;
+    char **targets = NULL;
+    bool   status  = false;
+    if (!names_read(&lines, fd, '\n')) goto cleanup;
+    if (lines.count < n) {
+        if (!(targets = calloc(n, sizeof(char *)))) goto cleanup;
+        memcpy(targets, lines.names, lines.count * sizeof(char *));
     }
 
-    fclose(tf);
+    // Rename files in an order where none clobbers another
+    status = rename_files(files, targets ? targets : lines.names, n);
+
+cleanup:
+    close(fd);
+    names_delete(&lines);
+    free(targets);
+    return status;
+}
+
+/**
+ * Rename files by applying each substitution in turn to their paths.
+ * @param   files       Array of old path names.
+ * @param   n           Number of old path names.
+ * @return  Whether or not all rename operations were successful.
+ **/
+bool    substitute_files(char **files, size_t n) {
+    char **targets = calloc(n ? n : 1, sizeof(char *));
+    bool   status  = false;
+    if (!targets) return false;
+
+    for (size_t i = 0; i < n; i++) {
+        if (!(targets[i] = strdup(files[i]))) goto cleanup;
+        for (size_t p = 0; p < NPatterns; p++) {
+            char *target = pattern_apply(&Patterns[p], targets[i]);
+            free(targets[i]);
+            if (!(targets[i] = target)) goto cleanup;
+        }
+    }
+    status = rename_files(files, targets, n);
 
+cleanup:
+    for (size_t i = 0; i < n; i++) free(targets[i]);
+    free(targets);
+    return status;
+}
+
+/**
+ * Rename files as listed in map, one SOURCE<tab>TARGET per line (blank lines
+ * are skipped), or SOURCE and TARGET each ended by NUL with -0.
+ * @param   path        Path to map ("-" for standard input).
+ * @return  Whether or not all rename operations were successful.
+ **/
+bool    map_files(const char *path) {
+    int fd = streq(path, "-") ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "moveit: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    Names   map;
+    char  **targets = NULL;
+    size_t  n       = 0;
+    bool    status  = false;
+    if (!names_read(&map, fd, Delimiter)) {
+        fprintf(stderr, "moveit: %s: %s\n", path, strerror(errno));
+        goto cleanup;
+    }
+    if (!(targets = malloc((map.count ? map.count : 1) * sizeof(char *)))) goto cleanup;
+
+    // Sources are gathered at the front of the names they were read with
+    for (size_t i = 0; i < map.count; i++) {
+        char *source = map.names[i];
+        char *target = NULL;
+        if (!Delimiter) {
+            target = i + 1 < map.count ? map.names[++i] : NULL;
+        } else if (!*source) {
+            continue;
+        } else if ((target = strchr(source, '\t'))) {
+            *target++ = 0;
+        }
+
+        if (!target || !*source || !*target) {
+            fprintf(stderr, "moveit: %s:%zu: not SOURCE%sTARGET\n", path, i + 1, Delimiter ? "<tab>" : "<nul>");
+            goto cleanup;
+        }
+        map.names[n] = source;
+        targets[n++] = target;
+    }
+    status = rename_files(map.names, targets, n);
+
+cleanup:
+    if (fd != STDIN_FILENO) close(fd);
+    names_delete(&map);
+    free(targets);
     return status;
 }
 
@@ -119,24 +264,89 @@ int     main(int argc, char *argv[]) {
     int estatus = EXIT_SUCCESS;
     
     // Parse command line options
-    if (argc == 1){
+    int argind = 1;
+    while (argind < argc && argv[argind][0] == '-'){
+        if (streq(argv[argind], "--")){
+            argind++;
+            break;
+        } else if (streq(argv[argind], "-h")){
+            usage(0);
+        } else if (streq(argv[argind], "-j") && argind + 1 < argc && atoi(argv[argind + 1]) > 0){
+            Jobs = atoi(argv[argind + 1]);
+            argind += 2;
+        } else if (streq(argv[argind], "-s")){
+            Sync = true;
+            argind++;
+        } else if (streq(argv[argind], "-0")){
+            Delimiter = 0;
+            argind++;
+        } else if (streq(argv[argind], "-e") && argind + 1 < argc){
+            Pattern *patterns = realloc(Patterns, (NPatterns + 1) * sizeof(Pattern));
+            if (!patterns) return EXIT_FAILURE;
+            Patterns = patterns;
+            if (!pattern_compile(&Patterns[NPatterns], argv[argind + 1])) return EXIT_FAILURE;
+            NPatterns++;
+            argind += 2;
+        } else if (streq(argv[argind], "--from-file") && argind + 1 < argc){
+            Map = argv[argind + 1];
+            argind += 2;
+        } else if (streq(argv[argind], "--recover")){
+            Recover = 1;
+            argind++;
+        } else if (streq(argv[argind], "--rollback")){
+            Recover = -1;
+            argind++;
+        } else {
+            usage(1);
+        }
+    }
+    bool listed = argind < argc;
+    if (((Recover || Map) ? listed : !(listed || !Delimiter)) || (Recover && (Map || NPatterns)) || (Map && NPatterns)){
         usage(1);
     }
-    if (argc == 2 && streq(argv[1], "-h")){
-        usage(0);
+    if (!Jobs){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        Jobs = cpus > 0 ? cpus : 1;
+    }
+    if (Recover){
+        return journal_recover(JOURNAL_PATH, Recover > 0, Jobs, Sync) ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
-    int n = argc-1;
+    if (Map){
+        return map_files(Map) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Refuse to start before editing if an earlier run never finished
+    if (access(JOURNAL_PATH, F_OK) == 0){
+        fprintf(stderr, "moveit: %s: unfinished run, use --recover or --rollback\n", JOURNAL_PATH);
+        return EXIT_FAILURE;
+    }
 
-    char **files = malloc(n * sizeof(char*));
+    // Names are used where they are: in argv, or as read from stdin
+    Names  input = {0};
+    char **files = argv + argind;
+    size_t n     = argc - argind;
+    if (!listed) {
+        if (!names_read(&input, STDIN_FILENO, Delimiter)) {
+            fprintf(stderr, "moveit: stdin: %s\n", strerror(errno));
+            return EXIT_FAILURE;
+        }
+        files = input.names;
+        n     = input.count;
+    }
 
-    for (int i = 0; i < n; i++){
-        files[i] = malloc((strlen(argv[i+1]) + 1) * sizeof(char));
-        strcpy(files[i], argv[i+1]);
+    // Substitutions compute new names without an editor round trip
+    char *path = NULL;
+    if (NPatterns){
+        if (!substitute_files(files, n)) estatus = EXIT_FAILURE;
+        goto cleanup;
     }
 
     //Save files
-    char *path = save_files(files, n);
+    if (!(path = save_files(files, n))){
+        estatus = EXIT_FAILURE;
+        goto cleanup;
+    }
     // Edit files
     if(!edit_files(path)){
         estatus = EXIT_FAILURE;
@@ -149,10 +359,11 @@ int     main(int argc, char *argv[]) {
     }
     // Cleanup temporary file
     cleanup:
-    unlink(path);
+    if (path) unlink(path);
     free(path);
-    for (int i = 0; i < n; i++) free(files[i]);
-    free(files);
+    names_delete(&input);
+    for (size_t p = 0; p < NPatterns; p++) pattern_delete(&Patterns[p]);
+    free(Patterns);
     return estatus;
 }
 
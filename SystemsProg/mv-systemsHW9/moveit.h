@@ -0,0 +1,89 @@
+/* moveit.h: Interactive Move Command */
+
+#pragma once
+
+#include <regex.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Rename Structure */
+
+typedef struct {
+    const char *source;     // Current path
+    const char *target;     // New path
+    size_t      from;       // Directory of source (index into plan's directories)
+    size_t      to;         // Directory of target (index into plan's directories)
+} Rename;
+
+/* Plan Structure */
+
+#define PLAN_MAXJOBS    16      // Most rename threads
+
+typedef struct {
+    const char *path;       // Path the directory part of which this is
+    size_t      length;     // Length of directory part (0 for the current one)
+    bool        cached;     // Names may be resolved from a descriptor opened once
+    int         fd;         // Descriptor while executing (AT_FDCWD if not cached)
+} Directory;
+
+typedef struct {
+    bool        cycle;      // Renames form a cycle (first one is parked)
+    size_t      start;      // Index of first rename in order
+    size_t      count;      // Number of renames
+    size_t      group;      // Group of tasks run by one thread, in order
+    char       *temp;       // Name first rename of a cycle is parked under
+} Task;
+
+typedef struct {
+    Rename     *renames;    // Renames that change a path
+    size_t      count;      // Number of renames
+    size_t     *order;      // Indices of renames, task by task, in execution order
+    Task       *tasks;      // Chains and cycles of dependent renames
+    size_t      ntasks;     // Number of tasks
+    size_t      ngroups;    // Number of groups of tasks
+    bool        nested;     // Some path lies inside another renamed path
+    Directory  *directories;    // Directories renames resolve names in
+    size_t      ndirectories;   // Number of directories
+} Plan;
+
+bool    plan_build(Plan *p, char **sources, char **targets, size_t n);
+bool    plan_execute(Plan *p, size_t jobs, bool sync);
+void    plan_delete(Plan *p);
+
+/* Journal Functions */
+
+#define JOURNAL_PATH    ".moveit.journal"   // Journal of unfinished run (in current directory)
+#define JOURNAL_MAGIC   "MOVEITJ2"          // Magic (and version) of journal files
+
+bool    journal_write(const Plan *p, const char *path, bool replace);
+bool    journal_recover(const char *path, bool forward, size_t jobs, bool sync);
+
+/* Names Structure */
+
+#define NAMES_BUFSIZ    (1 << 16)   // Bytes written (or first read) at a time
+
+typedef struct {
+    char       *data;       // Contents, with each name NUL-terminated in place
+    size_t      length;     // Bytes of contents
+    bool        mapped;     // Contents are mapped rather than allocated
+    char      **names;      // Pointers to names in contents
+    size_t      count;      // Number of names
+} Names;
+
+bool    names_write(int fd, char **names, size_t n, char delimiter);
+bool    names_read(Names *l, int fd, char delimiter);
+void    names_delete(Names *l);
+
+/* Pattern Structure */
+
+typedef struct {
+    regex_t     regex;          // Compiled regular expression
+    char       *replacement;    // Replacement text (with & and \1 .. \9)
+    bool        global;         // Replace every match, not just the first
+} Pattern;
+
+bool    pattern_compile(Pattern *p, const char *expression);
+char *  pattern_apply(const Pattern *p, const char *path);
+void    pattern_delete(Pattern *p);
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
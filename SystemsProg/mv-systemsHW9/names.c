@@ -0,0 +1,160 @@
+/* names.c: Read and write lists of path names in bulk */
+
+#include "moveit.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Functions */
+
+/**
+ * Write all of buffer to fd.
+ * @param   fd          File descriptor
+ * @param   buffer      Bytes to write
+ * @param   n           Number of bytes
+ * @return  Whether or not every byte was written.
+ **/
+static bool names_flush(int fd, const char *buffer, size_t n) {
+    while (n > 0) {
+        ssize_t written = write(fd, buffer, n);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        buffer += written;
+        n      -= written;
+    }
+    return true;
+}
+
+/**
+ * Write names to fd, each followed by delimiter, a buffer at a time.
+ * Names that contain the delimiter could not be read back, so are refused.
+ * @param   fd          File descriptor
+ * @param   names       Array of names
+ * @param   n           Number of names
+ * @param   delimiter   Byte written after each name ('\n' or 0)
+ * @return  Whether or not every name was written.
+ **/
+bool    names_write(int fd, char **names, size_t n, char delimiter) {
+    char   buffer[NAMES_BUFSIZ];
+    size_t used = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        const char *name   = names[i];
+        size_t      length = strlen(name);
+        if (delimiter && memchr(name, delimiter, length)) {
+            errno = EINVAL;
+            return false;
+        }
+
+        // Long names go straight through rather than in pieces
+        if (used + length + 1 > sizeof(buffer)) {
+            if (!names_flush(fd, buffer, used)) return false;
+            used = 0;
+        }
+        if (length + 1 > sizeof(buffer)) {
+            if (!names_flush(fd, name, length) || !names_flush(fd, &delimiter, 1)) return false;
+            continue;
+        }
+        memcpy(buffer + used, name, length);
+        used += length;
+        buffer[used++] = delimiter;
+    }
+    return names_flush(fd, buffer, used);
+}
+
+/**
+ * Load contents of fd into memory with room for a NUL after the last byte:
+ * mapped privately if it is a regular file whose last page has room to
+ * spare, and read into one growing buffer otherwise (pipes, for instance).
+ * @param   l           Pointer to Names structure
+ * @param   fd          File descriptor
+ * @return  Whether or not the contents could be loaded.
+ **/
+static bool names_load(Names *l, int fd) {
+    struct stat s    = {0};
+    long        page = sysconf(_SC_PAGESIZE);
+
+    if (fstat(fd, &s) == 0 && S_ISREG(s.st_mode) && s.st_size > 0 && s.st_size % page != 0) {
+        void *data = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            l->data   = data;
+            l->length = s.st_size;
+            l->mapped = true;
+            return true;
+        }
+    }
+
+    // Room for the contents, the NUL, and the read that finds the end
+    size_t capacity = S_ISREG(s.st_mode) && s.st_size > 0 ? (size_t)s.st_size + 2 : NAMES_BUFSIZ;
+    for (;;) {
+        if (l->length + 1 >= capacity || !l->data) {
+            if (l->data) capacity *= 2;
+            char *data = realloc(l->data, capacity);
+            if (!data) return false;
+            l->data = data;
+        }
+
+        ssize_t n = read(fd, l->data + l->length, capacity - l->length - 1);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) return true;
+        l->length += n;
+    }
+}
+
+/**
+ * Read names from fd, each ended by delimiter (the last one need not be).
+ * Names are split in place, so reading takes two allocations however many
+ * names there are: the contents (unless mapped) and the array of names.
+ * @param   l           Pointer to Names structure
+ * @param   fd          File descriptor
+ * @param   delimiter   Byte that ends each name ('\n' or 0)
+ * @return  Whether or not the names could be read.
+ **/
+bool    names_read(Names *l, int fd, char delimiter) {
+    memset(l, 0, sizeof(Names));
+    if (!names_load(l, fd)) goto failure;
+
+    size_t count = 0;
+    for (char *s = l->data, *end = l->data + l->length; s < end; count++) {
+        char *next = memchr(s, delimiter, end - s);
+        s = next ? next + 1 : end;
+    }
+
+    if (!(l->names = malloc((count ? count : 1) * sizeof(char *)))) goto failure;
+    for (char *s = l->data, *end = l->data + l->length; s < end; ) {
+        char *next = memchr(s, delimiter, end - s);
+        l->names[l->count++] = s;
+        if (!next) {
+            *end = 0;
+            break;
+        }
+        *next = 0;
+        s     = next + 1;
+    }
+    return true;
+
+failure:
+    names_delete(l);
+    return false;
+}
+
+/**
+ * Release names.
+ * @param   l           Pointer to Names structure
+ **/
+void    names_delete(Names *l) {
+    if (l->mapped) {
+        munmap(l->data, l->length);
+    } else {
+        free(l->data);
+    }
+    free(l->names);
+    memset(l, 0, sizeof(Names));
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,210 @@
+/* names.unit.c: Name list unit test */
+
+#include "moveit.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+
+#define NAMES       10000
+
+/* Allocation Counting */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+size_t Allocations = 0;     // Calls to malloc, calloc, and realloc so far
+
+void *malloc(size_t size) {
+    Allocations++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size) {
+    Allocations++;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    Allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+/* Functions */
+
+/**
+ * Make n names, some longer than a write buffer.
+ * @param   n           Number of names
+ * @return  Newly allocated array of newly allocated names.
+ **/
+char **make_names(size_t n) {
+    char **names = calloc(n, sizeof(char *));
+    assert(names);
+    for (size_t i = 0; i < n; i++) {
+        size_t length = i % 1000 == 999 ? NAMES_BUFSIZ + 17 : 8 + i % 40;
+        assert((names[i] = malloc(length + 1)));
+        for (size_t c = 0; c < length; c++) {
+            names[i][c] = 'a' + (i + c) % 26;
+        }
+        names[i][length] = 0;
+
+        char prefix[BUFSIZ];
+        int  p = snprintf(prefix, sizeof(prefix), "d%zu/", i);
+        memcpy(names[i], prefix, p);
+    }
+    return names;
+}
+
+void free_names(char **names, size_t n) {
+    for (size_t i = 0; i < n; i++) free(names[i]);
+    free(names);
+}
+
+/**
+ * Write names to a new temporary file, and open it for reading.
+ * @param   names       Array of names
+ * @param   n           Number of names
+ * @param   delimiter   Byte that ends each name
+ * @param   extra       Bytes written after names (NULL for none)
+ * @return  Descriptor of file, at its start.
+ **/
+int temp_names(char **names, size_t n, char delimiter, const char *extra) {
+    char path[] = "/tmp/names.unit.XXXXXX";
+    int  fd     = mkstemp(path);
+    assert(fd >= 0);
+    unlink(path);
+
+    size_t allocations = Allocations;
+    assert(names_write(fd, names, n, delimiter));
+    assert(Allocations == allocations);
+    if (extra) assert(write(fd, extra, strlen(extra)) == (ssize_t)strlen(extra));
+    assert(lseek(fd, 0, SEEK_SET) == 0);
+    return fd;
+}
+
+/* Tests */
+
+int test_00_names_round_trip() {
+    char **names = make_names(NAMES);
+    Names  l;
+
+    // Test: names come back whole with either delimiter, long ones included
+    for (int d = 0; d < 2; d++) {
+        char delimiter = d ? 0 : '\n';
+        int  fd        = temp_names(names, NAMES, delimiter, NULL);
+        assert(names_read(&l, fd, delimiter));
+        assert(l.count == NAMES);
+        for (size_t i = 0; i < NAMES; i++) {
+            assert(streq(l.names[i], names[i]));
+        }
+        names_delete(&l);
+        close(fd);
+    }
+
+    // Test: last name need not be ended, empty lines are names
+    char *few[] = {"a", "", "b c"};
+    int   fd    = temp_names(few, 3, '\n', "last");
+    assert(names_read(&l, fd, '\n'));
+    assert(l.count == 4 && streq(l.names[1], "") && streq(l.names[2], "b c") && streq(l.names[3], "last"));
+    names_delete(&l);
+    close(fd);
+
+    // Test: names holding the delimiter are refused, NUL keeps newlines
+    char *odd[] = {"one\ntwo"};
+    assert(!names_write(STDOUT_FILENO, odd, 1, '\n') && errno == EINVAL);
+    fd = temp_names(odd, 1, 0, NULL);
+    assert(names_read(&l, fd, 0));
+    assert(l.count == 1 && streq(l.names[0], "one\ntwo"));
+    names_delete(&l);
+    close(fd);
+
+    // Test: nothing to read
+    fd = temp_names(NULL, 0, '\n', NULL);
+    assert(names_read(&l, fd, '\n') && l.count == 0);
+    names_delete(&l);
+    close(fd);
+
+    free_names(names, NAMES);
+    return EXIT_SUCCESS;
+}
+
+int test_01_names_allocations() {
+    char **names = make_names(NAMES);
+    Names  l;
+
+    // Test: a file is mapped, so reading it takes only the array of names,
+    // however many names it has
+    for (size_t n = 10; n <= NAMES; n *= 10) {
+        int    fd          = temp_names(names, n, '\n', NULL);
+        size_t allocations = Allocations;
+        assert(names_read(&l, fd, '\n'));
+        assert(l.mapped && Allocations - allocations == 1);
+        names_delete(&l);
+        close(fd);
+    }
+
+    // Test: a file that fills its last page is read into one buffer instead
+    long  page = sysconf(_SC_PAGESIZE);
+    char *full = malloc(page);
+    assert(full);
+    memset(full, 'p', page - 1);
+    full[page - 1] = 0;
+    char  *one[]       = {full};
+    int    fd          = temp_names(one, 1, '\n', NULL);
+    size_t allocations = Allocations;
+    assert(names_read(&l, fd, '\n'));
+    assert(!l.mapped && Allocations - allocations == 2);
+    assert(l.count == 1 && streq(l.names[0], full));
+    names_delete(&l);
+    close(fd);
+    free(full);
+
+    // Test: a pipe is read into one buffer that grows only as needed
+    int pipes[2];
+    assert(pipe(pipes) == 0);
+    assert(names_write(pipes[1], names, 100, 0));
+    close(pipes[1]);
+    allocations = Allocations;
+    assert(names_read(&l, pipes[0], 0));
+    assert(!l.mapped && Allocations - allocations == 2);
+    assert(l.count == 100 && streq(l.names[99], names[99]));
+    names_delete(&l);
+    close(pipes[0]);
+
+    free_names(names, NAMES);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test names round trip\n");
+        fprintf(stderr, "    1  Test names allocations\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_names_round_trip(); break;
+        case 1:  status = test_01_names_allocations(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,192 @@
+/* pattern.c: sed-style substitutions on paths */
+
+#include "moveit.h"
+
+#include <ctype.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Buffer Structure */
+
+typedef struct {
+    char       *data;       // Text built so far (NUL-terminated)
+    size_t      length;     // Bytes used
+    size_t      capacity;   // Bytes allocated
+} Buffer;
+
+/* Buffer Functions */
+
+static bool buffer_append(Buffer *b, const char *s, size_t n) {
+    if (b->length + n + 1 > b->capacity) {
+        size_t capacity = b->capacity ? b->capacity : 64;
+        while (b->length + n + 1 > capacity) capacity *= 2;
+
+        char *data = realloc(b->data, capacity);
+        if (!data) return false;
+        b->data     = data;
+        b->capacity = capacity;
+    }
+    memcpy(b->data + b->length, s, n);
+    b->length += n;
+    b->data[b->length] = 0;
+    return true;
+}
+
+/* Pattern Functions */
+
+/**
+ * Copy up to the next unescaped delimiter, dropping the backslash of an
+ * escaped delimiter (other escapes are kept for regcomp or for replacement).
+ * @param   s           Text to copy from
+ * @param   delimiter   Delimiter that ends the part
+ * @param   end         Set to delimiter that ended the part (NULL if none)
+ * @return  Newly allocated copy of part (must be freed).
+ **/
+static char *pattern_part(const char *s, char delimiter, const char **end) {
+    char  *part = malloc(strlen(s) + 1);
+    size_t n    = 0;
+    if (!part) return NULL;
+
+    for (; *s && *s != delimiter; s++) {
+        if (*s == '\\' && s[1] == delimiter) {
+            s++;
+        } else if (*s == '\\' && s[1]) {
+            part[n++] = *s++;
+        }
+        part[n++] = *s;
+    }
+    part[n] = 0;
+    *end    = *s ? s : NULL;
+    return part;
+}
+
+/**
+ * Compile substitution of the form s/regex/replacement/flags, where any
+ * character may stand in for /, regex is extended, and flags are g (replace
+ * every match, not just the first) and i (ignore case).
+ * @param   p           Pointer to Pattern structure
+ * @param   expression  Substitution to compile
+ * @return  Whether or not the substitution is valid.
+ **/
+bool    pattern_compile(Pattern *p, const char *expression) {
+    const char *end   = NULL;
+    char       *regex = NULL;
+    int         flags = REG_EXTENDED;
+
+    memset(p, 0, sizeof(Pattern));
+    if (expression[0] != 's' || !expression[1] || expression[1] == '\\') goto invalid;
+
+    char delimiter = expression[1];
+    if (!(regex = pattern_part(expression + 2, delimiter, &end)) || !end) goto invalid;
+    if (!(p->replacement = pattern_part(end + 1, delimiter, &end)) || !end) goto invalid;
+
+    for (const char *f = end + 1; *f; f++) {
+        switch (*f) {
+            case 'g': p->global = true; break;
+            case 'i': flags |= REG_ICASE; break;
+            default:  goto invalid;
+        }
+    }
+
+    int status = regcomp(&p->regex, regex, flags);
+    if (status != 0) {
+        char message[BUFSIZ];
+        regerror(status, &p->regex, message, sizeof(message));
+        fprintf(stderr, "moveit: %s: %s\n", expression, message);
+        goto failure;
+    }
+    free(regex);
+    return true;
+
+invalid:
+    fprintf(stderr, "moveit: %s: not of the form s/regex/replacement/flags\n", expression);
+
+failure:
+    free(regex);
+    free(p->replacement);
+    p->replacement = NULL;
+    return false;
+}
+
+/**
+ * Apply substitution to path.  In the replacement, & stands for the whole
+ * match and \1 through \9 for groups, as in sed.  With g, an empty match
+ * right after the previous match is not replaced (so b* turns abc into
+ * -a-c- when replaced by -, not -a--c-).
+ * @param   p           Pointer to Pattern structure
+ * @param   path        Path to rewrite
+ * @return  Newly allocated new path (must be freed), or NULL on failure.
+ **/
+char *  pattern_apply(const Pattern *p, const char *path) {
+    Buffer      b     = {0};
+    const char *s     = path;
+    const char *last  = NULL;   // Where the previous match ended
+    int         flags = 0;
+    regmatch_t  match[10];
+
+    if (!buffer_append(&b, "", 0)) return NULL;
+    while (regexec(&p->regex, s, 10, match, flags) == 0) {
+        // An empty match right where the previous one ended is passed over, as in sed
+        if (match[0].rm_so == match[0].rm_eo && s + match[0].rm_so == last) {
+            s += match[0].rm_so;
+            if (!*s) break;
+            if (!buffer_append(&b, s++, 1)) goto failure;
+            flags = REG_NOTBOL;
+            continue;
+        }
+        if (!buffer_append(&b, s, match[0].rm_so)) goto failure;
+
+        for (const char *r = p->replacement; *r; r++) {
+            const char *text = r;
+            size_t      n    = 1;
+            int         g    = -1;
+
+            if (*r == '&') {
+                g = 0;
+            } else if (*r == '\\' && isdigit((unsigned char)r[1])) {
+                g = *++r - '0';
+            } else if (*r == '\\' && r[1]) {
+                text = ++r;
+            }
+            if (g >= 0) {
+                text = s + match[g].rm_so;
+                n    = match[g].rm_so < 0 ? 0 : (size_t)(match[g].rm_eo - match[g].rm_so);
+            }
+            if (!buffer_append(&b, text, n)) goto failure;
+        }
+
+        // An empty match still has to move past a character
+        bool empty = match[0].rm_eo == match[0].rm_so;
+        s   += match[0].rm_eo;
+        last = s;
+        if (empty) {
+            if (!*s) break;
+            if (!buffer_append(&b, s++, 1)) goto failure;
+        }
+        flags = REG_NOTBOL;
+        if (!p->global) break;
+    }
+
+    if (!buffer_append(&b, s, strlen(s))) goto failure;
+    return b.data;
+
+failure:
+    free(b.data);
+    return NULL;
+}
+
+/**
+ * Release substitution.
+ * @param   p           Pointer to Pattern structure
+ **/
+void    pattern_delete(Pattern *p) {
+    if (p->replacement) {
+        regfree(&p->regex);
+        free(p->replacement);
+    }
+    memset(p, 0, sizeof(Pattern));
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,114 @@
+/* pattern.unit.c: Substitution unit test */
+
+#include "moveit.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+#define nargs(a)    (sizeof(a) / sizeof((a)[0]))
+
+/* Functions */
+
+/**
+ * Determine if substitution turns path into expected, as sed -E would.
+ * @param   expression  Substitution to apply
+ * @param   path        Path to rewrite
+ * @param   expected    Path wanted
+ * @return  Whether or not the substitution gave expected.
+ **/
+bool substitutes(const char *expression, const char *path, const char *expected) {
+    Pattern p;
+    assert(pattern_compile(&p, expression));
+
+    char *result = pattern_apply(&p, path);
+    assert(result);
+    bool same = streq(result, expected);
+    if (!same) fprintf(stderr, "%s on %s: %s, not %s\n", expression, path, result, expected);
+
+    free(result);
+    pattern_delete(&p);
+    return same;
+}
+
+/* Tests */
+
+int test_00_pattern_compile() {
+    Pattern p;
+
+    // Test: any delimiter, escaped delimiters, and flags are accepted
+    char *valid[] = {"s/a/b/", "s,a,b,", "s|a\\|b|c|g", "s/a//", "s/a/b/gi", "s/a/b/ig", "s#a/b#c/d#"};
+    for (size_t i = 0; i < nargs(valid); i++) {
+        assert(pattern_compile(&p, valid[i]));
+        pattern_delete(&p);
+    }
+    assert(pattern_compile(&p, "s/a/b/g") && p.global);
+    pattern_delete(&p);
+    assert(pattern_compile(&p, "s/a/b/") && !p.global);
+    pattern_delete(&p);
+
+    // Test: other forms, unknown flags, and bad regexes are refused
+    char *invalid[] = {"", "s", "y/a/b/", "s/a/b", "s/a", "s\\a\\b\\", "s/a/b/x", "s/(/b/", "s/a{2/b/"};
+    for (size_t i = 0; i < nargs(invalid); i++) {
+        assert(!pattern_compile(&p, invalid[i]));
+        assert(!p.replacement);
+        pattern_delete(&p);
+    }
+    return EXIT_SUCCESS;
+}
+
+int test_01_pattern_apply() {
+    // Test: first match only, or every match with g, ignoring case with i
+    assert(substitutes("s/a/x/", "banana", "bxnana"));
+    assert(substitutes("s/a/x/g", "banana", "bxnxnx"));
+    assert(substitutes("s/a/x/gi", "AbAb", "xbxb"));
+    assert(substitutes("s/q/x/g", "banana", "banana"));
+    assert(substitutes("s,/,_,g", "a/b/c", "a_b_c"));
+
+    // Test: & is the whole match, \N a group (empty if it did not take part)
+    assert(substitutes("s/[0-9]/<&>/g", "dir/f1", "dir/f<1>"));
+    assert(substitutes("s/(.*)\\.txt/\\1.md/", "foo.txt", "foo.md"));
+    assert(substitutes("s/(a)(x)?b/[\\2\\1]/g", "abab", "[a][a]"));
+    assert(substitutes("s/(.)(.)/\\2\\1/g", "abcd", "badc"));
+    assert(substitutes("s/a/\\&\\\\/", "a", "&\\"));
+
+    // Test: empty matches, including right after a match, as in sed
+    assert(substitutes("s/b*/-/g", "abc", "-a-c-"));
+    assert(substitutes("s/x*/-/g", "abc", "-a-b-c-"));
+    assert(substitutes("s/b*/-/", "abc", "-abc"));
+    assert(substitutes("s/c*$/-/g", "abc", "ab-"));
+    assert(substitutes("s/l*/X/g", "hello", "XhXeXoX"));
+    assert(substitutes("s/a*/x/g", "baaac", "xbxcx"));
+    assert(substitutes("s/^/pre-/g", "abc", "pre-abc"));
+    assert(substitutes("s/x*/-/g", "", "-"));
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test pattern compile\n");
+        fprintf(stderr, "    1  Test pattern apply\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_pattern_compile(); break;
+        case 1:  status = test_01_pattern_apply(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,681 @@
+/* plan.c: Order renames so that none clobbers another */
+
+#define _GNU_SOURCE     // renameat2, qsort_r
+
+#include "moveit.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+
+#define NONE        ((size_t)-1)
+
+/* Table Structure */
+
+typedef struct {
+    size_t     *slots;      // Index of rename plus one (0 for an empty slot)
+    size_t      capacity;   // Number of slots (power of two)
+} Table;
+
+/* Executor Structure */
+
+typedef struct {
+    Plan           *plan;   // Plan being executed
+    size_t         *groups; // Index of first task of each group (plus end)
+    atomic_size_t   next;   // Next group to claim
+    atomic_bool     ok;     // Whether or not every rename succeeded
+} Executor;
+
+/* Table Functions */
+
+static uint64_t table_hash(const char *s, size_t n) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * Allocate table with room for n paths at most half full.
+ * @param   t           Pointer to Table structure
+ * @param   n           Number of paths
+ * @return  Whether or not the table could be allocated.
+ **/
+static bool table_init(Table *t, size_t n) {
+    for (t->capacity = 16; t->capacity < 2 * n; t->capacity *= 2);
+    t->slots = calloc(t->capacity, sizeof(size_t));
+    return t->slots != NULL;
+}
+
+/**
+ * Find slot of the first n bytes of path among sources (or targets) of
+ * renames.
+ * @param   t           Pointer to Table structure
+ * @param   renames     Renames indexed by table
+ * @param   path        Path to look up
+ * @param   n           Length of path
+ * @param   target      Whether table is keyed by target instead of source
+ * @return  Pointer to slot holding path, or to empty slot where it belongs.
+ **/
+static size_t *table_slot(Table *t, const Rename *renames, const char *path, size_t n, bool target) {
+    size_t mask = t->capacity - 1;
+    for (size_t i = table_hash(path, n) & mask; ; i = (i + 1) & mask) {
+        if (!t->slots[i]) return &t->slots[i];
+
+        const char *key = target ? renames[t->slots[i] - 1].target : renames[t->slots[i] - 1].source;
+        if (!strncmp(key, path, n) && !key[n]) return &t->slots[i];
+    }
+}
+
+/* Plan Functions */
+
+/**
+ * Order tasks by directory of the first path they create, then by directory
+ * of the first path they remove, so renames between the same directories
+ * end up next to each other.
+ **/
+static int plan_compare(const void *a, const void *b, void *arg) {
+    const Plan   *p = arg;
+    const Task   *x = a;
+    const Task   *y = b;
+    const Rename *r = &p->renames[p->order[x->start]];
+    const Rename *q = &p->renames[p->order[y->start]];
+
+    if (r->to != q->to) return r->to < q->to ? -1 : 1;
+    if (r->from != q->from) return r->from < q->from ? -1 : 1;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+/**
+ * Determine if the first n bytes of path, or any directory above them, is
+ * the source or target of a rename (so names in it may not stay put).
+ * @param   sources     Table of sources
+ * @param   targets     Table of targets
+ * @param   renames     Renames indexed by tables
+ * @param   path        Path to check
+ * @param   n           Length of path
+ * @return  Whether or not path or a parent is being renamed.
+ **/
+static bool plan_renamed(Table *sources, Table *targets, const Rename *renames, const char *path, size_t n) {
+    for (size_t i = 1; i <= n; i++) {
+        if (i < n && path[i] != '/') continue;
+        if (*table_slot(sources, renames, path, i, false) || *table_slot(targets, renames, path, i, true)) return true;
+    }
+    return false;
+}
+
+/**
+ * Determine if any directory above path is itself the source or target of a
+ * rename, so that whether path can be found depends on when that one runs.
+ * @param   sources     Table of sources
+ * @param   targets     Table of targets
+ * @param   renames     Renames indexed by tables
+ * @param   path        Path to check
+ * @return  Whether or not a parent of path is being renamed.
+ **/
+static bool plan_nested(Table *sources, Table *targets, const Rename *renames, const char *path) {
+    const char *slash = strrchr(path, '/');
+    return slash && slash > path && plan_renamed(sources, targets, renames, path, slash - path);
+}
+
+/**
+ * Collect dependencies between tasks of a nested plan, as pairs of task
+ * indices where the first has to run before the second: a task that creates
+ * a directory goes before any that moves into or out of it, and a task that
+ * moves a file out of a directory goes before the one that moves the
+ * directory itself away.
+ * @param   p           Pointer to Plan structure
+ * @param   sources     Table of sources
+ * @param   targets     Table of targets
+ * @param   taskof      Index of task of each rename
+ * @param   pairs       Filled in with pairs (NULL to only count them)
+ * @return  Number of pairs.
+ **/
+static size_t plan_edges(const Plan *p, Table *sources, Table *targets, const size_t *taskof, size_t *pairs) {
+    size_t n = 0;
+
+    for (size_t i = 0; i < p->count; i++) {
+        for (int side = 0; side < 2; side++) {
+            const char *path = side ? p->renames[i].target : p->renames[i].source;
+            for (const char *s = strchr(path, '/'); s; s = strchr(s + 1, '/')) {
+                if (s == path) continue;
+
+                size_t created = *table_slot(targets, p->renames, path, s - path, true);
+                size_t removed = side ? 0 : *table_slot(sources, p->renames, path, s - path, false);
+                if (created && taskof[created - 1] != taskof[i]) {
+                    if (pairs) {
+                        pairs[2 * n]     = taskof[created - 1];
+                        pairs[2 * n + 1] = taskof[i];
+                    }
+                    n++;
+                }
+                if (removed && taskof[removed - 1] != taskof[i]) {
+                    if (pairs) {
+                        pairs[2 * n]     = taskof[i];
+                        pairs[2 * n + 1] = taskof[removed - 1];
+                    }
+                    n++;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+/**
+ * Order tasks of a nested plan so that each runs after the tasks it depends
+ * on, and otherwise in the order they were planned in.  Where dependencies
+ * contradict each other (a cycle), the task reached first waits on the rest.
+ * @param   p           Pointer to Plan structure
+ * @param   sources     Table of sources
+ * @param   targets     Table of targets
+ * @return  Whether or not the tasks could be ordered.
+ **/
+static bool plan_order(Plan *p, Table *sources, Table *targets) {
+    size_t *taskof = malloc((p->count ? p->count : 1) * sizeof(size_t));
+    size_t *first  = calloc(p->ntasks + 1, sizeof(size_t));
+    size_t *cursor = malloc((p->ntasks ? p->ntasks : 1) * sizeof(size_t));
+    size_t *stack  = malloc((p->ntasks ? p->ntasks : 1) * sizeof(size_t));
+    char   *state  = calloc(p->ntasks ? p->ntasks : 1, sizeof(char));
+    Task   *tasks  = malloc((p->ntasks ? p->ntasks : 1) * sizeof(Task));
+    size_t *pairs  = NULL;
+    size_t *before = NULL;
+    bool    ok     = false;
+    if (!taskof || !first || !cursor || !stack || !state || !tasks) goto cleanup;
+
+    for (size_t t = 0; t < p->ntasks; t++) {
+        for (size_t m = 0; m < p->tasks[t].count; m++) {
+            taskof[p->order[p->tasks[t].start + m]] = t;
+        }
+    }
+
+    // Tasks each one waits on, gathered by the task waiting
+    size_t n = plan_edges(p, sources, targets, taskof, NULL);
+    pairs  = malloc((n ? 2 * n : 1) * sizeof(size_t));
+    before = malloc((n ? n : 1) * sizeof(size_t));
+    if (!pairs || !before) goto cleanup;
+    plan_edges(p, sources, targets, taskof, pairs);
+
+    for (size_t e = 0; e < n; e++) first[pairs[2 * e + 1] + 1]++;
+    for (size_t t = 0; t < p->ntasks; t++) {
+        first[t + 1] += first[t];
+        cursor[t]     = first[t];
+    }
+    for (size_t e = 0; e < n; e++) before[cursor[pairs[2 * e + 1]]++] = pairs[2 * e];
+
+    // Depth first from each task in turn, emitting tasks it waits on first
+    // (a task already on the stack is a contradiction, and is passed over)
+    size_t used = 0;
+    for (size_t t = 0; t < p->ntasks; t++) {
+        if (state[t]) continue;
+
+        size_t depth = 0;
+        stack[depth++] = t;
+        cursor[t]      = first[t];
+        state[t]       = 1;
+        while (depth) {
+            size_t top = stack[depth - 1];
+            if (cursor[top] < first[top + 1]) {
+                size_t q = before[cursor[top]++];
+                if (!state[q]) {
+                    stack[depth++] = q;
+                    cursor[q]      = first[q];
+                    state[q]       = 1;
+                }
+                continue;
+            }
+            state[top]    = 2;
+            tasks[used++] = p->tasks[top];
+            depth--;
+        }
+    }
+    memcpy(p->tasks, tasks, p->ntasks * sizeof(Task));
+    ok = true;
+
+cleanup:
+    free(taskof);
+    free(first);
+    free(cursor);
+    free(stack);
+    free(state);
+    free(tasks);
+    free(pairs);
+    free(before);
+    return ok;
+}
+
+/**
+ * Find the directory path lies in among those of the plan, adding it if new.
+ * @param   p           Pointer to Plan structure
+ * @param   t           Table of directories (slots hold index plus one)
+ * @param   path        Path to find directory of
+ * @return  Index of directory.
+ **/
+static size_t plan_intern(Plan *p, Table *t, const char *path) {
+    const char *slash  = strrchr(path, '/');
+    size_t      length = !slash ? 0 : slash == path ? 1 : (size_t)(slash - path);
+    size_t      mask   = t->capacity - 1;
+
+    for (size_t i = table_hash(path, length) & mask; ; i = (i + 1) & mask) {
+        if (!t->slots[i]) {
+            p->directories[p->ndirectories] = (Directory){.path = path, .length = length, .fd = AT_FDCWD};
+            t->slots[i] = ++p->ndirectories;
+            return p->ndirectories - 1;
+        }
+
+        Directory *d = &p->directories[t->slots[i] - 1];
+        if (d->length == length && !memcmp(d->path, path, length)) return t->slots[i] - 1;
+    }
+}
+
+/**
+ * Build plan for renaming each of sources to the corresponding target (NULL
+ * or identical targets are left alone).  A rename whose target is another
+ * rename's source must wait until that one has moved out of the way, so
+ * renames form chains (run from the end) and cycles (run by parking one file
+ * under a temporary name, or as an exchange when there are only two).
+ * Sources listed twice, and targets shared by two renames, are refused.
+ * Renames inside directories that are themselves renamed (or created) run
+ * on one thread, each after the renames it depends on.  The directories
+ * names are resolved in are collected too, so each can be opened once while
+ * executing (unless it is itself being renamed).
+ * @param   p           Pointer to Plan structure
+ * @param   sources     Current paths
+ * @param   targets     New paths
+ * @param   n           Number of paths
+ * @return  Whether or not the renames can be carried out safely.
+ **/
+bool    plan_build(Plan *p, char **sources, char **targets, size_t n) {
+    Table   bysource = {0};
+    Table   bytarget = {0};
+    Table   bydirectory = {0};
+    size_t *next     = NULL;
+    bool   *head     = NULL;
+    bool   *planned  = NULL;
+    bool    ok       = false;
+
+    memset(p, 0, sizeof(Plan));
+    p->renames = malloc((n ? n : 1) * sizeof(Rename));
+    p->order   = malloc((n ? n : 1) * sizeof(size_t));
+    p->tasks   = malloc((n ? n : 1) * sizeof(Task));
+    next       = malloc((n ? n : 1) * sizeof(size_t));
+    head       = malloc((n ? n : 1) * sizeof(bool));
+    planned    = calloc(n ? n : 1, sizeof(bool));
+    p->directories = malloc((n ? 2 * n : 1) * sizeof(Directory));
+    if (!p->renames || !p->order || !p->tasks || !next || !head || !planned || !p->directories) goto cleanup;
+
+    for (size_t i = 0; i < n; i++) {
+        if (targets[i] && !streq(sources[i], targets[i])) {
+            p->renames[p->count++] = (Rename){sources[i], targets[i]};
+        }
+    }
+
+    // Index renames by source and by target, refusing ambiguous ones
+    if (!table_init(&bysource, p->count) || !table_init(&bytarget, p->count)) goto cleanup;
+    for (size_t i = 0; i < p->count; i++) {
+        Rename *r    = &p->renames[i];
+        size_t *slot = table_slot(&bysource, p->renames, r->source, strlen(r->source), false);
+        if (*slot) {
+            fprintf(stderr, "moveit: %s: listed more than once\n", r->source);
+            goto cleanup;
+        }
+        *slot = i + 1;
+
+        slot = table_slot(&bytarget, p->renames, r->target, strlen(r->target), true);
+        if (*slot) {
+            fprintf(stderr, "moveit: %s and %s would both be renamed to %s\n", p->renames[*slot - 1].source, r->source, r->target);
+            goto cleanup;
+        }
+        *slot = i + 1;
+    }
+
+    // Each rename waits on at most one other: whichever currently has its target
+    for (size_t i = 0; i < p->count; i++) head[i] = true;
+    for (size_t i = 0; i < p->count; i++) {
+        size_t found = *table_slot(&bysource, p->renames, p->renames[i].target, strlen(p->renames[i].target), false);
+        next[i] = found ? found - 1 : NONE;
+        if (found) head[found - 1] = false;
+        p->nested = p->nested || plan_nested(&bysource, &bytarget, p->renames, p->renames[i].source) ||
+                                 plan_nested(&bysource, &bytarget, p->renames, p->renames[i].target);
+    }
+
+    // Directories whose path stays put can be opened once and resolved from
+    if (!table_init(&bydirectory, 2 * p->count)) goto cleanup;
+    for (size_t i = 0; i < p->count; i++) {
+        p->renames[i].from = plan_intern(p, &bydirectory, p->renames[i].source);
+        p->renames[i].to   = plan_intern(p, &bydirectory, p->renames[i].target);
+    }
+    for (size_t d = 0; d < p->ndirectories; d++) {
+        Directory *directory = &p->directories[d];
+        directory->cached = !p->nested && !plan_renamed(&bysource, &bytarget, p->renames, directory->path, directory->length);
+    }
+
+    // Chains start at renames nobody waits on, and run from their far end
+    size_t used = 0;
+    for (size_t i = 0; i < p->count; i++) {
+        if (!head[i]) continue;
+
+        size_t length = 0;
+        for (size_t k = i; k != NONE; k = next[k]) length++;
+        size_t m = used + length;
+        for (size_t k = i; k != NONE; k = next[k]) {
+            p->order[--m] = k;
+            planned[k]    = true;
+        }
+        p->tasks[p->ntasks++] = (Task){.cycle = false, .start = used, .count = length};
+        used += length;
+    }
+
+    // Everything left is on a cycle: park first, run the rest backwards, unpark
+    for (size_t i = 0; i < p->count; i++) {
+        if (planned[i]) continue;
+
+        size_t length = 0;
+        size_t k      = i;
+        do {
+            length++;
+            k = next[k];
+        } while (k != i);
+
+        p->order[used] = i;
+        planned[i]     = true;
+        size_t m = used + length;
+        for (k = next[i]; k != i; k = next[k]) {
+            p->order[--m] = k;
+            planned[k]    = true;
+        }
+        // Temporary name is fixed now, so a journal can say where to look
+        const char *source = p->renames[i].source;
+        const char *slash  = strrchr(source, '/');
+        int         prefix = slash ? (int)(slash - source + 1) : 0;
+        Task       *t      = &p->tasks[p->ntasks];
+        *t = (Task){.cycle = true, .start = used, .count = length};
+        if (asprintf(&t->temp, "%.*s.moveit.%d.%zu", prefix, source, getpid(), p->ntasks) < 0) {
+            t->temp = NULL;
+            goto cleanup;
+        }
+        p->ntasks++;
+        used += length;
+    }
+
+    // Renames inside renamed directories depend on order, so keep them on one
+    // thread, each after the renames that make its paths exist
+    if (!p->nested) {
+        qsort_r(p->tasks, p->ntasks, sizeof(Task), plan_compare, p);
+    } else if (!plan_order(p, &bysource, &bytarget)) {
+        goto cleanup;
+    }
+    for (size_t t = 0; t < p->ntasks; t++) {
+        bool same = t > 0 && p->nested;
+        if (t > 0 && !p->nested) {
+            same = p->renames[p->order[p->tasks[t - 1].start]].to == p->renames[p->order[p->tasks[t].start]].to;
+        }
+        p->ngroups += !same;
+        p->tasks[t].group = p->ngroups - 1;
+    }
+    ok = true;
+
+cleanup:
+    free(bysource.slots);
+    free(bytarget.slots);
+    free(bydirectory.slots);
+    free(next);
+    free(head);
+    free(planned);
+    return ok;
+}
+
+/**
+ * Resolve path in its directory: by name from the directory's descriptor if
+ * it was opened, or by whole path from the current directory if not.
+ * @param   p           Pointer to Plan structure
+ * @param   path        Path to resolve
+ * @param   d           Index of directory of path
+ * @param   fd          Set to descriptor to resolve name from
+ * @return  Name to resolve.
+ **/
+static const char *plan_resolve(const Plan *p, const char *path, size_t d, int *fd) {
+    *fd = p->directories[d].fd;
+    if (*fd == AT_FDCWD) return path;
+
+    const char *slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+/**
+ * Rename source to target, each resolved in its directory.
+ * @param   p           Pointer to Plan structure
+ * @param   source      Current path
+ * @param   from        Index of directory of source
+ * @param   target      New path
+ * @param   to          Index of directory of target
+ * @param   flags       Flags for renameat2 (0 for a plain rename)
+ * @return  Whether or not source was renamed.
+ **/
+static bool plan_rename(const Plan *p, const char *source, size_t from, const char *target, size_t to, unsigned int flags) {
+    int         sfd, tfd;
+    const char *s = plan_resolve(p, source, from, &sfd);
+    const char *t = plan_resolve(p, target, to, &tfd);
+
+    if (!flags) return renameat(sfd, s, tfd, t) == 0;
+    if (renameat2(sfd, s, tfd, t, flags) == 0) return true;
+
+    // File systems without RENAME_NOREPLACE get a checked rename instead
+    if (errno != EINVAL || flags != RENAME_NOREPLACE) return false;
+    if (faccessat(tfd, t, F_OK, AT_SYMLINK_NOFOLLOW) == 0) {
+        errno = EEXIST;
+        return false;
+    }
+    return renameat(sfd, s, tfd, t) == 0;
+}
+
+/**
+ * Report failed rename.
+ * @param   source      Current path
+ * @param   target      New path
+ **/
+static void plan_report(const char *source, const char *target) {
+    fprintf(stderr, "moveit: %s -> %s: %s\n", source, target, strerror(errno));
+}
+
+/**
+ * Carry out one chain or cycle of renames, stopping at the first failure so
+ * nothing that failed to move out of the way is clobbered.
+ * @param   p           Pointer to Plan structure
+ * @param   t           Pointer to Task structure
+ * @return  Whether or not every rename succeeded.
+ **/
+static bool plan_run(Plan *p, Task *t) {
+    Rename *first = &p->renames[p->order[t->start]];
+    char   *temp  = NULL;
+    size_t  m     = 0;
+
+    if (t->cycle) {
+        if (t->count == 2 && plan_rename(p, first->source, first->from, first->target, first->to, RENAME_EXCHANGE)) {
+            return true;
+        }
+        // Temporary name lies in the directory of the first source
+        if (!plan_rename(p, first->source, first->from, t->temp, first->from, RENAME_NOREPLACE)) {
+            plan_report(first->source, t->temp);
+            return false;
+        }
+        temp = t->temp;
+        m    = 1;
+    }
+
+    for (; m < t->count; m++) {
+        Rename *r = &p->renames[p->order[t->start + m]];
+        if (!plan_rename(p, r->source, r->from, r->target, r->to, 0)) {
+            plan_report(r->source, r->target);
+            goto failure;
+        }
+    }
+
+    if (temp && !plan_rename(p, temp, first->from, first->target, first->to, 0)) {
+        plan_report(temp, first->target);
+        goto failure;
+    }
+    return true;
+
+failure:
+    if (temp) fprintf(stderr, "moveit: %s: left at %s\n", first->source, temp);
+    return false;
+}
+
+/**
+ * Rename thread: claim groups one at a time until none are left.
+ * @param   arg         Pointer to Executor structure
+ * @return  NULL
+ **/
+static void *plan_worker(void *arg) {
+    Executor *e = arg;
+    size_t    g;
+
+    while ((g = atomic_fetch_add(&e->next, 1)) < e->plan->ngroups) {
+        for (size_t t = e->groups[g]; t < e->groups[g + 1]; t++) {
+            if (!plan_run(e->plan, &e->plan->tasks[t])) {
+                atomic_store(&e->ok, false);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Copy directory part of path for system calls.
+ * @param   d           Pointer to Directory structure
+ * @param   buffer      Buffer of PATH_MAX bytes
+ * @return  Directory as a string, or NULL if it is too long.
+ **/
+static const char *plan_directory(const Directory *d, char *buffer) {
+    if (!d->length) return ".";
+    if (d->length >= PATH_MAX) return NULL;
+    memcpy(buffer, d->path, d->length);
+    buffer[d->length] = 0;
+    return buffer;
+}
+
+/**
+ * Open each directory that can be cached once, raising the limit on open
+ * files if there are many.  Directories that cannot be opened are left to
+ * resolve whole paths from the current directory.
+ * @param   p           Pointer to Plan structure
+ **/
+static void plan_open(Plan *p) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < p->ndirectories + 64) {
+        limit.rlim_cur = limit.rlim_max == RLIM_INFINITY || limit.rlim_max > p->ndirectories + 64 ? p->ndirectories + 64 : limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    for (size_t d = 0; d < p->ndirectories; d++) {
+        Directory  *directory = &p->directories[d];
+        char        buffer[PATH_MAX];
+        const char *path      = plan_directory(directory, buffer);
+
+        directory->fd = AT_FDCWD;
+        if (directory->cached && path) {
+            int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd >= 0) directory->fd = fd;
+        }
+    }
+}
+
+/**
+ * Sync each directory renames went into or out of, once.
+ * @param   p           Pointer to Plan structure
+ * @return  Whether or not every directory was synced.
+ **/
+static bool plan_sync(Plan *p) {
+    bool ok = true;
+
+    for (size_t d = 0; d < p->ndirectories; d++) {
+        Directory  *directory = &p->directories[d];
+        char        buffer[PATH_MAX];
+        const char *path      = plan_directory(directory, buffer);
+        int         fd        = directory->fd;
+
+        // Directories not kept open are found by path, unless they went away
+        if (fd < 0 && path && (fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 && errno == ENOENT) continue;
+        if (fd < 0 || fsync(fd) < 0) {
+            fprintf(stderr, "moveit: %s: %s\n", path ? path : directory->path, strerror(errno));
+            ok = false;
+        }
+        if (fd >= 0 && fd != directory->fd) close(fd);
+    }
+    return ok;
+}
+
+/**
+ * Carry out plan with up to jobs threads, each taking a whole group of
+ * tasks (renames into one directory) at a time, so threads rarely contend
+ * for the same directory.  Names are resolved from directories opened once
+ * for the whole plan, and each directory is synced once at the end if asked.
+ * @param   p           Pointer to Plan structure
+ * @param   jobs        Number of threads
+ * @param   sync        Whether or not to sync directories renamed in
+ * @return  Whether or not every rename succeeded.
+ **/
+bool    plan_execute(Plan *p, size_t jobs, bool sync) {
+    Executor  e = {.plan = p};
+    pthread_t threads[PLAN_MAXJOBS];
+    size_t    started = 0;
+
+    if (!(e.groups = malloc((p->ngroups + 1) * sizeof(size_t)))) return false;
+    for (size_t t = 0, g = 0; t <= p->ntasks; t++) {
+        if (t == p->ntasks || t == 0 || p->tasks[t].group != p->tasks[t - 1].group) {
+            e.groups[g++] = t;
+        }
+    }
+    atomic_init(&e.next, 0);
+    atomic_init(&e.ok, true);
+    plan_open(p);
+
+    if (jobs > p->ngroups) jobs = p->ngroups;
+    if (jobs > PLAN_MAXJOBS) jobs = PLAN_MAXJOBS;
+    for (; jobs > 1 && started < jobs - 1; started++) {
+        if (pthread_create(&threads[started], NULL, plan_worker, &e) != 0) break;
+    }
+    plan_worker(&e);
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    if (sync && !plan_sync(p)) atomic_store(&e.ok, false);
+    for (size_t d = 0; d < p->ndirectories; d++) {
+        if (p->directories[d].fd >= 0) close(p->directories[d].fd);
+        p->directories[d].fd = AT_FDCWD;
+    }
+    free(e.groups);
+    return atomic_load(&e.ok);
+}
+
+/**
+ * Release plan.
+ * @param   p           Pointer to Plan structure
+ **/
+void    plan_delete(Plan *p) {
+    for (size_t t = 0; p->tasks && t < p->ntasks; t++) {
+        free(p->tasks[t].temp);
+    }
+    free(p->renames);
+    free(p->order);
+    free(p->tasks);
+    free(p->directories);
+    memset(p, 0, sizeof(Plan));
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */
@@ -0,0 +1,227 @@
+/* plan.unit.c: Rename plan unit test */
+
+#define _GNU_SOURCE     // asprintf
+
+#include "moveit.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Macros */
+
+#define streq(a, b) (strcmp(a, b) == 0)
+#define nargs(a)    (sizeof(a) / sizeof((a)[0]))
+
+#define TEMPLATE    "/tmp/plan.unit.XXXXXX"
+#define UNRELATED   200
+
+/* Functions */
+
+/**
+ * Create a temporary directory and make it the current directory.
+ * @param   root        Buffer of sizeof(TEMPLATE) bytes for its path
+ **/
+void enter_root(char *root) {
+    strcpy(root, TEMPLATE);
+    assert(mkdtemp(root));
+    assert(chdir(root) == 0);
+}
+
+/**
+ * Leave and remove temporary directory.
+ * @param   root        Path of temporary directory
+ **/
+void leave_root(const char *root) {
+    char command[BUFSIZ];
+    assert(chdir("/") == 0);
+    snprintf(command, BUFSIZ, "rm -fr %s", root);
+    assert(system(command) == 0);
+}
+
+/**
+ * Create file holding its own name as contents.
+ * @param   path        Path of file
+ **/
+void make_file(const char *path) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    assert(fd >= 0);
+    assert(write(fd, path, strlen(path)) == (ssize_t)strlen(path));
+    close(fd);
+}
+
+/**
+ * Determine if file at path holds the contents it was created with.
+ * @param   path        Path of file
+ * @param   name        Name file was created with
+ * @return  Whether or not file holds name.
+ **/
+bool holds(const char *path, const char *name) {
+    char buffer[BUFSIZ] = {0};
+    int  fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    ssize_t n = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    return n == (ssize_t)strlen(name) && streq(buffer, name);
+}
+
+/**
+ * Find position of rename from source in the order a plan carries it out.
+ * @param   p           Pointer to Plan structure
+ * @param   source      Source of rename
+ * @return  Position among renames executed (count if not planned).
+ **/
+size_t position(const Plan *p, const char *source) {
+    size_t n = 0;
+    for (size_t t = 0; t < p->ntasks; t++) {
+        for (size_t m = 0; m < p->tasks[t].count; m++, n++) {
+            if (streq(p->renames[p->order[p->tasks[t].start + m]].source, source)) return n;
+        }
+    }
+    return n;
+}
+
+/* Tests */
+
+int test_00_plan_nested() {
+    Plan p;
+
+    // Test: unrelated renames, swaps, and cycles are not nested
+    char *sources[] = {"a", "b", "c", "d", "e", "dir/f"};
+    char *targets[] = {"b", "a", "d", "e", "c", "dir/g"};
+    assert(plan_build(&p, sources, targets, nargs(sources)));
+    assert(!p.nested && p.count == 6 && p.ntasks == 3);
+    plan_delete(&p);
+
+    // Test: moving into a directory another rename creates is nested, and
+    // runs after it whichever is listed first
+    char *into[]    = {"y", "z", "x"};
+    char *created[] = {"d/y", "w", "d"};
+    assert(plan_build(&p, into, created, nargs(into)));
+    assert(p.nested && p.ngroups == 1);
+    assert(position(&p, "x") < position(&p, "y"));
+    plan_delete(&p);
+
+    // Test: moving out of a directory another rename removes runs first
+    char *out[]     = {"a", "a/f"};
+    char *removed[] = {"b", "a/g"};
+    assert(plan_build(&p, out, removed, nargs(out)));
+    assert(p.nested && position(&p, "a/f") < position(&p, "a"));
+    plan_delete(&p);
+
+    // Test: moving out of a directory another rename creates runs after it
+    char *from[]  = {"n/f", "m"};
+    char *to[]    = {"g", "n"};
+    assert(plan_build(&p, from, to, nargs(from)));
+    assert(p.nested && position(&p, "m") < position(&p, "n/f"));
+    plan_delete(&p);
+
+    // Test: contradictory dependencies still plan every rename
+    char *both[]    = {"a", "a/f"};
+    char *clashed[] = {"b", "b/f"};
+    assert(plan_build(&p, both, clashed, nargs(both)));
+    assert(p.nested && p.ntasks == 2 && position(&p, "a/f") < 2 && position(&p, "a") < 2);
+    plan_delete(&p);
+
+    // Test: ambiguous renames are refused
+    char *twice[] = {"a", "a"};
+    char *apart[] = {"b", "c"};
+    assert(!plan_build(&p, twice, apart, nargs(twice)));
+    plan_delete(&p);
+    char *pair[]   = {"a", "b"};
+    char *shared[] = {"c", "c"};
+    assert(!plan_build(&p, pair, shared, nargs(pair)));
+    plan_delete(&p);
+    return EXIT_SUCCESS;
+}
+
+int test_01_plan_execute() {
+    char   root[sizeof(TEMPLATE)];
+    char **sources = calloc(UNRELATED + 7, sizeof(char *));
+    char **targets = calloc(UNRELATED + 7, sizeof(char *));
+    size_t n = 0;
+    Plan   p;
+    assert(sources && targets);
+    enter_root(root);
+
+    // Test: a file moved into a directory that another rename creates,
+    // among many unrelated renames, with swaps and a cycle, on many threads
+    assert(mkdir("x", 0755) == 0);
+    make_file("y");
+    sources[n] = "y";   targets[n++] = "d/y";
+    sources[n] = "x";   targets[n++] = "d";
+    make_file("a");
+    make_file("b");
+    sources[n] = "a";   targets[n++] = "b";
+    sources[n] = "b";   targets[n++] = "a";
+    make_file("c1");
+    make_file("c2");
+    make_file("c3");
+    sources[n] = "c1";  targets[n++] = "c2";
+    sources[n] = "c2";  targets[n++] = "c3";
+    sources[n] = "c3";  targets[n++] = "c1";
+    for (size_t i = 0; i < UNRELATED; i++, n++) {
+        assert(asprintf(&sources[n], "f%zu", i) > 0);
+        assert(asprintf(&targets[n], "g%zu", i) > 0);
+        make_file(sources[n]);
+    }
+
+    assert(plan_build(&p, sources, targets, n));
+    assert(plan_execute(&p, 4, false));
+    plan_delete(&p);
+
+    struct stat st;
+    assert(stat("d", &st) == 0 && S_ISDIR(st.st_mode));
+    assert(holds("d/y", "y") && access("x", F_OK) < 0 && access("y", F_OK) < 0);
+    assert(holds("a", "b") && holds("b", "a"));
+    assert(holds("c2", "c1") && holds("c3", "c2") && holds("c1", "c3"));
+    for (size_t i = 7; i < n; i++) {
+        assert(holds(targets[i], sources[i]) && access(sources[i], F_OK) < 0);
+    }
+
+    // Test: a rename that fails does not stop unrelated ones
+    char *missing[] = {"nothing", "g0"};
+    char *moved[]   = {"something", "h0"};
+    assert(plan_build(&p, missing, moved, nargs(missing)));
+    assert(!plan_execute(&p, 4, true));
+    plan_delete(&p);
+    assert(holds("h0", "f0") && access("something", F_OK) < 0);
+
+    for (size_t i = 7; i < n; i++) {
+        free(sources[i]);
+        free(targets[i]);
+    }
+    free(sources);
+    free(targets);
+    leave_root(root);
+    return EXIT_SUCCESS;
+}
+
+/* Main Execution */
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s NUMBER\n\n", argv[0]);
+        fprintf(stderr, "Where NUMBER is right of the following:\n");
+        fprintf(stderr, "    0  Test plan nested\n");
+        fprintf(stderr, "    1  Test plan execute\n");
+        return EXIT_FAILURE;
+    }
+
+    int number = atoi(argv[1]);
+    int status = EXIT_FAILURE;
+
+    switch (number) {
+        case 0:  status = test_00_plan_nested(); break;
+        case 1:  status = test_01_plan_execute(); break;
+        default: fprintf(stderr, "Unknown NUMBER: %d\n", number); break;
+    }
+
+    return status;
+}
+
+/* vim: set sts=4 sw=4 ts=8 expandtab ft=c: */